@@ -1,44 +1,126 @@
+#define _POSIX_C_SOURCE 199309L
 #include <stdbool.h>
+#include <limits.h>
 #include <string.h>
-#include <pthread.h>
+#include <ctype.h>
+#include <math.h>
 #include <assert.h>
+#include <time.h>
+#include "batch_manager.h"
 #include "client_context.h"
 #include "utils.h"
-
-#define QUERIES_PER_THREAD 8
-#define CHUNK_PROCESSING_SIZE ((int) 1 << 16)
-#define MAX_THREAD_COUNT 4
-#define DBO_CHUNK_SIZE 4
-
+#include "db_reads.h"
+#include "db_reads_indexed.h"
+#include "db_sample.h"
+#include "parse.h"
+#include "worker_pool.h"
+#include "hardware.h"
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
+
+// most queries a task takes on, each one adds a bitvector to its working set.
+// the default until calibration picks one
+#define MAX_QUERIES_PER_TASK 32
+// fewest values a task scans, so scheduling stays cheap next to the work
+#define MIN_CHUNK_PROCESSING_SIZE ((int) 1 << 12)
+// tasks we aim for per thread, so stealing can even out the load. the
+// default until calibration picks one
+#define TASKS_PER_THREAD 4
+// batches this big look up each value's queries instead of checking them all
+#define INTERVAL_SCAN_MIN_QUERIES 32
+// most (interval, query) pairs we'll materialize for those lookups
+#define INTERVAL_SCAN_MAX_MATCHES ((int) 1 << 22)
+// most selects, fetches or aggregates that wait for a cooperative scan
+// before we run it anyway
+#define COOPERATIVE_SCAN_MAX_QUERIES 1024
+// most arguments we read from a command to decide whether it can wait
+#define COOPERATIVE_SCAN_MAX_ARGS 4
+// bitvector ints each shared fetch task covers, 32K positions
+#define SHARED_FETCH_CHUNK_INTS 1024
+// smallest position list a columnwise task starts a chunk with, and how far
+// over the sample's estimate we size them
+#define PARTIAL_POSITIONS_MIN_CAPACITY 16
+#define PARTIAL_POSITIONS_SLACK 1.25
+// relative costs the batch planner weighs, in units of streaming one value
+// through a scan. checking another range against a value is a couple of
+// vector instructions shared by 32 values, while a probe misses the cache
+// at each level of a search and, unclustered, for each match's bit
+#define SCAN_COST_PER_VALUE 1.0
+#define SCAN_COST_PER_QUERY_VALUE 0.25
+#define PROBE_COST_PER_LEVEL 8.0
+#define PROBE_COST_PER_MATCH 4.0
+#define PROBE_COST_PER_MATCH_CLUSTERED (1.0 / 32)
+// ints per vector, and vectors per bitvector int's worth of values
+#define SCAN_LANES 4
+#define SCAN_BLOCK_VECTORS ((int) (BITS_PER_INT / SCAN_LANES))
+// unaligned, columns are only int aligned
+typedef int v4si __attribute__((vector_size(SCAN_LANES * sizeof(int)), aligned(sizeof(int))));
+// values in the synthetic column calibrated on before the first shared scan, 1MB
+#define CALIBRATION_VALUES ((int) 1 << 18)
+// queries in a calibration batch, the most the per query kernel takes on
+#define CALIBRATION_QUERIES (INTERVAL_SCAN_MIN_QUERIES - 1)
+// times each setting is run, keeping the fastest
+#define CALIBRATION_RUNS 2
+// how much faster a setting has to be to replace the best so far, so timing
+// noise doesn't move us off the defaults
+#define CALIBRATION_MIN_GAIN 0.95
+
+// the knobs shared scans run with, cache sized chunks over the whole pool
+// until calibration says otherwise
+static SharedScanTuning shared_scan_tuning = { 0, MAX_QUERIES_PER_TASK, TASKS_PER_THREAD, 0 };
+// calibrating takes a few dozen scans, so it waits for the first real one
+static bool shared_scan_calibrated = false;
+
+
+// fetches waiting to share a pass over their columns
+static SharedScanDbOperators shared_fetch_operators = { 0, 0, NULL };
+
+// an aggregate over a waiting fetch, held as text until the fetch has run
+typedef struct HeldAggregate {
+    char handle[HANDLE_MAX_SIZE];
+    char input[HANDLE_MAX_SIZE]; // the fetch it aggregates
+    char* command;
+} HeldAggregate;
+
+static HeldAggregate* held_aggregates = NULL;
+static int num_held_aggregates = 0;
+static int held_aggregate_slots = 0;
+
+// the first error from a statement the client already heard back about,
+// kept until it can be reported on the command that made it run
+static message_status deferred_status = OK_DONE;
+static char* deferred_error = NULL;
 
 /*
- * add_shared_dbo receives a dbo to add to the batch of queries to be processed together
+ * appends a dbo to a batch, growing it if necessary
  */
-void add_shared_dbo(DbOperator* dbo) {
+static void append_dbo(SharedScanDbOperators* operators, DbOperator* dbo) {
     // check if we need to resize
-    if (shared_scan_operators.num_dbos == shared_scan_operators.dbo_slots) {
+    if (operators->num_dbos == operators->dbo_slots) {
         // get reference to old dbos and size
-        DbOperator** old_dbos = shared_scan_operators.dbos;
-        int old_size = shared_scan_operators.dbo_slots;
+        DbOperator** old_dbos = operators->dbos;
+        int old_size = operators->dbo_slots;
         // update the size
-        shared_scan_operators.dbo_slots = 2 * old_size;
+        operators->dbo_slots = old_size == 0 ? SHARED_QUERY_START_SIZE : 2 * old_size;
         // allocate more space, copy old data in
-        shared_scan_operators.dbos = malloc(sizeof(DbOperator*) * shared_scan_operators.dbo_slots);
-        memcpy(shared_scan_operators.dbos, old_dbos, (sizeof(DbOperator*) * old_size)); 
+        operators->dbos = malloc(sizeof(DbOperator*) * operators->dbo_slots);
+        if (old_dbos != NULL) {
+            memcpy(operators->dbos, old_dbos, (sizeof(DbOperator*) * old_size));
+        }
         // free old dbo references
         free(old_dbos);
     }
 
-    // only doing selects for now
-    // if we don't have the column being used yet, set it
-    if (shared_scan_operators.col == NULL) {
-        shared_scan_operators.col = dbo->operator_fields.select_operator.compare_info->gen_col.column_pointer.column;
-        shared_scan_operators.num_entries = dbo->operator_fields.select_operator.num_results;
-    }
-
     // add this dbo and increment the number of dbos we have
-    shared_scan_operators.dbos[shared_scan_operators.num_dbos++] = dbo;
+    operators->dbos[operators->num_dbos++] = dbo;
+}
 
+/*
+ * add_shared_dbo receives a dbo to add to the batch of queries to be processed together
+ */
+void add_shared_dbo(DbOperator* dbo) {
+    append_dbo(&shared_scan_operators, dbo);
     return;
 }
 
@@ -58,10 +140,12 @@ DbOperator* construct_batch_operator() {
 }
 
 bool validate_shared_scan() {
-    // make sure every select operator is referring to the column we care about
+    // make sure every operator is a select over a column. they're grouped by
+    // column when the batch runs, so the columns can differ
     for (int i = 0; i < shared_scan_operators.num_dbos; ++i) {
         DbOperator* current_dbo = shared_scan_operators.dbos[i];
-        if (current_dbo->operator_fields.select_operator.compare_info->gen_col.column_pointer.column != shared_scan_operators.col) {
+        if (current_dbo->type != SELECT ||
+            current_dbo->operator_fields.select_operator.compare_info->gen_col.column_type != COLUMN) {
             return false;
         }
     }
@@ -69,11 +153,23 @@ bool validate_shared_scan() {
     return true;
 }
 
-// simple data structure to wrap a results array with its current count
+// one query's matching positions within one chunk, grown by the only task
+// that writes them
+typedef struct PartialPositions {
+    int* positions;
+    int count;
+    int capacity;
+} PartialPositions;
+
+// simple data structure to wrap a results array with its current count. the
+// result is put together from one partial list per chunk once every task is
+// done
 typedef struct ResultAndCount {
     int* result;
     int count;
     struct DbOperator** dbos;
+    PartialPositions* partials; // one per chunk of its column
+    int num_partials;
 } ResultAndCount;
 
 // simple data structure to wrap a results array with its current count
@@ -86,9 +182,31 @@ typedef struct ResultAndCountBitVector {
 typedef struct SharedScanThreadObj {
     struct ResultAndCount* results_and_counts;
     int num_queries; // how many queries the thread needs to execute
+    int chunk; // which of its queries' partial lists it fills
+    int* data_start; // the chunk of the column its queries select from
+    int data_offset; // position of the chunk's first value
+    int data_sz;
 } SharedScanThreadObj;
 
-struct TaskList;
+// the queries of a batch over one column. the batch's dbos are ordered so
+// each column's queries sit next to each other, starting at first_query
+typedef struct SharedScanColumn {
+    Column* col;
+    int num_entries;
+    int first_query;
+    int num_queries;
+} SharedScanColumn;
+
+// the batch's predicate endpoints, sorted, split the values into intervals
+// that each match a fixed set of queries. interval i is
+// [endpoints[i], endpoints[i + 1]) and its queries are
+// matches[match_offsets[i]] up to matches[match_offsets[i + 1]]
+typedef struct SharedScanIntervals {
+    int num_endpoints;
+    long* endpoints;
+    int* match_offsets;
+    int* matches;
+} SharedScanIntervals;
 
 // object used by a thread to perform a unit of work (this is a task)
 typedef struct SharedScanThreadObjBitVector {
@@ -97,165 +215,336 @@ typedef struct SharedScanThreadObjBitVector {
     int data_sz;
     int* data_start;
     int result_offset;
-    struct TaskList* task_list_head;
+    SharedScanIntervals* intervals; // NULL to check every query per value
+    int* counts; // this task's matches for each of its queries
 } SharedScanThreadObjBitVector;
 
-// list of tasks
-typedef struct TaskList {
-    bool is_head;
-    struct TaskList* next;
-    struct SharedScanThreadObjBitVector* sst_obj;
-    pthread_mutex_t* lock;
-} TaskList;
-
-// information that execute_shared_scan_bitvector uses to clean up memory
-// after executing the shared scan
+// information that execute_shared_scan_bitvector uses to run the tasks and
+// clean up memory after executing the shared scan
 typedef struct SharedScanToFree {
-    struct TaskList* task_list_head;
     struct ResultAndCountBitVector* results_and_counts;
     struct SharedScanThreadObjBitVector* sst_objs;
+    int num_tasks;
+    struct SharedScanIntervals** intervals; // one per column, NULL if unused
+    int num_columns;
+    int* task_counts; // every task's counts, back to back
 } SharedScanToFree;
 
-// push a task onto our queue, add it to the front
-void task_list_push(TaskList* task_list_head, SharedScanThreadObjBitVector* sst_obj) {
-    assert(task_list_head && task_list_head->is_head);
-
-    // grab the lock
-    pthread_mutex_lock(task_list_head->lock);
+/*
+ * orders a batch's selects or fetches so each column's queries sit next to
+ * each other, keeping their order within a column, and describes each
+ * column's group. returns the number of columns
+ */
+static int group_shared_scan_columns(SharedScanDbOperators* operators, SharedScanColumn** columns_out) {
+    int num_dbos = operators->num_dbos;
+    SharedScanColumn* columns = malloc(sizeof(SharedScanColumn) * (num_dbos + 1));
+    int* column_of = malloc(sizeof(int) * (num_dbos + 1));
+    int num_columns = 0;
+    for (int i = 0; i < num_dbos; ++i) {
+        DbOperator* dbo = operators->dbos[i];
+        Column* col;
+        int num_entries;
+        if (dbo->type == FETCH) {
+            col = dbo->operator_fields.fetch_operator.column;
+            num_entries = dbo->operator_fields.fetch_operator.table->table_size;
+        } else {
+            col = dbo->operator_fields.select_operator.compare_info->gen_col.column_pointer.column;
+            num_entries = dbo->operator_fields.select_operator.num_results;
+        }
+        // batches touch a handful of columns, a linear search is plenty
+        int c = 0;
+        while (c < num_columns && columns[c].col != col) {
+            ++c;
+        }
+        if (c == num_columns) {
+            columns[c].col = col;
+            columns[c].num_entries = num_entries;
+            columns[c].num_queries = 0;
+            ++num_columns;
+        }
+        column_of[i] = c;
+        ++columns[c].num_queries;
+    }
 
-    // create a new TaskList item and add it to the end
-    TaskList* new_task_list_item = malloc(sizeof(TaskList));
-    new_task_list_item->next = NULL;
-    new_task_list_item->sst_obj = sst_obj;
-    new_task_list_item->is_head = false;
-    new_task_list_item->lock = NULL;
+    // turn the counts into offsets, then place each query after the ones
+    // before it on its column
+    int offset = 0;
+    for (int c = 0; c < num_columns; ++c) {
+        columns[c].first_query = offset;
+        offset += columns[c].num_queries;
+    }
+    int* fill = calloc(num_columns + 1, sizeof(int));
+    DbOperator** grouped_dbos = malloc(sizeof(DbOperator*) * operators->dbo_slots);
+    for (int i = 0; i < num_dbos; ++i) {
+        int c = column_of[i];
+        grouped_dbos[columns[c].first_query + fill[c]++] = operators->dbos[i];
+    }
+    free(operators->dbos);
+    operators->dbos = grouped_dbos;
+    free(fill);
+    free(column_of);
 
-    // assign to front of task list
-    new_task_list_item->next = task_list_head->next;
-    task_list_head->next = new_task_list_item;
+    *columns_out = columns;
+    return num_columns;
+}
 
-    // unlock mutex
-    pthread_mutex_unlock(task_list_head->lock);
+/*
+ * comparison function for sorting endpoints
+ */
+static int compare_endpoints(const void* a, const void* b) {
+    long endpoint_a = *((const long*) a);
+    long endpoint_b = *((const long*) b);
+    return (endpoint_a > endpoint_b) - (endpoint_a < endpoint_b);
+}
 
-    return;
+/*
+ * returns the index of the last endpoint <= value, or -1 if there isn't one
+ */
+static int find_interval(long* endpoints, int num_endpoints, long value) {
+    int low = 0;
+    int high = num_endpoints;
+    while (low < high) {
+        int mid = low + ((high - low) / 2);
+        if (endpoints[mid] <= value) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low - 1;
 }
 
-// remove the next unit of work from our queue, get it from the back
-SharedScanThreadObjBitVector* task_list_pop(TaskList* task_list_head) {
-    assert(task_list_head && task_list_head->is_head);
+/*
+ * sorts the predicate endpoints of a column's queries and lists the queries
+ * matching each interval between them. returns NULL if the lists would be too big, in
+ * which case we check every query per value instead
+ */
+static SharedScanIntervals* build_shared_scan_intervals(DbOperator** dbos, int num_queries) {
+    // every query contributes its low and high endpoint
+    long* endpoints = malloc(sizeof(long) * 2 * num_queries);
+    for (int i = 0; i < num_queries; ++i) {
+        Comparator* compare_info = dbos[i]->operator_fields.select_operator.compare_info;
+        endpoints[2 * i] = compare_info->p_low;
+        endpoints[(2 * i) + 1] = compare_info->p_high;
+    }
+    qsort(endpoints, 2 * num_queries, sizeof(long), compare_endpoints);
+    int num_endpoints = 0;
+    for (int i = 0; i < 2 * num_queries; ++i) {
+        if (num_endpoints == 0 || endpoints[num_endpoints - 1] != endpoints[i]) {
+            endpoints[num_endpoints++] = endpoints[i];
+        }
+    }
+
+    // a query matches every interval from its low endpoint up to its high
+    // one. count them per interval, then turn the counts into offsets
+    int* match_offsets = calloc(num_endpoints + 1, sizeof(int));
+    long total_matches = 0;
+    for (int i = 0; i < num_queries; ++i) {
+        Comparator* compare_info = dbos[i]->operator_fields.select_operator.compare_info;
+        int first = find_interval(endpoints, num_endpoints, compare_info->p_low);
+        int last = find_interval(endpoints, num_endpoints, compare_info->p_high);
+        for (int j = first; j < last; ++j) {
+            ++match_offsets[j + 1];
+        }
+        total_matches += last > first ? last - first : 0;
+        if (total_matches > INTERVAL_SCAN_MAX_MATCHES) {
+            log_info("too many overlapping ranges for an interval scan\n");
+            free(endpoints);
+            free(match_offsets);
+            return NULL;
+        }
+    }
+    for (int i = 0; i < num_endpoints; ++i) {
+        match_offsets[i + 1] += match_offsets[i];
+    }
+    int* matches = malloc(sizeof(int) * (total_matches + 1));
+    int* fill = malloc(sizeof(int) * (num_endpoints + 1));
+    memcpy(fill, match_offsets, sizeof(int) * (num_endpoints + 1));
+    for (int i = 0; i < num_queries; ++i) {
+        Comparator* compare_info = dbos[i]->operator_fields.select_operator.compare_info;
+        int first = find_interval(endpoints, num_endpoints, compare_info->p_low);
+        int last = find_interval(endpoints, num_endpoints, compare_info->p_high);
+        for (int j = first; j < last; ++j) {
+            matches[fill[j]++] = i;
+        }
+    }
+    free(fill);
+
+    SharedScanIntervals* intervals = malloc(sizeof(SharedScanIntervals));
+    intervals->num_endpoints = num_endpoints;
+    intervals->endpoints = endpoints;
+    intervals->match_offsets = match_offsets;
+    intervals->matches = matches;
+    return intervals;
+}
 
-    // grab the lock
-    pthread_mutex_lock(task_list_head->lock);
+/*
+ * frees the interval lookup built for a batch
+ */
+static void free_shared_scan_intervals(SharedScanIntervals* intervals) {
+    if (intervals == NULL) {
+        return;
+    }
+    free(intervals->endpoints);
+    free(intervals->match_offsets);
+    free(intervals->matches);
+    free(intervals);
+}
 
-    // find the end
-    // done if this is the only node
-    if (task_list_head->next == NULL) {
-        // unlock mutex
-        pthread_mutex_unlock(task_list_head->lock);
+/*
+ * returns the table of the current database a column belongs to, or NULL
+ */
+static Table* column_table(Column* column) {
+    if (current_db == NULL) {
         return NULL;
     }
-    TaskList* current_tl = task_list_head;
-    TaskList* prev = NULL;
-    while (current_tl->next) {
-        prev = current_tl;
-        current_tl = current_tl->next;
-    }
-    // chop off this node
-    prev->next = NULL;
-    // grab our return value
-    SharedScanThreadObjBitVector* sst_obj = current_tl->sst_obj;
-    // free the node
-    free(current_tl);
-
-    // unlock mutex
-    pthread_mutex_unlock(task_list_head->lock);
-
-    // return the sst_obj
-    return sst_obj;
-}
-
-// free the task list head, clean up other things
-void free_task_list_head(TaskList* task_list_head) {
-    assert(task_list_head && task_list_head->is_head);
-    // destroy the lock
-    pthread_mutex_destroy(task_list_head->lock);
-    free(task_list_head->lock);
-    free(task_list_head);
-    return;
+    for (size_t i = 0; i < current_db->tables_size; ++i) {
+        Table* table = &(current_db->tables[i]);
+        if (column >= table->columns && column < table->columns + table->col_size) {
+            return table;
+        }
+    }
+    return NULL;
 }
 
-// initialize the list of tasks
-SharedScanToFree setup_task_list(void) {
-    // ALLOCATE AND INITIALIZE OBJECTS FOR SHARED SCANS
-    // to free: results_and_counts, sst_objs, task list
+/*
+ * returns how many threads a shared scan runs on
+ */
+static int shared_scan_threads(void) {
+    int pool_threads = worker_pool_threads();
+    if (shared_scan_tuning.num_threads > 0 && shared_scan_tuning.num_threads < pool_threads) {
+        return shared_scan_tuning.num_threads;
+    }
+    return pool_threads;
+}
 
-    int num_bitvector_ints = num_bitvector_ints_needed(shared_scan_operators.num_entries);
-    log_info("how many bitvector_ints %d\n", num_bitvector_ints);
-    // allocate results/counts array for each dbo
-    ResultAndCountBitVector* results_and_counts = malloc(sizeof(ResultAndCountBitVector) * shared_scan_operators.num_dbos);
-    for (int i = 0; i < shared_scan_operators.num_dbos; ++i) {
-        results_and_counts[i].result = calloc(num_bitvector_ints, sizeof(int));
-        results_and_counts[i].count = 0;
-        results_and_counts[i].dbos = shared_scan_operators.dbos + i;
+/*
+ * picks how many values each shared scan task scans. a chunk of the column
+ * plus a bitvector for each of its queries should sit in L2, and every
+ * thread's chunk should fit in the L3 they share
+ */
+static int shared_scan_chunk_size(int num_threads, int queries_per_task) {
+    if (shared_scan_tuning.chunk_size > 0) {
+        return shared_scan_tuning.chunk_size;
+    }
+    // a value costs its int plus a bit per query
+    long bytes_per_value = sizeof(int) + ((queries_per_task + 7) / 8);
+    long chunk_size = cache_size(2) / (2 * bytes_per_value);
+    long shared_chunk_size = cache_size(3) / (2 * bytes_per_value * num_threads);
+    if (shared_chunk_size < chunk_size) {
+        chunk_size = shared_chunk_size;
+    }
+    // round down to a power of 2, which also keeps chunks on bitvector int
+    // boundaries
+    int rounded_chunk_size = MIN_CHUNK_PROCESSING_SIZE;
+    while ((long) rounded_chunk_size * 2 <= chunk_size) {
+        rounded_chunk_size *= 2;
     }
+    return rounded_chunk_size;
+}
 
-    // calculate number of tasks needed: based on number of queries and size of data
-    // #1: number of queries portion
-    int num_query_chunks = shared_scan_operators.num_dbos / QUERIES_PER_THREAD;
-    // add one more if not evenly split
-    if (shared_scan_operators.num_dbos % QUERIES_PER_THREAD > 0) {
-        ++num_query_chunks;
+/*
+ * picks how many queries each shared scan task checks its chunk against,
+ * splitting the batch finely enough that every thread has work to steal
+ */
+static int shared_scan_queries_per_task(int num_queries, int num_data_chunks, int num_threads) {
+    int target_tasks = num_threads * shared_scan_tuning.tasks_per_thread;
+    int num_query_groups = (target_tasks + num_data_chunks - 1) / num_data_chunks;
+    int max_queries_per_task = shared_scan_tuning.queries_per_task;
+    int min_query_groups = (num_queries + max_queries_per_task - 1) / max_queries_per_task;
+    if (num_query_groups < min_query_groups) {
+        num_query_groups = min_query_groups;
+    }
+    if (num_query_groups > num_queries) {
+        num_query_groups = num_queries;
+    }
+    if (num_query_groups < 1) {
+        return 1;
     }
-    // #2: size of data portion
-    int num_data_chunks = shared_scan_operators.num_entries / CHUNK_PROCESSING_SIZE;
+    return (num_queries + num_query_groups - 1) / num_query_groups;
+}
+
+/*
+ * sets up the tasks that scan one column for its queries, in chunk order.
+ * num_threads is the column's share of the pool, which decides how finely
+ * the queries are split. stores the column's interval lookup, if it uses
+ * one, in intervals_out and its number of tasks in num_tasks_out
+ */
+static SharedScanThreadObjBitVector* setup_shared_scan_column_tasks(SharedScanColumn* column,
+    ResultAndCountBitVector* results_and_counts, int num_threads, SharedScanIntervals** intervals_out,
+    int* num_tasks_out) {
+    DbOperator** dbos = shared_scan_operators.dbos + column->first_query;
+    int num_dbos = column->num_queries;
+    int num_entries = column->num_entries;
+
+    // big batches look up each value's queries by its interval between the
+    // sorted predicate endpoints, so every task takes on every query
+    SharedScanIntervals* intervals = NULL;
+    if (num_dbos >= INTERVAL_SCAN_MIN_QUERIES) {
+        intervals = build_shared_scan_intervals(dbos, num_dbos);
+    }
+
+    // calculate number of tasks needed: based on size of data, number of
+    // queries and how many threads we have to keep busy
+    // #1: size of data portion. every thread in the pool is scanning
+    // something, so they all share the L3
+    int chunk_processing_size;
+    int num_data_chunks;
+    if (intervals == NULL) {
+        chunk_processing_size = shared_scan_chunk_size(shared_scan_threads(), shared_scan_tuning.queries_per_task);
+    } else {
+        chunk_processing_size = shared_scan_chunk_size(shared_scan_threads(), num_dbos);
+        // only the data is split now, so split it finely enough to go around
+        while (chunk_processing_size > MIN_CHUNK_PROCESSING_SIZE &&
+               (long) chunk_processing_size * num_threads * shared_scan_tuning.tasks_per_thread > num_entries) {
+            chunk_processing_size /= 2;
+        }
+    }
+    num_data_chunks = num_entries / chunk_processing_size;
     // add one more if not evenly split
-    if (shared_scan_operators.num_entries % CHUNK_PROCESSING_SIZE > 0) {
+    if (num_entries % chunk_processing_size > 0) {
         ++num_data_chunks;
     }
+    // #2: number of queries portion
+    int queries_per_task = num_dbos;
+    if (intervals == NULL) {
+        queries_per_task = shared_scan_queries_per_task(num_dbos, num_data_chunks, num_threads);
+    }
+    int num_query_chunks = num_dbos / queries_per_task;
+    // add one more if not evenly split
+    if (num_dbos % queries_per_task > 0) {
+        ++num_query_chunks;
+    }
+    log_info("shared scan: %d threads, chunks of %d, %d queries per task\n", num_threads, chunk_processing_size, queries_per_task);
 
     int total_units_of_work = num_query_chunks * num_data_chunks;
 
     // allocate all the needed SharedScanThreadObjBitVector, which is an
     // individual unit of work for a thread
-    SharedScanThreadObjBitVector* sst_objs = malloc(sizeof(SharedScanThreadObjBitVector) * total_units_of_work); 
-
-    // create a lock for our task list
-    pthread_mutex_t* lock = malloc(sizeof(pthread_mutex_t));
-    // initialize it
-    if (pthread_mutex_init(lock, NULL) != 0) {
-        // TODO: error handle
-        log_err("Failed to create mutex\n");
-    }
-
-    // setup these units of work in a task list
-    TaskList* task_list_head = malloc(sizeof(TaskList));
-    task_list_head->next = NULL;
-    task_list_head->sst_obj = NULL;
-    task_list_head->is_head = true;
-    task_list_head->lock = lock;
+    SharedScanThreadObjBitVector* sst_objs = malloc(sizeof(SharedScanThreadObjBitVector) * (total_units_of_work + 1));
 
     // organize work units
     // loops through our data one data chunk at a time
     for (int c = 0; c < num_data_chunks; ++c) {
 
-        int data_offset = c * CHUNK_PROCESSING_SIZE;
+        int data_offset = c * chunk_processing_size;
         int result_offset = data_offset / BITS_PER_INT;
-        int data_sz = CHUNK_PROCESSING_SIZE;
-        if (shared_scan_operators.num_entries - data_offset < data_sz) {
-            data_sz = shared_scan_operators.num_entries - data_offset;
+        int data_sz = chunk_processing_size;
+        if (num_entries - data_offset < data_sz) {
+            data_sz = num_entries - data_offset;
         }
-        int* data_start = shared_scan_operators.col->data + data_offset;
+        int* data_start = column->col->data + data_offset;
 
         // assign to a unit of work (SharedScanThreadObjBitVector)
         for (int i = 0; i < num_query_chunks; ++i) {
             // get start of ResultAndCount
-            ResultAndCountBitVector* start_res_and_count = results_and_counts + (i * QUERIES_PER_THREAD);
+            ResultAndCountBitVector* start_res_and_count = results_and_counts + column->first_query + (i * queries_per_task);
             // create the thread obj
-            int num_queries = QUERIES_PER_THREAD;
+            int num_queries = queries_per_task;
             // account for the last set of queries, which might not divide 
-            // QUERIES_PER_THREAD evenly
-            if (shared_scan_operators.num_dbos - (QUERIES_PER_THREAD * i) < QUERIES_PER_THREAD) {
-                num_queries = shared_scan_operators.num_dbos - (QUERIES_PER_THREAD * i);
+            // queries_per_task evenly
+            if (num_dbos - (queries_per_task * i) < queries_per_task) {
+                num_queries = num_dbos - (queries_per_task * i);
             }
             log_info("num_queries at creation time: %d\n", num_queries);
             SharedScanThreadObjBitVector* sst_obj = sst_objs + (c * num_query_chunks) + i;
@@ -264,335 +553,331 @@ SharedScanToFree setup_task_list(void) {
             sst_obj->data_sz = data_sz;
             sst_obj->data_start = data_start;
             sst_obj->result_offset = result_offset;
-            sst_obj->task_list_head = task_list_head;
+            sst_obj->intervals = intervals;
+        }
+    }
+    *intervals_out = intervals;
+    *num_tasks_out = total_units_of_work;
+    return sst_objs;
+}
+
+// initialize the tasks for the worker pool
+SharedScanToFree setup_shared_scan_tasks(SharedScanColumn* columns, int num_columns) {
+    // ALLOCATE AND INITIALIZE OBJECTS FOR SHARED SCANS
+    // to free: results_and_counts, sst_objs, intervals
+
+    // allocate results/counts array for each dbo, sized for its column
+    ResultAndCountBitVector* results_and_counts = malloc(sizeof(ResultAndCountBitVector) * shared_scan_operators.num_dbos);
+    for (int c = 0; c < num_columns; ++c) {
+        int num_bitvector_ints = num_bitvector_ints_needed(columns[c].num_entries);
+        log_info("how many bitvector_ints %d\n", num_bitvector_ints);
+        for (int i = columns[c].first_query; i < columns[c].first_query + columns[c].num_queries; ++i) {
+            results_and_counts[i].result = calloc(num_bitvector_ints, sizeof(int));
+            results_and_counts[i].count = 0;
+            results_and_counts[i].dbos = shared_scan_operators.dbos + i;
+        }
+    }
+
+    // each column scan gets its share of the pool
+    int column_threads = (shared_scan_threads() + num_columns - 1) / num_columns;
+    SharedScanIntervals** intervals = malloc(sizeof(SharedScanIntervals*) * num_columns);
+    SharedScanThreadObjBitVector** column_tasks = malloc(sizeof(SharedScanThreadObjBitVector*) * num_columns);
+    int* column_num_tasks = malloc(sizeof(int) * num_columns);
+    int total_units_of_work = 0;
+    for (int c = 0; c < num_columns; ++c) {
+        column_tasks[c] = setup_shared_scan_column_tasks(columns + c, results_and_counts, column_threads,
+                                                         intervals + c, column_num_tasks + c);
+        total_units_of_work += column_num_tasks[c];
+    }
 
-            // add to task list
-            task_list_push(task_list_head, sst_obj);
+    // interleave the columns' tasks so the pool deals every thread a mix of
+    // columns and all the scans finish together
+    SharedScanThreadObjBitVector* sst_objs = malloc(sizeof(SharedScanThreadObjBitVector) * total_units_of_work);
+    int num_tasks = 0;
+    for (int k = 0; num_tasks < total_units_of_work; ++k) {
+        for (int c = 0; c < num_columns; ++c) {
+            if (k < column_num_tasks[c]) {
+                sst_objs[num_tasks++] = column_tasks[c][k];
+            }
         }
     }
-    SharedScanToFree to_free = { task_list_head, results_and_counts, sst_objs };
+    for (int c = 0; c < num_columns; ++c) {
+        free(column_tasks[c]);
+    }
+    free(column_tasks);
+    free(column_num_tasks);
+
+    // each task counts its matches on its own, no task shares a count
+    int total_task_queries = 0;
+    for (int i = 0; i < total_units_of_work; ++i) {
+        total_task_queries += sst_objs[i].num_queries;
+    }
+    int* task_counts = calloc(total_task_queries + 1, sizeof(int));
+    total_task_queries = 0;
+    for (int i = 0; i < total_units_of_work; ++i) {
+        sst_objs[i].counts = task_counts + total_task_queries;
+        total_task_queries += sst_objs[i].num_queries;
+    }
+
+    SharedScanToFree to_free = { results_and_counts, sst_objs, total_units_of_work, intervals, num_columns, task_counts };
     // for freeing from the caller
     return to_free;
 }
 
 /*
- * shared_scan_helper is a helper function that does the actual scanning
+ * shared_scan_helper is a helper function that does the actual scanning. the
+ * chunk stays in cache while each of its queries takes a pass over it,
+ * appending matches to that query's partial list for the chunk
  */
 void* shared_scan_helper(void* sst_obj_void) {
     SharedScanThreadObj* sst_obj = (SharedScanThreadObj*) sst_obj_void;
     log_info("USING THREADS, num_queries: %d\n", sst_obj->num_queries);
     // access result and count
     ResultAndCount* results_and_counts = sst_obj->results_and_counts;
-    // iterate through all our data, perform the comparison at each step
-    for (int i = 0; i < shared_scan_operators.num_entries; ++i) {
-        // get current value from base data
-        int current_val = shared_scan_operators.col->data[i];
-        // iterate over each dbo
-        for (int j = 0; j < sst_obj->num_queries; ++j) {
-            Comparator* current_compare_info = results_and_counts->dbos[j]->operator_fields.select_operator.compare_info;
-            // access the result/count for this query
-            ResultAndCount* current_res_and_count = &results_and_counts[j];
-            // if it passes the check, add it to the results
-            if (current_val < current_compare_info->p_high && current_val >= current_compare_info->p_low) {
-                // add it and increment the count
-                current_res_and_count->result[current_res_and_count->count++] = i;
+    for (int j = 0; j < sst_obj->num_queries; ++j) {
+        Comparator* current_compare_info = results_and_counts[j].dbos[0]->operator_fields.select_operator.compare_info;
+        long low = current_compare_info->p_low;
+        long high = current_compare_info->p_high;
+        // only this task touches this list
+        PartialPositions* partial = &(results_and_counts[j].partials[sst_obj->chunk]);
+        int capacity = partial->capacity;
+        int* positions = malloc(sizeof(int) * capacity);
+        int count = 0;
+        for (int i = 0; i < sst_obj->data_sz; ++i) {
+            int current_val = sst_obj->data_start[i];
+            if (current_val < high && current_val >= low) {
+                // the estimate was low, double size
+                if (count == capacity) {
+                    capacity *= 2;
+                    positions = realloc(positions, sizeof(int) * capacity);
+                }
+                positions[count++] = sst_obj->data_offset + i;
             }
         }
+        partial->positions = positions;
+        partial->count = count;
+        partial->capacity = capacity;
+    }
+    return NULL;
+}
+
+/*
+ * puts one query's partial lists together in chunk order, which is position
+ * order, into an exactly sized result
+ */
+static void* concatenate_partial_positions(void* res_and_count_void) {
+    ResultAndCount* res_and_count = (ResultAndCount*) res_and_count_void;
+    int count = 0;
+    for (int c = 0; c < res_and_count->num_partials; ++c) {
+        count += res_and_count->partials[c].count;
+    }
+    // plus 1 so an empty result is still a valid allocation
+    int* result = malloc(sizeof(int) * (count + 1));
+    int offset = 0;
+    for (int c = 0; c < res_and_count->num_partials; ++c) {
+        PartialPositions* partial = &(res_and_count->partials[c]);
+        memcpy(result + offset, partial->positions, sizeof(int) * partial->count);
+        offset += partial->count;
+        free(partial->positions);
     }
+    free(res_and_count->partials);
+    res_and_count->partials = NULL;
+    res_and_count->result = result;
+    res_and_count->count = count;
     return NULL;
 }
 
+/*
+ * turns a comparison result (every lane all ones or all zeros) into one bit
+ * per lane
+ */
+static inline unsigned int lane_mask_bits(v4si mask) {
+#ifdef __SSE2__
+    return (unsigned int) _mm_movemask_ps((__m128) mask);
+#else
+    return (mask[0] & 1) | (mask[1] & 2) | (mask[2] & 4) | (mask[3] & 8);
+#endif
+}
+
+/*
+ * scans a chunk for a group of queries. values are loaded a bitvector int's
+ * worth at a time and stay in registers while every query's range is
+ * checked against them with vector compares, so each query writes whole
+ * bitvector ints and counts them with a popcount
+ */
 void* shared_scan_helper_bitvector(SharedScanThreadObjBitVector* sst_obj) {
     log_info("USING THREADS, num_queries: %d\n", sst_obj->num_queries);
     // access result and count
     ResultAndCountBitVector* results_and_counts = sst_obj->results_and_counts;
+    int num_queries = sst_obj->num_queries;
+
+    // each query's range as inclusive int bounds, copied across the lanes
+    v4si lows[num_queries];
+    v4si highs[num_queries];
+    int* result_starts[num_queries];
+    int counts[num_queries];
+    for (int j = 0; j < num_queries; ++j) {
+        Comparator* current_compare_info = results_and_counts[j].dbos[0]->operator_fields.select_operator.compare_info;
+        long low = current_compare_info->p_low < INT_MIN ? INT_MIN : current_compare_info->p_low;
+        long high = current_compare_info->p_high - 1 > INT_MAX ? INT_MAX : current_compare_info->p_high - 1;
+        if (low > high || low > INT_MAX || high < INT_MIN) {
+            // nothing can match, use a range nothing falls in
+            low = 1;
+            high = 0;
+        }
+        lows[j] = (v4si) { (int) low, (int) low, (int) low, (int) low };
+        highs[j] = (v4si) { (int) high, (int) high, (int) high, (int) high };
+        result_starts[j] = results_and_counts[j].result + sst_obj->result_offset;
+        counts[j] = 0;
+    }
 
-    // OPTIMIZATION: THIS WAS WAY SLOWER
-    // iterate through all our data, perform the comparison at each step
-    /*for (int i = 0; i < sst_obj->data_sz; ++i) {*/
-        /*// get current value from base data*/
-        /*int current_val = sst_obj->data_start[i];*/
-        /*// iterate over each dbo*/
-        /*for (int j = 0; j < sst_obj->num_queries; ++j) {*/
-            /*Comparator* current_compare_info = results_and_counts->dbos[j]->operator_fields.select_operator.compare_info;*/
-            /*// access the result/count for this query*/
-            /*ResultAndCountBitVector* current_res_and_count = &results_and_counts[j];*/
-            /*int* result_start = current_res_and_count->result + sst_obj->result_offset;*/
-            /*// if it passes the check, add it to the results*/
-            /*if (current_val < current_compare_info->p_high && current_val >= current_compare_info->p_low) {*/
-                /*// update the bitvector*/
-                /*// get the right char*/
-                /*int int_idx = i / BITS_PER_INT;*/
-                /*int int_offset = i % BITS_PER_INT;*/
-                /*// we have a pointer to the start of the result bitvector that we're updating*/
-                /*result_start[int_idx] = (result_start[int_idx] | (1 << int_offset));*/
-                /*// increment the count*/
-                /*++current_res_and_count->count;*/
-            /*}*/
-        /*}*/
-    /*}*/
-
-    // this looped version is slower for some reason W/O optimization
-    // NOTE: this is the same thing as the unrolled by hand version
-    // when we run with an optimized build - likely gets unrolled
-    /*for (int j = 0; j < sst_obj->num_queries;) {*/
-        /*if (j - 1 + DBO_CHUNK_SIZE < sst_obj->num_queries) {*/
-            /*Comparator* current_compare_infos[DBO_CHUNK_SIZE];*/
-            /*ResultAndCountBitVector* current_res_and_counts[DBO_CHUNK_SIZE];*/
-            /*int* result_starts[DBO_CHUNK_SIZE];*/
-            /*for (int i = 0; i < DBO_CHUNK_SIZE; ++i) {*/
-                /*current_compare_infos[i] = results_and_counts->dbos[j + i]->operator_fields.select_operator.compare_info;*/
-                /*current_res_and_counts[i] = &results_and_counts[j + i];*/
-                /*result_starts[i] = current_res_and_counts[i]->result + sst_obj->result_offset;*/
-            /*}*/
-            /*// iterate through all our data, perform the comparison at each step*/
-            /*// adding a zig zag pattern is slightly faster*/
-            /*if (j % 2 == 0) {*/
-                /*for (int i = 0; i < sst_obj->data_sz; ++i) {*/
-                    /*// get current value from base data*/
-                    /*int current_val = sst_obj->data_start[i];*/
-                    /*// if it passes the check, add it to the results*/
-                    /*for (int k = 0; k < DBO_CHUNK_SIZE; ++k) {*/
-                        /*if (current_val < current_compare_infos[k]->p_high && current_val >= current_compare_infos[k]->p_low) {*/
-                            /*// update the bitvector*/
-                            /*// get the right char*/
-                            /*int int_idx = i / BITS_PER_INT;*/
-                            /*int int_offset = i % BITS_PER_INT;*/
-                            /*// we have a pointer to the start of the result bitvector that we're updating*/
-                            /*result_starts[k][int_idx] = (result_starts[k][int_idx] | (1 << int_offset));*/
-                            /*// increment the count*/
-                            /*++current_res_and_counts[k]->count;*/
-                        /*}*/
-                    /*}*/
-                /*}*/
-            /*} else {*/
-                /*for (int i = sst_obj->data_sz - 1; i >= 0; --i) {*/
-                    /*// get current value from base data*/
-                    /*int current_val = sst_obj->data_start[i];*/
-                    /*// if it passes the check, add it to the results*/
-                    /*for (int k = 0; k < DBO_CHUNK_SIZE; ++k) {*/
-                        /*if (current_val < current_compare_infos[k]->p_high && current_val >= current_compare_infos[k]->p_low) {*/
-                            /*// update the bitvector*/
-                            /*// get the right char*/
-                            /*int int_idx = i / BITS_PER_INT;*/
-                            /*int int_offset = i % BITS_PER_INT;*/
-                            /*// we have a pointer to the start of the result bitvector that we're updating*/
-                            /*result_starts[k][int_idx] = (result_starts[k][int_idx] | (1 << int_offset));*/
-                            /*// increment the count*/
-                            /*++current_res_and_counts[k]->count;*/
-                        /*}*/
-                    /*}*/
-                /*}*/
-            /*}*/
-            /*// increment j*/
-            /*j += DBO_CHUNK_SIZE;*/
-        /*} else {*/
-            /*Comparator* current_compare_info = results_and_counts->dbos[j]->operator_fields.select_operator.compare_info;*/
-            /*// access the result/count for this query*/
-            /*ResultAndCountBitVector* current_res_and_count = &results_and_counts[j];*/
-            /*int* result_start = current_res_and_count->result + sst_obj->result_offset;*/
-            /*// iterate through all our data, perform the comparison at each step*/
-            /*// adding a zig zag pattern is slightly faster*/
-            /*if (j % 2 == 0) {*/
-                /*for (int i = 0; i < sst_obj->data_sz; ++i) {*/
-                    /*// get current value from base data*/
-                    /*int current_val = sst_obj->data_start[i];*/
-                    /*// if it passes the check, add it to the results*/
-                    /*if (current_val < current_compare_info->p_high && current_val >= current_compare_info->p_low) {*/
-                        /*// update the bitvector*/
-                        /*// get the right char*/
-                        /*int int_idx = i / BITS_PER_INT;*/
-                        /*int int_offset = i % BITS_PER_INT;*/
-                        /*// we have a pointer to the start of the result bitvector that we're updating*/
-                        /*result_start[int_idx] = (result_start[int_idx] | (1 << int_offset));*/
-                        /*// increment the count*/
-                        /*++current_res_and_count->count;*/
-                    /*}*/
-                /*}*/
-            /*} else {*/
-                /*for (int i = sst_obj->data_sz - 1; i >= 0; --i) {*/
-                    /*// get current value from base data*/
-                    /*int current_val = sst_obj->data_start[i];*/
-                    /*// if it passes the check, add it to the results*/
-                    /*if (current_val < current_compare_info->p_high && current_val >= current_compare_info->p_low) {*/
-                        /*// update the bitvector*/
-                        /*// get the right char*/
-                        /*int int_idx = i / BITS_PER_INT;*/
-                        /*int int_offset = i % BITS_PER_INT;*/
-                        /*// we have a pointer to the start of the result bitvector that we're updating*/
-                        /*result_start[int_idx] = (result_start[int_idx] | (1 << int_offset));*/
-                        /*// increment the count*/
-                        /*++current_res_and_count->count;*/
-                    /*}*/
-                /*}*/
-            /*}*/
-            /*// increment j*/
-            /*j += 1;*/
-        /*}*/
-    /*}*/
-
-    // OPTIMIZATION: FASTER, LOOPING OVER THE DBOS IN THE OUTSIDE LOOP
-    // (ALSO USING UNROLLING) AND LOOPING OVER DATA INSIDE
-    // THIS HAS BY HAND UNROLLING, WHEN OPTIMIZED ITS THE SAME
-    // iterate over each dbo
-    for (int j = 0; j < sst_obj->num_queries;) {
-        if (j - 1 + DBO_CHUNK_SIZE < sst_obj->num_queries) {
-            // loop unrolling
-            Comparator* current_compare_info1 = results_and_counts->dbos[j]->operator_fields.select_operator.compare_info;
-            Comparator* current_compare_info2 = results_and_counts->dbos[j + 1]->operator_fields.select_operator.compare_info;
-            Comparator* current_compare_info3 = results_and_counts->dbos[j + 2]->operator_fields.select_operator.compare_info;
-            Comparator* current_compare_info4 = results_and_counts->dbos[j + 3]->operator_fields.select_operator.compare_info;
-            // access the result/count for these queries
-            ResultAndCountBitVector* current_res_and_count1 = &results_and_counts[j];
-            ResultAndCountBitVector* current_res_and_count2 = &results_and_counts[j + 1];
-            ResultAndCountBitVector* current_res_and_count3 = &results_and_counts[j + 2];
-            ResultAndCountBitVector* current_res_and_count4 = &results_and_counts[j + 3];
-            int* result_start1 = current_res_and_count1->result + sst_obj->result_offset;
-            int* result_start2 = current_res_and_count2->result + sst_obj->result_offset;
-            int* result_start3 = current_res_and_count3->result + sst_obj->result_offset;
-            int* result_start4 = current_res_and_count4->result + sst_obj->result_offset;
-            // iterate through all our data, perform the comparison at each step
-            // adding a zig zag pattern is slightly faster
-            if (j % 2 == 0) {
-                for (int i = 0; i < sst_obj->data_sz; ++i) {
-                    // get current value from base data
-                    int current_val = sst_obj->data_start[i];
-                    // if it passes the check, add it to the results
-                    if (current_val < current_compare_info1->p_high && current_val >= current_compare_info1->p_low) {
-                        // update the bitvector
-                        // get the right char
-                        int int_idx = i / BITS_PER_INT;
-                        int int_offset = i % BITS_PER_INT;
-                        // we have a pointer to the start of the result bitvector that we're updating
-                        result_start1[int_idx] = (result_start1[int_idx] | (1 << int_offset));
-                        // increment the count
-                        ++current_res_and_count1->count;
-                    }
-                    if (current_val < current_compare_info2->p_high && current_val >= current_compare_info2->p_low) {
-                        // update the bitvector
-                        // get the right char
-                        int int_idx = i / BITS_PER_INT;
-                        int int_offset = i % BITS_PER_INT;
-                        // we have a pointer to the start of the result bitvector that we're updating
-                        result_start2[int_idx] = (result_start2[int_idx] | (1 << int_offset));
-                        // increment the count
-                        ++current_res_and_count2->count;
-                    }
-                    if (current_val < current_compare_info3->p_high && current_val >= current_compare_info3->p_low) {
-                        // update the bitvector
-                        // get the right char
-                        int int_idx = i / BITS_PER_INT;
-                        int int_offset = i % BITS_PER_INT;
-                        // we have a pointer to the start of the result bitvector that we're updating
-                        result_start3[int_idx] = (result_start3[int_idx] | (1 << int_offset));
-                        // increment the count
-                        ++current_res_and_count3->count;
-                    }
-                    if (current_val < current_compare_info4->p_high && current_val >= current_compare_info4->p_low) {
-                        // update the bitvector
-                        // get the right char
-                        int int_idx = i / BITS_PER_INT;
-                        int int_offset = i % BITS_PER_INT;
-                        // we have a pointer to the start of the result bitvector that we're updating
-                        result_start4[int_idx] = (result_start4[int_idx] | (1 << int_offset));
-                        // increment the count
-                        ++current_res_and_count4->count;
-                    }
-                }
+    // full blocks, one bitvector int each
+    int num_blocks = sst_obj->data_sz / BITS_PER_INT;
+    for (int b = 0; b < num_blocks; ++b) {
+        const int* block = sst_obj->data_start + (b * BITS_PER_INT);
+        v4si values[SCAN_BLOCK_VECTORS];
+        for (int k = 0; k < SCAN_BLOCK_VECTORS; ++k) {
+            values[k] = *(const v4si*) (block + (k * SCAN_LANES));
+        }
+        for (int j = 0; j < num_queries; ++j) {
+            unsigned int word = 0;
+            for (int k = 0; k < SCAN_BLOCK_VECTORS; ++k) {
+                word |= lane_mask_bits((values[k] >= lows[j]) & (values[k] <= highs[j])) << (k * SCAN_LANES);
+            }
+            result_starts[j][b] = (int) word;
+            counts[j] += __builtin_popcount(word);
+        }
+    }
+
+    // whatever doesn't fill a block
+    for (int i = num_blocks * BITS_PER_INT; i < sst_obj->data_sz; ++i) {
+        int current_val = sst_obj->data_start[i];
+        for (int j = 0; j < num_queries; ++j) {
+            if (current_val >= lows[j][0] && current_val <= highs[j][0]) {
+                result_starts[j][i / BITS_PER_INT] |= 1 << (i % BITS_PER_INT);
+                ++counts[j];
+            }
+        }
+    }
+
+    // other tasks count into the same queries, ours get added up with
+    // theirs once the job is done
+    for (int j = 0; j < num_queries; ++j) {
+        sst_obj->counts[j] = counts[j];
+    }
+    return NULL;
+}
+
+/*
+ * comparison function for ordering selects by their low endpoint
+ */
+static int compare_select_lows(const void* a, const void* b) {
+    long low_a = (*(DbOperator* const*) a)->operator_fields.select_operator.compare_info->p_low;
+    long low_b = (*(DbOperator* const*) b)->operator_fields.select_operator.compare_info->p_low;
+    return (low_a > low_b) - (low_a < low_b);
+}
+
+/*
+ * answers the batch's selective queries on indexed columns through the
+ * index, the way a lone select would, and leaves the rest for the shared
+ * scan. for each indexed column the cost model compares probing for every
+ * query against scanning for the queries whose probe would cost more than
+ * their share of a scan, and picks the cheaper, so a batch never costs more
+ * than probing the index for each of its queries
+ */
+static void answer_queries_by_index(void) {
+    SharedScanColumn* columns;
+    int num_columns = group_shared_scan_columns(&shared_scan_operators, &columns);
+    bool* probe = calloc(shared_scan_operators.num_dbos + 1, sizeof(bool));
+    int num_probes = 0;
+    // the scan is split over the pool, probes each run on one thread
+    double num_threads = shared_scan_threads();
+    for (int c = 0; c < num_columns; ++c) {
+        Column* col = columns[c].col;
+        if (col->index_type == NO_INDEX) {
+            continue;
+        }
+        double num_entries = columns[c].num_entries;
+        double search_cost = PROBE_COST_PER_LEVEL * log2(num_entries + 1);
+        // a clustered column's matches sit next to each other and are set a
+        // bitvector int at a time
+        double match_cost = col->clustered ? PROBE_COST_PER_MATCH_CLUSTERED : PROBE_COST_PER_MATCH;
+        double scan_query_cost = (SCAN_COST_PER_QUERY_VALUE * num_entries) / num_threads;
+
+        double* probe_costs = malloc(sizeof(double) * columns[c].num_queries);
+        double all_probe_cost = 0.0;
+        double mixed_cost = (SCAN_COST_PER_VALUE * num_entries) / num_threads;
+        bool any_scans = false;
+        for (int q = 0; q < columns[c].num_queries; ++q) {
+            Comparator* compare_info = shared_scan_operators.dbos[columns[c].first_query + q]->operator_fields.select_operator.compare_info;
+            // compared as ints, the same way a lone select does
+            int num_matches = index_count_range(col, columns[c].num_entries, (int) compare_info->p_low, (int) compare_info->p_high);
+            probe_costs[q] = search_cost + (match_cost * num_matches);
+            all_probe_cost += probe_costs[q];
+            if (probe_costs[q] <= scan_query_cost) {
+                mixed_cost += probe_costs[q];
             } else {
-                for (int i = sst_obj->data_sz - 1; i >= 0; --i) {
-                    // get current value from base data
-                    int current_val = sst_obj->data_start[i];
-                    // if it passes the check, add it to the results
-                    if (current_val < current_compare_info1->p_high && current_val >= current_compare_info1->p_low) {
-                        // update the bitvector
-                        // get the right char
-                        int int_idx = i / BITS_PER_INT;
-                        int int_offset = i % BITS_PER_INT;
-                        // we have a pointer to the start of the result bitvector that we're updating
-                        result_start1[int_idx] = (result_start1[int_idx] | (1 << int_offset));
-                        // increment the count
-                        ++current_res_and_count1->count;
-                    }
-                    if (current_val < current_compare_info2->p_high && current_val >= current_compare_info2->p_low) {
-                        // update the bitvector
-                        // get the right char
-                        int int_idx = i / BITS_PER_INT;
-                        int int_offset = i % BITS_PER_INT;
-                        // we have a pointer to the start of the result bitvector that we're updating
-                        result_start2[int_idx] = (result_start2[int_idx] | (1 << int_offset));
-                        // increment the count
-                        ++current_res_and_count2->count;
-                    }
-                    if (current_val < current_compare_info3->p_high && current_val >= current_compare_info3->p_low) {
-                        // update the bitvector
-                        // get the right char
-                        int int_idx = i / BITS_PER_INT;
-                        int int_offset = i % BITS_PER_INT;
-                        // we have a pointer to the start of the result bitvector that we're updating
-                        result_start3[int_idx] = (result_start3[int_idx] | (1 << int_offset));
-                        // increment the count
-                        ++current_res_and_count3->count;
-                    }
-                    if (current_val < current_compare_info4->p_high && current_val >= current_compare_info4->p_low) {
-                        // update the bitvector
-                        // get the right char
-                        int int_idx = i / BITS_PER_INT;
-                        int int_offset = i % BITS_PER_INT;
-                        // we have a pointer to the start of the result bitvector that we're updating
-                        result_start4[int_idx] = (result_start4[int_idx] | (1 << int_offset));
-                        // increment the count
-                        ++current_res_and_count4->count;
-                    }
-                }
+                mixed_cost += scan_query_cost;
+                any_scans = true;
             }
-            // increment j
-            j += DBO_CHUNK_SIZE;
-        } else {
-            Comparator* current_compare_info = results_and_counts->dbos[j]->operator_fields.select_operator.compare_info;
-            // access the result/count for this query
-            ResultAndCountBitVector* current_res_and_count = &results_and_counts[j];
-            int* result_start = current_res_and_count->result + sst_obj->result_offset;
-            // iterate through all our data, perform the comparison at each step
-            // adding a zig zag pattern is slightly faster
-            if (j % 2 == 0) {
-                for (int i = 0; i < sst_obj->data_sz; ++i) {
-                    // get current value from base data
-                    int current_val = sst_obj->data_start[i];
-                    // if it passes the check, add it to the results
-                    if (current_val < current_compare_info->p_high && current_val >= current_compare_info->p_low) {
-                        // update the bitvector
-                        // get the right char
-                        int int_idx = i / BITS_PER_INT;
-                        int int_offset = i % BITS_PER_INT;
-                        // we have a pointer to the start of the result bitvector that we're updating
-                        result_start[int_idx] = (result_start[int_idx] | (1 << int_offset));
-                        // increment the count
-                        ++current_res_and_count->count;
-                    }
-                }
+        }
+        bool probe_all = !any_scans || all_probe_cost <= mixed_cost;
+        log_info("index plan: probe all %f, mixed %f\n", all_probe_cost, mixed_cost);
+        for (int q = 0; q < columns[c].num_queries; ++q) {
+            if (probe_all || probe_costs[q] <= scan_query_cost) {
+                probe[columns[c].first_query + q] = true;
+                ++num_probes;
+            }
+        }
+        free(probe_costs);
+    }
+    free(columns);
+
+    if (num_probes > 0) {
+        // probe in order of low endpoint, so one probe's part of the index is
+        // still cached for the next
+        DbOperator** probes = malloc(sizeof(DbOperator*) * num_probes);
+        int num_kept = 0;
+        int p = 0;
+        for (int i = 0; i < shared_scan_operators.num_dbos; ++i) {
+            if (probe[i]) {
+                probes[p++] = shared_scan_operators.dbos[i];
             } else {
-                for (int i = sst_obj->data_sz - 1; i >= 0; --i) {
-                    // get current value from base data
-                    int current_val = sst_obj->data_start[i];
-                    // if it passes the check, add it to the results
-                    if (current_val < current_compare_info->p_high && current_val >= current_compare_info->p_low) {
-                        // update the bitvector
-                        // get the right char
-                        int int_idx = i / BITS_PER_INT;
-                        int int_offset = i % BITS_PER_INT;
-                        // we have a pointer to the start of the result bitvector that we're updating
-                        result_start[int_idx] = (result_start[int_idx] | (1 << int_offset));
-                        // increment the count
-                        ++current_res_and_count->count;
-                    }
-                }
+                shared_scan_operators.dbos[num_kept++] = shared_scan_operators.dbos[i];
             }
-            // increment j
-            j += 1;
         }
+        shared_scan_operators.num_dbos = num_kept;
+        qsort(probes, num_probes, sizeof(DbOperator*), compare_select_lows);
+        for (int i = 0; i < num_probes; ++i) {
+            message probe_message;
+            probe_message.payload = NULL;
+            db_select(probes[i], &probe_message);
+            free(probe_message.payload);
+            db_operator_free(probes[i]);
+        }
+        free(probes);
     }
-    return NULL;
+    free(probe);
+}
+
+/*
+ * frees the batch's dbos once their results are stored and reports success
+ */
+static void finish_shared_scan(message* send_message) {
+    // free each of the dbos
+    for (int i = 0; i < shared_scan_operators.num_dbos; ++i) {
+        db_operator_free(shared_scan_operators.dbos[i]);
+    }
+    free(shared_scan_operators.dbos);
+    shared_scan_operators.dbos = NULL;
+    shared_scan_operators.dbo_slots = 0;
+    shared_scan_operators.num_dbos = 0;
+
+    const char* result_message = "shared scan successful";
+    char* result_message_ptr = malloc(strlen(result_message) + 1);
+    strcpy(result_message_ptr, result_message);
+    send_message->payload = result_message_ptr;
+    send_message->status = OK_DONE;
 }
 
 /*
@@ -613,73 +898,125 @@ void execute_shared_scan_columnwise(DbOperator* shared_dbo, message* send_messag
 
     log_info("number of scans to execute: %d\n", shared_scan_operators.num_dbos);
 
-    // ALLOCATE AND INITIALIZE OBJECTS FOR SHARED SCANS
-    // to free: results_and_counts, threads, sst_objs
-
-    // allocate results/counts array for each dbo
-    ResultAndCount* results_and_counts = malloc(sizeof(ResultAndCount) * shared_scan_operators.num_dbos);
-    for (int i = 0; i < shared_scan_operators.num_dbos; ++i) {
-        // TODO: resize results somehow?
-        results_and_counts[i].result = malloc(shared_scan_operators.num_entries * sizeof(int));
-        results_and_counts[i].count = 0;
-        results_and_counts[i].dbos = shared_scan_operators.dbos + i;
+    // selective queries on indexed columns go through their index instead
+    answer_queries_by_index();
+    if (shared_scan_operators.num_dbos == 0) {
+        finish_shared_scan(send_message);
+        return;
     }
 
-    // calculate number of threads needed
-    int num_threads = shared_scan_operators.num_dbos / QUERIES_PER_THREAD;
-    // add one more if not evenly split
-    if (shared_scan_operators.num_dbos % QUERIES_PER_THREAD > 0) {
-        ++num_threads;
+    // put each column's queries together
+    SharedScanColumn* columns;
+    int num_columns = group_shared_scan_columns(&shared_scan_operators, &columns);
+
+    // ALLOCATE AND INITIALIZE OBJECTS FOR SHARED SCANS
+    // to free: results_and_counts, sst_objs
+
+    // each column is split into chunks that stay in cache while a group of
+    // queries takes turns passing over them, and each column gets its share
+    // of the pool
+    int num_threads = shared_scan_threads();
+    int column_threads = (num_threads + num_columns - 1) / num_columns;
+    int chunk_size = shared_scan_chunk_size(num_threads, shared_scan_tuning.queries_per_task);
+    ResultAndCount* results_and_counts = malloc(sizeof(ResultAndCount) * shared_scan_operators.num_dbos);
+    int* column_queries_per_task = malloc(sizeof(int) * num_columns);
+    int num_tasks = 0;
+    for (int c = 0; c < num_columns; ++c) {
+        int num_chunks = (columns[c].num_entries + chunk_size - 1) / chunk_size;
+        if (num_chunks == 0) {
+            num_chunks = 1;
+        }
+        column_queries_per_task[c] = shared_scan_queries_per_task(columns[c].num_queries, num_chunks, column_threads);
+        num_tasks += num_chunks * ((columns[c].num_queries + column_queries_per_task[c] - 1) / column_queries_per_task[c]);
+
+        // size each chunk's list from the table's sample, a low guess only
+        // costs the task that owns the list a realloc
+        Table* table = column_table(columns[c].col);
+        int values_per_chunk = columns[c].num_entries < chunk_size ? columns[c].num_entries : chunk_size;
+        for (int i = columns[c].first_query; i < columns[c].first_query + columns[c].num_queries; ++i) {
+            Comparator* compare_info = shared_scan_operators.dbos[i]->operator_fields.select_operator.compare_info;
+            double selectivity = table == NULL ? -1.0 : sample_selectivity(table, columns[c].col, compare_info->p_low, compare_info->p_high);
+            int capacity = PARTIAL_POSITIONS_MIN_CAPACITY;
+            if (selectivity > 0) {
+                double estimate = selectivity * PARTIAL_POSITIONS_SLACK * values_per_chunk;
+                if (estimate > values_per_chunk) {
+                    estimate = values_per_chunk;
+                }
+                if (estimate > capacity) {
+                    capacity = (int) estimate;
+                }
+            }
+            results_and_counts[i].result = NULL;
+            results_and_counts[i].count = 0;
+            results_and_counts[i].dbos = shared_scan_operators.dbos + i;
+            results_and_counts[i].partials = malloc(sizeof(PartialPositions) * num_chunks);
+            results_and_counts[i].num_partials = num_chunks;
+            for (int k = 0; k < num_chunks; ++k) {
+                // the task allocates its lists itself
+                results_and_counts[i].partials[k].positions = NULL;
+                results_and_counts[i].partials[k].count = 0;
+                results_and_counts[i].partials[k].capacity = capacity;
+            }
+        }
     }
-    // allocate threads
-    pthread_t* threads = malloc(sizeof(pthread_t) * num_threads);
     // allocate thread objs
-    SharedScanThreadObj* sst_objs = malloc(sizeof(SharedScanThreadObj) * num_threads); 
-
-    // assign to threads
-    for (int i = 0; i < num_threads; ++i) {
-        // get start of ResultAndCount
-        ResultAndCount* start_res_and_count = results_and_counts + (i * QUERIES_PER_THREAD);
-        // create the thread obj
-        int num_queries = QUERIES_PER_THREAD;
-        // set to one if there's only one left
-        if (shared_scan_operators.num_dbos - (QUERIES_PER_THREAD * i) < QUERIES_PER_THREAD) {
-            num_queries = shared_scan_operators.num_dbos - (QUERIES_PER_THREAD * i);
-        }
-        log_info("num_queries at creation time: %d\n", num_queries);
-        SharedScanThreadObj* sst_obj = sst_objs + i;
-        sst_obj->results_and_counts = start_res_and_count;
-        sst_obj->num_queries = num_queries;
-
-        // assign to thread
-        if (pthread_create(&threads[i], NULL, shared_scan_helper, sst_obj)) {
-            const char* result_message = "creating thread failed";
-            char* result_message_ptr = malloc(strlen(result_message) + 1);
-            strcpy(result_message_ptr, result_message);
-            send_message->payload = result_message_ptr;
-            send_message->status = OK_DONE;
-            // free objects from shared scans
-            free(results_and_counts);
-            free(threads);
-            free(sst_objs);
-            return;
-        }
-    }
-
-    // wait for all our threads to finish
-    for (int i = 0; i < num_threads; ++i) {
-        if (pthread_join(threads[i], NULL)) {
-            const char* result_message = "thread failed to execute";
-            char* result_message_ptr = malloc(strlen(result_message) + 1);
-            strcpy(result_message_ptr, result_message);
-            send_message->payload = result_message_ptr;
-            send_message->status = OK_DONE;
-            // free objects from shared scans
-            free(results_and_counts);
-            free(threads);
-            free(sst_objs);
-            return;
+    SharedScanThreadObj* sst_objs = malloc(sizeof(SharedScanThreadObj) * (num_tasks + 1));
+
+    // organize work units, a chunk at a time
+    SharedScanThreadObj* sst_obj = sst_objs;
+    for (int c = 0; c < num_columns; ++c) {
+        int queries_per_task = column_queries_per_task[c];
+        int num_chunks = results_and_counts[columns[c].first_query].num_partials;
+        for (int k = 0; k < num_chunks; ++k) {
+            int data_offset = k * chunk_size;
+            int data_sz = columns[c].num_entries - data_offset < chunk_size ? columns[c].num_entries - data_offset : chunk_size;
+            for (int i = 0; i < columns[c].num_queries; i += queries_per_task) {
+                // create the thread obj
+                int num_queries = queries_per_task;
+                // the last one might get fewer
+                if (columns[c].num_queries - i < queries_per_task) {
+                    num_queries = columns[c].num_queries - i;
+                }
+                log_info("num_queries at creation time: %d\n", num_queries);
+                sst_obj->results_and_counts = results_and_counts + columns[c].first_query + i;
+                sst_obj->num_queries = num_queries;
+                sst_obj->chunk = k;
+                sst_obj->data_start = columns[c].col->data + data_offset;
+                sst_obj->data_offset = data_offset;
+                sst_obj->data_sz = data_sz;
+                ++sst_obj;
+            }
+        }
+    }
+    free(column_queries_per_task);
+    free(columns);
+
+    // run them all on the worker pool, then put each query's partial lists
+    // together, a query per task
+    int failure = worker_pool_run_on(shared_scan_helper, sst_objs, sizeof(SharedScanThreadObj), num_tasks, num_threads);
+    if (failure == 0) {
+        failure = worker_pool_run_on(concatenate_partial_positions, results_and_counts, sizeof(ResultAndCount),
+                                     shared_scan_operators.num_dbos, num_threads);
+    }
+    free(sst_objs);
+    if (failure) {
+        const char* result_message = "creating thread failed";
+        char* result_message_ptr = malloc(strlen(result_message) + 1);
+        strcpy(result_message_ptr, result_message);
+        send_message->payload = result_message_ptr;
+        send_message->status = OK_DONE;
+        // free objects from shared scans
+        for (int i = 0; i < shared_scan_operators.num_dbos; ++i) {
+            if (results_and_counts[i].partials != NULL) {
+                for (int k = 0; k < results_and_counts[i].num_partials; ++k) {
+                    free(results_and_counts[i].partials[k].positions);
+                }
+                free(results_and_counts[i].partials);
+            }
+            free(results_and_counts[i].result);
         }
+        free(results_and_counts);
+        return;
     }
 
     // once it's done, save the results
@@ -693,6 +1030,7 @@ void execute_shared_scan_columnwise(DbOperator* shared_dbo, message* send_messag
         result_obj->num_tuples = current_res_and_count.count;
         result_obj->payload = current_res_and_count.result;
         result_obj->data_type = INT;
+        result_obj->bitvector_ints = -1;
         result_obj->is_posn_vector = true;
 
         // add each result to the client
@@ -710,44 +1048,87 @@ void execute_shared_scan_columnwise(DbOperator* shared_dbo, message* send_messag
     
     // free objects from shared scans
     free(results_and_counts);
-    free(threads);
-    free(sst_objs);
 
     // now that we've finished executing the results, clean up the shared_scan_operators
-    shared_scan_operators.num_dbos = 0;
-    shared_scan_operators.col = NULL;
-    shared_scan_operators.num_entries = 0;
-    
-    const char* result_message = "shared scan successful";
-    char* result_message_ptr = malloc(strlen(result_message) + 1);
-    strcpy(result_message_ptr, result_message);
-    send_message->payload = result_message_ptr;
-    send_message->status = OK_DONE;
+    finish_shared_scan(send_message);
     return;
 }
 
-// thread performs work through this mechanism
+/*
+ * scans a chunk for every query in the batch, finding each value's queries
+ * by binary searching its interval between the sorted predicate endpoints.
+ * costs O(log Q + matches) per value instead of O(Q)
+ */
+void shared_scan_helper_intervals(SharedScanThreadObjBitVector* sst_obj) {
+    SharedScanIntervals* intervals = sst_obj->intervals;
+    ResultAndCountBitVector* results_and_counts = sst_obj->results_and_counts;
+    // other tasks count into the same queries, ours get added up with
+    // theirs once the job is done
+    int* counts = sst_obj->counts;
+    for (int i = 0; i < sst_obj->data_sz; ++i) {
+        int current_val = sst_obj->data_start[i];
+        int interval = find_interval(intervals->endpoints, intervals->num_endpoints, current_val);
+        if (interval < 0) {
+            continue;
+        }
+        int int_idx = sst_obj->result_offset + (i / BITS_PER_INT);
+        int bit = 1 << (i % BITS_PER_INT);
+        for (int j = intervals->match_offsets[interval]; j < intervals->match_offsets[interval + 1]; ++j) {
+            int query = intervals->matches[j];
+            results_and_counts[query].result[int_idx] |= bit;
+            ++counts[query];
+        }
+    }
+}
+
+/*
+ * adds up every task's counts into its queries' counts, once the tasks are
+ * done
+ */
+static void sum_shared_scan_counts(SharedScanToFree to_free) {
+    for (int i = 0; i < to_free.num_tasks; ++i) {
+        SharedScanThreadObjBitVector* task = &(to_free.sst_objs[i]);
+        for (int j = 0; j < task->num_queries; ++j) {
+            task->results_and_counts[j].count += task->counts[j];
+        }
+    }
+}
+
+/*
+ * frees the task objects and lookups set up for a shared scan
+ */
+static void free_shared_scan_to_free(SharedScanToFree to_free) {
+    free(to_free.results_and_counts);
+    free(to_free.sst_objs);
+    free(to_free.task_counts);
+    for (int c = 0; c < to_free.num_columns; ++c) {
+        free_shared_scan_intervals(to_free.intervals[c]);
+    }
+    free(to_free.intervals);
+}
+
+// the worker pool performs each task through this mechanism
 void* do_task(void* void_task) {
     // the task
     SharedScanThreadObjBitVector* task = (SharedScanThreadObjBitVector*) void_task;
-    while (task) {
-        // timing
-        // ******************
-        clock_t start, end;
-        double cpu_time_used;
-        start = clock();
-        // ******************
-        // perform the scan
+    // timing
+    // ******************
+    clock_t start, end;
+    double cpu_time_used;
+    start = clock();
+    // ******************
+    // perform the scan
+    if (task->intervals != NULL) {
+        shared_scan_helper_intervals(task);
+    } else {
         shared_scan_helper_bitvector(task);
-        // timing
-        // ******************
-        end = clock();
-        cpu_time_used = ((double) (end - start)) / CLOCKS_PER_SEC;
-        log_timing("time to DO TASK: %f\n", cpu_time_used);
-        // ******************
-        // get the next task
-        task = task_list_pop(task->task_list_head);
     }
+    // timing
+    // ******************
+    end = clock();
+    cpu_time_used = ((double) (end - start)) / CLOCKS_PER_SEC;
+    log_timing("time to DO TASK: %f\n", cpu_time_used);
+    // ******************
     // done
     return NULL;
 }
@@ -766,49 +1147,40 @@ void execute_shared_scan_bitvector(DbOperator* shared_dbo, message* send_message
 
     log_info("number of scans to execute: %d\n", shared_scan_operators.num_dbos);
 
-    // set up our tasks
-    SharedScanToFree to_free = setup_task_list();
-
-    // set up our threads
-    pthread_t threads[MAX_THREAD_COUNT];
-
-    // run our threads over our tasks
-    for (int i = 0; i < MAX_THREAD_COUNT; ++i) {
-        // assign to thread
-        if (pthread_create(threads + i, NULL, do_task, task_list_pop(to_free.task_list_head))) {
-            const char* result_message = "creating thread failed";
-            char* result_message_ptr = malloc(strlen(result_message) + 1);
-            strcpy(result_message_ptr, result_message);
-            send_message->payload = result_message_ptr;
-            send_message->status = OK_DONE;
-            // free objects from shared scans
-            free(to_free.results_and_counts);
-            free(to_free.sst_objs);
-            free_task_list_head(to_free.task_list_head);
-            return;
-        }
-    }
-
-    // join the threads
-    for (int i = 0; i < MAX_THREAD_COUNT; ++i) {
-        if (pthread_join(threads[i], NULL)) {
-            const char* result_message = "thread failed to execute";
-            char* result_message_ptr = malloc(strlen(result_message) + 1);
-            strcpy(result_message_ptr, result_message);
-            send_message->payload = result_message_ptr;
-            send_message->status = OK_DONE;
-            // free objects from shared scans
-            free(to_free.results_and_counts);
-            free(to_free.sst_objs);
-            free_task_list_head(to_free.task_list_head);
-            return;
-        }
-    }
-
-    // need to know how many bitvector ints were used
-    int num_bitvector_ints = num_bitvector_ints_needed(shared_scan_operators.num_entries);
+    // selective queries on indexed columns go through their index instead
+    answer_queries_by_index();
+    if (shared_scan_operators.num_dbos == 0) {
+        finish_shared_scan(send_message);
+        return;
+    }
+
+    // put each column's queries together, then set up our tasks
+    SharedScanColumn* columns;
+    int num_columns = group_shared_scan_columns(&shared_scan_operators, &columns);
+    SharedScanToFree to_free = setup_shared_scan_tasks(columns, num_columns);
+
+    // run our tasks on the worker pool
+    if (worker_pool_run_on(do_task, to_free.sst_objs, sizeof(SharedScanThreadObjBitVector), to_free.num_tasks, shared_scan_threads())) {
+        const char* result_message = "creating thread failed";
+        char* result_message_ptr = malloc(strlen(result_message) + 1);
+        strcpy(result_message_ptr, result_message);
+        send_message->payload = result_message_ptr;
+        send_message->status = OK_DONE;
+        // free objects from shared scans
+        free_shared_scan_to_free(to_free);
+        free(columns);
+        return;
+    }
+
     // once it's done, save the results
+    sum_shared_scan_counts(to_free);
+    int c = 0;
     for (int i = 0; i < shared_scan_operators.num_dbos; ++i) {
+        // need to know how many bitvector ints were used for its column
+        while (i >= columns[c].first_query + columns[c].num_queries) {
+            ++c;
+        }
+        int num_bitvector_ints = num_bitvector_ints_needed(columns[c].num_entries);
         // access the current result/count and dbo
         ResultAndCountBitVector current_res_and_count = to_free.results_and_counts[i];
         DbOperator* current_dbo = shared_scan_operators.dbos[i];
@@ -835,25 +1207,11 @@ void execute_shared_scan_bitvector(DbOperator* shared_dbo, message* send_message
     }
     
     // free objects from shared scans
-    free(to_free.results_and_counts);
-    free(to_free.sst_objs);
-    free_task_list_head(to_free.task_list_head);
+    free_shared_scan_to_free(to_free);
+    free(columns);
 
     // now that we've finished executing the results, clean up the shared_scan_operators
-    // free each of the dbos
-    for (int i = 0; i < shared_scan_operators.num_dbos; ++i) {
-        db_operator_free(shared_scan_operators.dbos[i]);
-    }
-    free(shared_scan_operators.dbos);
-    shared_scan_operators.num_dbos = 0;
-    shared_scan_operators.col = NULL;
-    shared_scan_operators.num_entries = 0;
-    
-    const char* result_message = "shared scan successful";
-    char* result_message_ptr = malloc(strlen(result_message) + 1);
-    strcpy(result_message_ptr, result_message);
-    send_message->payload = result_message_ptr;
-    send_message->status = OK_DONE;
+    finish_shared_scan(send_message);
     return;
 }
 
@@ -861,9 +1219,808 @@ void execute_shared_scan_bitvector(DbOperator* shared_dbo, message* send_message
  * this function dispatches the correct shared scan function based on global flags
  */
 void execute_shared_scan(DbOperator* shared_dbo, message* send_message) {
+    if (!shared_scan_calibrated) {
+        shared_scan_calibrate();
+    }
     if (BITVECTOR_DB) {
         execute_shared_scan_bitvector(shared_dbo, send_message);
     } else {
         execute_shared_scan_columnwise(shared_dbo, send_message);
     }
 }
+
+/*
+ * times a shared scan of a calibration batch over num_entries values of a
+ * column with the given knobs. returns the fastest of CALIBRATION_RUNS runs,
+ * in seconds
+ */
+static double time_shared_scan(Column* column, int num_entries, DbOperator** dbos, int num_queries,
+    SharedScanTuning tuning) {
+    // run it as the only batch, then put back whatever is waiting
+    SharedScanTuning saved_tuning = shared_scan_tuning;
+    SharedScanDbOperators saved_operators = shared_scan_operators;
+    shared_scan_tuning = tuning;
+    shared_scan_operators.dbos = dbos;
+    shared_scan_operators.num_dbos = num_queries;
+    shared_scan_operators.dbo_slots = num_queries;
+    SharedScanColumn scan_column = { column, num_entries, 0, num_queries };
+
+    double best_time = -1.0;
+    for (int run = 0; run < CALIBRATION_RUNS; ++run) {
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        SharedScanToFree to_free = setup_shared_scan_tasks(&scan_column, 1);
+        int failure = worker_pool_run_on(do_task, to_free.sst_objs, sizeof(SharedScanThreadObjBitVector),
+                                         to_free.num_tasks, shared_scan_threads());
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        for (int i = 0; i < num_queries; ++i) {
+            free(to_free.results_and_counts[i].result);
+        }
+        free_shared_scan_to_free(to_free);
+        if (failure) {
+            best_time = -1.0;
+            break;
+        }
+        double elapsed = (end.tv_sec - start.tv_sec) + ((end.tv_nsec - start.tv_nsec) / 1e9);
+        if (best_time < 0 || elapsed < best_time) {
+            best_time = elapsed;
+        }
+    }
+
+    shared_scan_tuning = saved_tuning;
+    shared_scan_operators = saved_operators;
+    return best_time;
+}
+
+/*
+ * tries a knob setting, keeping it in best if it clearly beats best_time
+ */
+static void try_shared_scan_tuning(Column* column, int num_entries, DbOperator** dbos, int num_queries,
+    SharedScanTuning candidate, SharedScanTuning* best, double* best_time) {
+    double elapsed = time_shared_scan(column, num_entries, dbos, num_queries, candidate);
+    log_info("calibration: %d threads, chunks of %d, %d queries per task, %d tasks per thread: %f\n",
+             candidate.num_threads, candidate.chunk_size, candidate.queries_per_task, candidate.tasks_per_thread, elapsed);
+    if (elapsed >= 0 && (*best_time < 0 || elapsed < *best_time * CALIBRATION_MIN_GAIN)) {
+        *best = candidate;
+        *best_time = elapsed;
+    }
+}
+
+/*
+ * times a batch of ranges over a column's first num_entries values under
+ * different knob settings, and keeps the fastest for every shared scan after
+ * it. each knob is tuned in turn with the others held at their best so far,
+ * which takes a few dozen scans instead of one per combination
+ */
+static SharedScanTuning calibrate_shared_scan(Column* column, int num_entries) {
+    // ranges between values taken from around the column
+    DbOperator* dbos[CALIBRATION_QUERIES];
+    DbOperator calibration_dbos[CALIBRATION_QUERIES];
+    Comparator comparators[CALIBRATION_QUERIES];
+    unsigned int seed = 1;
+    for (int i = 0; i < CALIBRATION_QUERIES; ++i) {
+        seed = (seed * 1103515245) + 12345;
+        int first = column->data[seed % num_entries];
+        seed = (seed * 1103515245) + 12345;
+        int second = column->data[seed % num_entries];
+        memset(&comparators[i], 0, sizeof(Comparator));
+        comparators[i].p_low = first < second ? first : second;
+        comparators[i].p_high = (long) (first < second ? second : first) + 1;
+        calibration_dbos[i].type = SELECT;
+        calibration_dbos[i].operator_fields.select_operator.compare_info = &comparators[i];
+        dbos[i] = &calibration_dbos[i];
+    }
+
+    // start from the defaults, over the whole pool
+    int pool_threads = worker_pool_threads();
+    SharedScanTuning best = { 0, MAX_QUERIES_PER_TASK, TASKS_PER_THREAD, pool_threads };
+    double best_time = -1.0;
+    try_shared_scan_tuning(column, num_entries, dbos, CALIBRATION_QUERIES, best, &best, &best_time);
+
+    // #1: threads, more aren't faster once the scan is memory bound
+    SharedScanTuning candidate = best;
+    for (int num_threads = 1; num_threads < pool_threads; num_threads *= 2) {
+        candidate.num_threads = num_threads;
+        try_shared_scan_tuning(column, num_entries, dbos, CALIBRATION_QUERIES, candidate, &best, &best_time);
+    }
+    // #2: chunk size, against the caches actually there
+    candidate = best;
+    for (int chunk_size = MIN_CHUNK_PROCESSING_SIZE; chunk_size <= num_entries; chunk_size *= 4) {
+        candidate.chunk_size = chunk_size;
+        try_shared_scan_tuning(column, num_entries, dbos, CALIBRATION_QUERIES, candidate, &best, &best_time);
+    }
+    // #3: queries per task
+    candidate = best;
+    for (int queries_per_task = 4; queries_per_task <= 2 * MAX_QUERIES_PER_TASK; queries_per_task *= 2) {
+        if (queries_per_task != best.queries_per_task) {
+            candidate.queries_per_task = queries_per_task;
+            try_shared_scan_tuning(column, num_entries, dbos, CALIBRATION_QUERIES, candidate, &best, &best_time);
+        }
+    }
+    // #4: tasks per thread
+    candidate = best;
+    for (int tasks_per_thread = 1; tasks_per_thread <= 2 * TASKS_PER_THREAD; tasks_per_thread *= 2) {
+        if (tasks_per_thread != best.tasks_per_thread) {
+            candidate.tasks_per_thread = tasks_per_thread;
+            try_shared_scan_tuning(column, num_entries, dbos, CALIBRATION_QUERIES, candidate, &best, &best_time);
+        }
+    }
+
+    // the whole pool is what we'd use anyway
+    if (best.num_threads >= pool_threads) {
+        best.num_threads = 0;
+    }
+    log_info("calibrated shared scans: %d threads, chunks of %d, %d queries per task, %d tasks per thread\n",
+             best.num_threads, best.chunk_size, best.queries_per_task, best.tasks_per_thread);
+    return best;
+}
+
+/*
+ * this function calibrates shared scans on a synthetic column, so they're
+ * tuned for this machine. the first shared scan calls it
+ */
+void shared_scan_calibrate(void) {
+    Column column;
+    memset(&column, 0, sizeof(Column));
+    column.data = malloc(sizeof(int) * CALIBRATION_VALUES);
+    unsigned int seed = 1;
+    for (int i = 0; i < CALIBRATION_VALUES; ++i) {
+        seed = (seed * 1103515245) + 12345;
+        column.data[i] = (int) (seed >> 8);
+    }
+    shared_scan_tuning = calibrate_shared_scan(&column, CALIBRATION_VALUES);
+    shared_scan_calibrated = true;
+    free(column.data);
+}
+
+/*
+ * this function recalibrates shared scans on a column of the database, for
+ * the tune command
+ */
+void shared_scan_tune(DbOperator* query, message* send_message) {
+    TuneOperator* tune = &(query->operator_fields.tune_operator);
+    if (tune->column == NULL) {
+        shared_scan_calibrate();
+    } else if (tune->num_entries > 0) {
+        shared_scan_tuning = calibrate_shared_scan(tune->column, tune->num_entries);
+        shared_scan_calibrated = true;
+    }
+
+    char result_message[128];
+    sprintf(result_message, "shared scans tuned: %d threads, chunks of %d, %d queries per task, %d tasks per thread",
+            shared_scan_threads(), shared_scan_tuning.chunk_size, shared_scan_tuning.queries_per_task,
+            shared_scan_tuning.tasks_per_thread);
+    char* result_message_ptr = malloc(strlen(result_message) + 1);
+    strcpy(result_message_ptr, result_message);
+    send_message->payload = result_message_ptr;
+    send_message->status = OK_DONE;
+}
+
+/*
+ * copies the text between start and end into dest without surrounding
+ * spaces. returns false if it doesn't fit in a handle
+ */
+static bool copy_trimmed(char* dest, const char* start, const char* end) {
+    while (start < end && isspace((unsigned char) *start)) {
+        ++start;
+    }
+    while (end > start && isspace((unsigned char) *(end - 1))) {
+        --end;
+    }
+    if (end - start >= HANDLE_MAX_SIZE) {
+        return false;
+    }
+    memcpy(dest, start, end - start);
+    dest[end - start] = '\0';
+    return true;
+}
+
+/*
+ * reads the handle and arguments of a command like h=op(a,b), without
+ * parsing it for real. returns where the operation's name starts and sets
+ * num_args, which is -1 if the command doesn't look like that
+ */
+static const char* read_command(const char* command, char* handle, char args[][HANDLE_MAX_SIZE], int* num_args) {
+    *num_args = -1;
+    handle[0] = '\0';
+    const char* query_command = command;
+    const char* open_paren = strchr(command, '(');
+    const char* equals_pointer = strchr(command, '=');
+    // an = inside the parentheses isn't a handle's
+    if (equals_pointer != NULL && (open_paren == NULL || equals_pointer < open_paren)) {
+        if (!copy_trimmed(handle, command, equals_pointer)) {
+            return query_command;
+        }
+        query_command = equals_pointer + 1;
+    }
+    while (isspace((unsigned char) *query_command)) {
+        ++query_command;
+    }
+    const char* close_paren = open_paren == NULL ? NULL : strchr(open_paren, ')');
+    if (close_paren == NULL) {
+        return query_command;
+    }
+    int n = 0;
+    const char* arg_start = open_paren + 1;
+    while (true) {
+        const char* arg_end = arg_start;
+        while (arg_end < close_paren && *arg_end != ',') {
+            ++arg_end;
+        }
+        if (n == COOPERATIVE_SCAN_MAX_ARGS || !copy_trimmed(args[n], arg_start, arg_end)) {
+            return query_command;
+        }
+        ++n;
+        if (arg_end == close_paren) {
+            break;
+        }
+        arg_start = arg_end + 1;
+    }
+    *num_args = n;
+    return query_command;
+}
+
+/*
+ * returns the index of the waiting fetch storing to handle, or -1
+ */
+static int waiting_fetch(const char* handle) {
+    for (int i = 0; i < shared_fetch_operators.num_dbos; ++i) {
+        if (strcmp(shared_fetch_operators.dbos[i]->operator_fields.fetch_operator.handle, handle) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*
+ * checks whether a waiting fetch or aggregate will store to handle
+ */
+static bool waiting_handle(const char* handle) {
+    if (waiting_fetch(handle) >= 0) {
+        return true;
+    }
+    for (int i = 0; i < num_held_aggregates; ++i) {
+        if (strcmp(held_aggregates[i].handle, handle) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * keeps the error a waiting statement ran into, unless an earlier one is
+ * already being kept. statement is its handle or its text
+ */
+static void defer_error(const char* statement, message* failed_message) {
+    if (failed_message->status == OK_DONE || failed_message->status == OK_WAIT_FOR_RESPONSE ||
+        deferred_error != NULL) {
+        return;
+    }
+    const char* reason = failed_message->payload != NULL ? failed_message->payload : "it could not run";
+    const char* prefix = "waiting statement ";
+    deferred_error = malloc(strlen(prefix) + strlen(statement) + strlen(reason) + 3);
+    strcpy(deferred_error, prefix);
+    strcat(deferred_error, statement);
+    strcat(deferred_error, ": ");
+    strcat(deferred_error, reason);
+    deferred_status = failed_message->status;
+}
+
+/*
+ * reports the kept error in place of the current command's reply. returns
+ * true if there was one, in which case send_message is filled in
+ */
+static bool report_deferred_error(message* send_message) {
+    if (deferred_error == NULL) {
+        return false;
+    }
+    send_message->payload = deferred_error;
+    send_message->status = deferred_status;
+    deferred_error = NULL;
+    deferred_status = OK_DONE;
+    return true;
+}
+
+/*
+ * runs the selects waiting for a cooperative scan
+ */
+static void shared_select_flush(ClientContext* context) {
+    if (shared_scan_operators.num_dbos == 0) {
+        return;
+    }
+    message scan_message;
+    scan_message.payload = NULL;
+    if (shared_scan_operators.num_dbos == 1) {
+        // nothing to share with, run it as a regular select
+        DbOperator* query = shared_scan_operators.dbos[0];
+        db_select(query, &scan_message);
+        defer_error(query->operator_fields.select_operator.compare_info->handle, &scan_message);
+        db_operator_free(query);
+        free(shared_scan_operators.dbos);
+        shared_scan_operators.dbos = NULL;
+        shared_scan_operators.dbo_slots = 0;
+        shared_scan_operators.num_dbos = 0;
+    } else {
+        log_info("cooperative scan of %d selects\n", shared_scan_operators.num_dbos);
+        DbOperator* shared_dbo = construct_batch_operator();
+        shared_dbo->context = context;
+        execute_shared_scan(shared_dbo, &scan_message);
+        defer_error("select batch", &scan_message);
+        db_operator_free(shared_dbo);
+    }
+    // the client already heard back about each select, an error waits for
+    // the next command
+    free(scan_message.payload);
+}
+
+// totals a shared fetch gathers along the way, so aggregates over its output
+// don't need a pass of their own
+typedef struct SharedFetchTotals {
+    long sum;
+    int min;
+    int max;
+} SharedFetchTotals;
+
+// a unit of work for a shared fetch: a range of one column's positions, for
+// every fetch from that column
+typedef struct SharedFetchTask {
+    DbOperator** fetches;
+    int num_fetches;
+    int** outputs; // where each fetch's values go
+    int* output_offsets; // where this range starts in each output
+    bool* wants_totals; // whether each fetch has aggregates waiting on it
+    SharedFetchTotals* totals; // this range's, one per fetch
+    int* data;
+    int start_int;
+    int end_int;
+} SharedFetchTask;
+
+/*
+ * gathers a range of a column for each of its fetches. the range is walked
+ * a bitvector int at a time, so each 32 values are brought in once and
+ * handed to every fetch that wants any of them
+ */
+static void* shared_fetch_range(void* task_void) {
+    SharedFetchTask* task = (SharedFetchTask*) task_void;
+    int cursors[task->num_fetches];
+    for (int k = 0; k < task->num_fetches; ++k) {
+        cursors[k] = task->output_offsets[k];
+        task->totals[k].sum = 0;
+        task->totals[k].min = INT_MAX;
+        task->totals[k].max = INT_MIN;
+    }
+    for (int i = task->start_int; i < task->end_int; ++i) {
+        const int* values = task->data + (i * BITS_PER_INT);
+        for (int k = 0; k < task->num_fetches; ++k) {
+            Result* ids_result = task->fetches[k]->operator_fields.fetch_operator.ids_result;
+            if (i >= ids_result->bitvector_ints) {
+                continue;
+            }
+            unsigned int current_int = ((int*) ids_result->payload)[i];
+            int* output = task->outputs[k];
+            if (!task->wants_totals[k]) {
+                while (current_int != 0) {
+                    output[cursors[k]++] = values[__builtin_ctz(current_int)];
+                    current_int &= current_int - 1;
+                }
+                continue;
+            }
+            SharedFetchTotals* totals = &(task->totals[k]);
+            while (current_int != 0) {
+                int value = values[__builtin_ctz(current_int)];
+                output[cursors[k]++] = value;
+                totals->sum += value;
+                totals->min = value < totals->min ? value : totals->min;
+                totals->max = value > totals->max ? value : totals->max;
+                current_int &= current_int - 1;
+            }
+        }
+    }
+    return NULL;
+}
+
+/*
+ * runs the fetches waiting for a shared pass, then the aggregates held on
+ * them. fetches from the same column are gathered together in one pass over
+ * it, which also totals up the fetches that have aggregates waiting
+ */
+static void shared_fetch_flush(ClientContext* context) {
+    int num_fetches = shared_fetch_operators.num_dbos;
+    if (num_fetches == 0) {
+        return;
+    }
+    message fetch_message;
+    fetch_message.payload = NULL;
+    int client_fd = shared_fetch_operators.dbos[0]->client_fd;
+    if (num_fetches == 1 && num_held_aggregates == 0) {
+        // nothing to share with, run it as a regular fetch
+        db_fetch(shared_fetch_operators.dbos[0], &fetch_message);
+        defer_error(shared_fetch_operators.dbos[0]->operator_fields.fetch_operator.handle, &fetch_message);
+        free(fetch_message.payload);
+        db_operator_free(shared_fetch_operators.dbos[0]);
+        free(shared_fetch_operators.dbos);
+        shared_fetch_operators.dbos = NULL;
+        shared_fetch_operators.dbo_slots = 0;
+        shared_fetch_operators.num_dbos = 0;
+        return;
+    }
+    log_info("shared pass for %d fetches\n", num_fetches);
+
+    SharedScanColumn* columns;
+    int num_columns = group_shared_scan_columns(&shared_fetch_operators, &columns);
+    DbOperator** fetches = shared_fetch_operators.dbos;
+
+    // only total up the fetches something is waiting on
+    bool* wants_totals = calloc(num_fetches + 1, sizeof(bool));
+    for (int i = 0; i < num_held_aggregates; ++i) {
+        wants_totals[waiting_fetch(held_aggregates[i].input)] = true;
+    }
+    // add one so that we can write loops with fewer branch predictions
+    int** outputs = malloc(sizeof(int*) * num_fetches);
+    for (int k = 0; k < num_fetches; ++k) {
+        outputs[k] = malloc((fetches[k]->operator_fields.fetch_operator.ids_result->num_tuples + 1) * sizeof(int));
+    }
+
+    // split each column into ranges of bitvector ints, one task per range
+    int* column_ints = malloc(sizeof(int) * num_columns);
+    int num_tasks = 0;
+    int num_task_slots = 0;
+    for (int c = 0; c < num_columns; ++c) {
+        column_ints[c] = 0;
+        for (int k = columns[c].first_query; k < columns[c].first_query + columns[c].num_queries; ++k) {
+            int bitvector_ints = fetches[k]->operator_fields.fetch_operator.ids_result->bitvector_ints;
+            column_ints[c] = bitvector_ints > column_ints[c] ? bitvector_ints : column_ints[c];
+        }
+        int num_ranges = (column_ints[c] + SHARED_FETCH_CHUNK_INTS - 1) / SHARED_FETCH_CHUNK_INTS;
+        num_tasks += num_ranges;
+        num_task_slots += num_ranges * columns[c].num_queries;
+    }
+    SharedFetchTask* tasks = malloc(sizeof(SharedFetchTask) * (num_tasks + 1));
+    int* output_offsets = malloc(sizeof(int) * (num_task_slots + 1));
+    SharedFetchTotals* totals = malloc(sizeof(SharedFetchTotals) * (num_task_slots + 1));
+    SharedFetchTask* task = tasks;
+    int slot = 0;
+    for (int c = 0; c < num_columns; ++c) {
+        int first = columns[c].first_query;
+        int num_column_fetches = columns[c].num_queries;
+        int num_ranges = (column_ints[c] + SHARED_FETCH_CHUNK_INTS - 1) / SHARED_FETCH_CHUNK_INTS;
+        for (int r = 0; r < num_ranges; ++r) {
+            task[r].fetches = fetches + first;
+            task[r].num_fetches = num_column_fetches;
+            task[r].outputs = outputs + first;
+            task[r].output_offsets = output_offsets + slot + (r * num_column_fetches);
+            task[r].wants_totals = wants_totals + first;
+            task[r].totals = totals + slot + (r * num_column_fetches);
+            task[r].data = columns[c].col->data;
+            task[r].start_int = r * SHARED_FETCH_CHUNK_INTS;
+            task[r].end_int = (r + 1) * SHARED_FETCH_CHUNK_INTS < column_ints[c] ? (r + 1) * SHARED_FETCH_CHUNK_INTS : column_ints[c];
+        }
+        // each range writes its fetches' values after those of the ranges
+        // before it, count them up front
+        for (int k = 0; k < num_column_fetches; ++k) {
+            Result* ids_result = fetches[first + k]->operator_fields.fetch_operator.ids_result;
+            int* ids = (int*) ids_result->payload;
+            int running_count = 0;
+            for (int r = 0; r < num_ranges; ++r) {
+                task[r].output_offsets[k] = running_count;
+                int end_int = task[r].end_int < ids_result->bitvector_ints ? task[r].end_int : ids_result->bitvector_ints;
+                for (int i = task[r].start_int; i < end_int; ++i) {
+                    running_count += __builtin_popcount((unsigned int) ids[i]);
+                }
+            }
+        }
+        task += num_ranges;
+        slot += num_ranges * num_column_fetches;
+    }
+    free(column_ints);
+
+    // a failed run leaves the fetches without results, which the commands
+    // after them will report
+    bool gathered = worker_pool_run(shared_fetch_range, tasks, sizeof(SharedFetchTask), num_tasks) == 0;
+    if (!gathered) {
+        fetch_message.status = EXECUTION_ERROR;
+        defer_error(fetches[0]->operator_fields.fetch_operator.handle, &fetch_message);
+    }
+
+    // store every fetch's result, and fold each range's totals together
+    Result** fetch_results = malloc(sizeof(Result*) * num_fetches);
+    SharedFetchTotals* fetch_totals = malloc(sizeof(SharedFetchTotals) * num_fetches);
+    for (int k = 0; k < num_fetches; ++k) {
+        fetch_results[k] = NULL;
+        fetch_totals[k].sum = 0;
+        fetch_totals[k].min = INT_MAX;
+        fetch_totals[k].max = INT_MIN;
+    }
+    for (int t = 0; t < num_tasks && gathered; ++t) {
+        int first = tasks[t].fetches - fetches;
+        for (int k = 0; k < tasks[t].num_fetches; ++k) {
+            SharedFetchTotals* range_totals = &(tasks[t].totals[k]);
+            SharedFetchTotals* fetch_total = &(fetch_totals[first + k]);
+            fetch_total->sum += range_totals->sum;
+            fetch_total->min = range_totals->min < fetch_total->min ? range_totals->min : fetch_total->min;
+            fetch_total->max = range_totals->max > fetch_total->max ? range_totals->max : fetch_total->max;
+        }
+    }
+    for (int k = 0; k < num_fetches; ++k) {
+        if (!gathered) {
+            free(outputs[k]);
+            continue;
+        }
+        FetchOperator* fetch_operator = &(fetches[k]->operator_fields.fetch_operator);
+        // create the result object
+        Result* result_obj = malloc(sizeof(Result));
+        result_obj->num_tuples = fetch_operator->ids_result->num_tuples;
+        result_obj->payload = outputs[k];
+        result_obj->data_type = INT;
+        // NOTE: this is the number of bitvector ints used to perform the fetch,
+        // but this result is itself values
+        result_obj->bitvector_ints = fetch_operator->ids_result->bitvector_ints;
+        result_obj->is_posn_vector = true; // this isn't a bitvector, it's the results from a fetch
+        fetch_results[k] = result_obj;
+    }
+    // every pass is done, so replacing a handle the fetches read is safe now
+    for (int k = 0; k < num_fetches && gathered; ++k) {
+        GeneralizedColumnHandle generalized_result_handle;
+        strcpy(generalized_result_handle.name, fetches[k]->operator_fields.fetch_operator.handle);
+        generalized_result_handle.generalized_column.column_type = RESULT;
+        generalized_result_handle.generalized_column.column_pointer.result = fetch_results[k];
+        add_to_client_context(context, generalized_result_handle);
+    }
+
+    // the aggregates can find the fetches now. those over a fetch's output
+    // are answered from its totals, anything else runs as usual
+    for (int i = 0; i < num_held_aggregates; ++i) {
+        message aggregate_message;
+        aggregate_message.payload = NULL;
+        DbOperator* aggregate = parse_command(held_aggregates[i].command, &aggregate_message, client_fd, context);
+        if (aggregate == NULL) {
+            // its input went missing with a failed pass
+            if (aggregate_message.status == OK_DONE || aggregate_message.status == OK_WAIT_FOR_RESPONSE) {
+                aggregate_message.status = EXECUTION_ERROR;
+            }
+            defer_error(held_aggregates[i].handle, &aggregate_message);
+        }
+        free(aggregate_message.payload);
+        aggregate_message.payload = NULL;
+        if (aggregate != NULL) {
+            GeneralizedColumn* input;
+            if (aggregate->type == AVERAGE) {
+                input = &(aggregate->operator_fields.average_operator.generalized_column);
+            } else if (aggregate->type == SUM) {
+                input = &(aggregate->operator_fields.sum_operator.generalized_column);
+            } else if (aggregate->type == MIN) {
+                input = &(aggregate->operator_fields.min_operator.generalized_column);
+            } else {
+                input = &(aggregate->operator_fields.max_operator.generalized_column);
+            }
+            int k = waiting_fetch(held_aggregates[i].input);
+            if (gathered && input->column_type == RESULT && input->column_pointer.result == fetch_results[k]) {
+                db_aggregate_from_totals(aggregate, fetch_totals[k].sum, fetch_totals[k].min, fetch_totals[k].max, &aggregate_message);
+            } else if (aggregate->type == AVERAGE) {
+                db_average(aggregate, &aggregate_message);
+            } else if (aggregate->type == SUM) {
+                db_sum(aggregate, &aggregate_message);
+            } else if (aggregate->type == MIN) {
+                db_min(aggregate, &aggregate_message);
+            } else {
+                db_max(aggregate, &aggregate_message);
+            }
+            defer_error(held_aggregates[i].handle, &aggregate_message);
+            free(aggregate_message.payload);
+            db_operator_free(aggregate);
+        }
+        free(held_aggregates[i].command);
+    }
+
+    free(fetch_results);
+    free(fetch_totals);
+    free(tasks);
+    free(output_offsets);
+    free(totals);
+    free(outputs);
+    free(wants_totals);
+    free(columns);
+    for (int k = 0; k < num_fetches; ++k) {
+        db_operator_free(fetches[k]);
+    }
+    free(shared_fetch_operators.dbos);
+    shared_fetch_operators.dbos = NULL;
+    shared_fetch_operators.dbo_slots = 0;
+    shared_fetch_operators.num_dbos = 0;
+    free(held_aggregates);
+    held_aggregates = NULL;
+    held_aggregate_slots = 0;
+    num_held_aggregates = 0;
+}
+
+/*
+ * holds an aggregate over a waiting fetch until the fetch has run
+ */
+static void hold_aggregate(const char* command, const char* handle, const char* input) {
+    if (num_held_aggregates == held_aggregate_slots) {
+        held_aggregate_slots = held_aggregate_slots == 0 ? SHARED_QUERY_START_SIZE : 2 * held_aggregate_slots;
+        HeldAggregate* old_aggregates = held_aggregates;
+        held_aggregates = malloc(sizeof(HeldAggregate) * held_aggregate_slots);
+        if (old_aggregates != NULL) {
+            memcpy(held_aggregates, old_aggregates, sizeof(HeldAggregate) * num_held_aggregates);
+            free(old_aggregates);
+        }
+    }
+    HeldAggregate* held = &(held_aggregates[num_held_aggregates++]);
+    strcpy(held->handle, handle);
+    strcpy(held->input, input);
+    held->command = malloc(strlen(command) + 1);
+    strcpy(held->command, command);
+}
+
+/*
+ * this function runs whatever is waiting for a cooperative scan that the
+ * next command might read, before the command is parsed. an aggregate over
+ * a waiting fetch waits along with it, in which case this returns true and
+ * fills in send_message. so does an error from a statement that waited,
+ * which is reported in place of this command's reply, and the command
+ * doesn't run
+ */
+bool cooperative_scan_before_command(const char* command, ClientContext* context, message* send_message) {
+    // the client is batching by hand, they decide what shares a scan
+    if (!COOPERATIVE_SCANS || currently_batching_query) {
+        return false;
+    }
+    // a batch that filled up ran with the last command
+    if (report_deferred_error(send_message)) {
+        return true;
+    }
+    char handle[HANDLE_MAX_SIZE];
+    char args[COOPERATIVE_SCAN_MAX_ARGS][HANDLE_MAX_SIZE];
+    int num_args;
+    const char* query_command = read_command(command, handle, args, &num_args);
+
+    // a select over a column names it as db.table.column, any other select
+    // reads a result, which might be one that's waiting
+    bool column_select = strncmp(query_command, "select(", 7) == 0 && num_args == 3 && strchr(args[0], '.') != NULL;
+    if (!column_select) {
+        shared_select_flush(context);
+        if (report_deferred_error(send_message)) {
+            return true;
+        }
+    }
+
+    // a fetch can wait with the others, as long as it doesn't read one of
+    // their results
+    if (strncmp(query_command, "fetch(", 6) == 0 && num_args == 2 && !waiting_handle(args[1])) {
+        return false;
+    }
+    // so can an exact aggregate over a waiting fetch's output, which gets
+    // answered from the fetch's pass
+    bool is_aggregate = strncmp(query_command, "avg(", 4) == 0 || strncmp(query_command, "sum(", 4) == 0 ||
+                        strncmp(query_command, "min(", 4) == 0 || strncmp(query_command, "max(", 4) == 0;
+    if (is_aggregate && num_args == 1 && handle[0] != '\0' && strchr(handle, ',') == NULL &&
+        waiting_fetch(args[0]) >= 0 && waiting_fetch(handle) < 0) {
+        hold_aggregate(command, handle, args[0]);
+        if (num_held_aggregates == COOPERATIVE_SCAN_MAX_QUERIES) {
+            shared_fetch_flush(context);
+        }
+        const char* result_message = "aggregate waiting for a shared fetch";
+        char* result_message_ptr = malloc(strlen(result_message) + 1);
+        strcpy(result_message_ptr, result_message);
+        send_message->payload = result_message_ptr;
+        send_message->status = OK_DONE;
+        return true;
+    }
+    shared_fetch_flush(context);
+    return report_deferred_error(send_message);
+}
+
+/*
+ * this function holds back a select over a column, or a fetch at
+ * a bitvector's positions, so it can share a scan with the ones that come
+ * after it. returns true if the query is now waiting, or was dropped to
+ * report an error from one that waited before it, in which case it owns
+ * the dbo and fills in send_message
+ */
+bool cooperative_scan_offer(DbOperator* query, message* send_message) {
+    // the client is batching by hand
+    if (!COOPERATIVE_SCANS || query == NULL || currently_batching_query) {
+        return false;
+    }
+    const char* result_message;
+    if (query->type == SELECT) {
+        Comparator* compare_info = query->operator_fields.select_operator.compare_info;
+        // the batch planner sends the selective ones on indexed columns
+        // through the index, so those can wait as well
+        if (compare_info->gen_col.column_type != COLUMN || compare_info->has_posn_vector) {
+            return false;
+        }
+
+        // a select reusing a waiting select's handle has to see that one's
+        // result replaced, so it starts the next scan
+        for (int i = 0; i < shared_scan_operators.num_dbos; ++i) {
+            if (strcmp(shared_scan_operators.dbos[i]->operator_fields.select_operator.compare_info->handle, compare_info->handle) == 0) {
+                shared_select_flush(query->context);
+                break;
+            }
+        }
+        if (report_deferred_error(send_message)) {
+            db_operator_free(query);
+            return true;
+        }
+        add_shared_dbo(query);
+        if (shared_scan_operators.num_dbos == COOPERATIVE_SCAN_MAX_QUERIES) {
+            shared_select_flush(query->context);
+        }
+        result_message = "select waiting for a shared scan";
+    } else if (query->type == FETCH) {
+        // only fetches at a bitvector's positions walk the column in order
+        if (!BITVECTOR_DB || !result_is_bitvector(query->operator_fields.fetch_operator.ids_result)) {
+            return false;
+        }
+        // same as selects, a reused handle has to see the old one replaced
+        if (waiting_handle(query->operator_fields.fetch_operator.handle)) {
+            shared_fetch_flush(query->context);
+        }
+        if (report_deferred_error(send_message)) {
+            db_operator_free(query);
+            return true;
+        }
+        append_dbo(&shared_fetch_operators, query);
+        if (shared_fetch_operators.num_dbos == COOPERATIVE_SCAN_MAX_QUERIES) {
+            shared_fetch_flush(query->context);
+        }
+        result_message = "fetch waiting for a shared pass";
+    } else {
+        return false;
+    }
+
+    char* result_message_ptr = malloc(strlen(result_message) + 1);
+    strcpy(result_message_ptr, result_message);
+    send_message->payload = result_message_ptr;
+    send_message->status = OK_DONE;
+    return true;
+}
+
+/*
+ * this function runs the selects and fetches waiting for a cooperative
+ * scan, storing their results in the client context. an error from one of
+ * them is reported on the next command
+ */
+void cooperative_scan_flush(ClientContext* context) {
+    if (!COOPERATIVE_SCANS || currently_batching_query) {
+        return;
+    }
+    shared_select_flush(context);
+    shared_fetch_flush(context);
+}
+
+/*
+ * this function drops the selects, fetches and aggregates waiting for a
+ * cooperative scan, for when their client is gone
+ */
+void cooperative_scan_discard(void) {
+    if (!COOPERATIVE_SCANS || currently_batching_query) {
+        return;
+    }
+    free(deferred_error);
+    deferred_error = NULL;
+    deferred_status = OK_DONE;
+    for (int i = 0; i < shared_scan_operators.num_dbos; ++i) {
+        db_operator_free(shared_scan_operators.dbos[i]);
+    }
+    free(shared_scan_operators.dbos);
+    shared_scan_operators.dbos = NULL;
+    shared_scan_operators.dbo_slots = 0;
+    shared_scan_operators.num_dbos = 0;
+    for (int i = 0; i < shared_fetch_operators.num_dbos; ++i) {
+        db_operator_free(shared_fetch_operators.dbos[i]);
+    }
+    free(shared_fetch_operators.dbos);
+    shared_fetch_operators.dbos = NULL;
+    shared_fetch_operators.dbo_slots = 0;
+    shared_fetch_operators.num_dbos = 0;
+    for (int i = 0; i < num_held_aggregates; ++i) {
+        free(held_aggregates[i].command);
+    }
+    free(held_aggregates);
+    held_aggregates = NULL;
+    held_aggregate_slots = 0;
+    num_held_aggregates = 0;
+}
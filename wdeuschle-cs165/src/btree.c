@@ -1172,7 +1172,8 @@ int* btree_select_range(BTree* btree, int low_value, int high_value, int* num_re
 
     Node* current_node = first_node_with_result;
     int current_idx = first_idx;
-    while (current_idx < current_node->num_entries) {
+    // the last leaf has no next node
+    while (current_node != NULL && current_idx < current_node->num_entries) {
         // check if we need to resize our position_vector
         if (results_count == current_pos_vector_sz) {
             // resize
@@ -127,3 +127,26 @@ Result* lookup_handle_result(char* handle, ClientContext* context) {
     }
     return ids_result;
 }
+
+/*
+ * This function returns the result stored under a handle if its buffer can be
+ * overwritten in place by a new int value vector of num_tuples entries, so
+ * operators can skip allocating a fresh payload for a handle they are about
+ * to replace. Returns NULL if there is no such result.
+ */
+Result* lookup_reusable_result(char* handle, int num_tuples, ClientContext* context) {
+    for (int i = 0; i < context->chandles_in_use; ++i) {
+        if (strcmp(handle, context->chandle_table[i].name) == 0) {
+            if (context->chandle_table[i].generalized_column.column_type != RESULT) {
+                return NULL;
+            }
+            Result* result = context->chandle_table[i].generalized_column.column_pointer.result;
+            // positions and bitvectors aren't laid out one int per tuple
+            if (result->data_type != INT || result_is_bitvector(result) || (int) result->num_tuples != num_tuples) {
+                return NULL;
+            }
+            return result;
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,183 @@
+#include <string.h>
+#include "db_expression.h"
+#include "client_context.h"
+#include "utils.h"
+
+// number of values we evaluate the whole tree over at a time, small enough
+// that every intermediate for a batch stays in cache
+#define EXPR_VECTOR_SIZE 1024
+#define EXPR_LANES 4
+
+// 4 wide int vector, only aligned to an int so it can load from anywhere in a
+// column or result
+typedef int v4si __attribute__((vector_size(EXPR_LANES * sizeof(int)), aligned(sizeof(int))));
+
+/* 
+ * this function applies op elementwise to two operands over num_values values,
+ * writing to out. division by zero evaluates to 0 and is counted in
+ * num_divide_by_zero
+ */
+void expression_apply(char op, ExprOperand left, ExprOperand right, int* out, int num_values, int* num_divide_by_zero) {
+    if (op == '/') {
+        // no vector integer division, do it one at a time
+        for (int i = 0; i < num_values; ++i) {
+            long numerator = left.is_constant ? left.constant : left.data[i];
+            long denominator = right.is_constant ? right.constant : right.data[i];
+            *num_divide_by_zero += denominator == 0;
+            // divide by one instead of zero, then zero the result
+            out[i] = (int) (numerator / (denominator + (denominator == 0))) * (denominator != 0);
+        }
+        return;
+    }
+
+    // constants are broadcast to every lane
+    v4si left_splat = {left.constant, left.constant, left.constant, left.constant};
+    v4si right_splat = {right.constant, right.constant, right.constant, right.constant};
+    int i = 0;
+    for (; i + EXPR_LANES <= num_values; i += EXPR_LANES) {
+        v4si x = left.is_constant ? left_splat : *(v4si*) (left.data + i);
+        v4si y = right.is_constant ? right_splat : *(v4si*) (right.data + i);
+        v4si result;
+        if (op == '+') {
+            result = x + y;
+        } else if (op == '-') {
+            result = x - y;
+        } else {
+            result = x * y;
+        }
+        *(v4si*) (out + i) = result;
+    }
+    // leftovers that don't fill a vector
+    for (; i < num_values; ++i) {
+        int x = left.is_constant ? left.constant : left.data[i];
+        int y = right.is_constant ? right.constant : right.data[i];
+        if (op == '+') {
+            out[i] = x + y;
+        } else if (op == '-') {
+            out[i] = x - y;
+        } else {
+            out[i] = x * y;
+        }
+    }
+}
+
+/*
+ * evaluates the subtree rooted at node_idx over values [start, start + num_values).
+ * vectors are read in place, operations write to their own scratch buffer
+ * unless they are the root, which writes straight to out
+ */
+static ExprOperand evaluate_expression_batch(ExpressionOperator* expression, int node_idx,
+    int start, int num_values, int** scratch, int* out, int* num_divide_by_zero) {
+    ExprNode* node = &(expression->nodes[node_idx]);
+    ExprOperand operand;
+    operand.is_constant = false;
+    operand.constant = 0;
+    if (node->type == EXPR_CONSTANT) {
+        operand.is_constant = true;
+        operand.constant = node->constant;
+        operand.data = NULL;
+    } else if (node->type == EXPR_VECTOR) {
+        operand.data = node->data + start;
+    } else {
+        ExprOperand left = evaluate_expression_batch(expression, node->left, start, num_values, scratch, NULL, num_divide_by_zero);
+        ExprOperand right = evaluate_expression_batch(expression, node->right, start, num_values, scratch, NULL, num_divide_by_zero);
+        operand.data = out != NULL ? out : scratch[node_idx];
+        expression_apply(node->op, left, right, operand.data, num_values, num_divide_by_zero);
+    }
+    return operand;
+}
+
+/* 
+ * this function evaluates an expression tree one cache sized batch at a time,
+ * writing only the final values to output. returns the number of divisions
+ * by zero encountered
+ */
+int evaluate_expression(ExpressionOperator* expression, int* output) {
+    int num_divide_by_zero = 0;
+    // one batch sized scratch buffer for every operation below the root
+    int num_operations = 0;
+    for (int i = 0; i < expression->num_nodes; ++i) {
+        num_operations += expression->nodes[i].type == EXPR_OPERATION && i != expression->root;
+    }
+    int* scratch_space = malloc(sizeof(int) * EXPR_VECTOR_SIZE * (num_operations + 1));
+    int* scratch[expression->num_nodes];
+    int next_scratch = 0;
+    for (int i = 0; i < expression->num_nodes; ++i) {
+        scratch[i] = NULL;
+        if (expression->nodes[i].type == EXPR_OPERATION && i != expression->root) {
+            scratch[i] = scratch_space + (EXPR_VECTOR_SIZE * next_scratch++);
+        }
+    }
+
+    ExprNode* root = &(expression->nodes[expression->root]);
+    for (int start = 0; start < expression->num_results; start += EXPR_VECTOR_SIZE) {
+        int num_values = expression->num_results - start < EXPR_VECTOR_SIZE ? expression->num_results - start : EXPR_VECTOR_SIZE;
+        if (root->type == EXPR_OPERATION) {
+            evaluate_expression_batch(expression, expression->root, start, num_values, scratch, output + start, &num_divide_by_zero);
+        } else if (root->type == EXPR_VECTOR) {
+            // a bare vector is just a copy
+            memmove(output + start, root->data + start, sizeof(int) * num_values);
+        } else {
+            for (int i = 0; i < num_values; ++i) {
+                output[start + i] = root->constant;
+            }
+        }
+    }
+
+    free(scratch_space);
+    return num_divide_by_zero;
+}
+
+/* 
+ * this function evaluates an expression and stores it in the client context,
+ * overwriting the old buffer of the handle in place when it has the right
+ * size. returns the number of divisions by zero encountered
+ */
+int store_expression_result(ExpressionOperator* expression, ClientContext* context) {
+    // elementwise evaluation never reads a value after writing its slot, so
+    // this is safe even if the old result is one of our operands
+    Result* reusable_result = lookup_reusable_result(expression->handle, expression->num_results, context);
+    if (reusable_result != NULL) {
+        log_info("reusing the buffer of %s\n", expression->handle);
+        reusable_result->bitvector_ints = -1;
+        return evaluate_expression(expression, (int*) reusable_result->payload);
+    }
+
+    int* final_results = malloc(sizeof(int) * (expression->num_results + 1));
+    int num_divide_by_zero = evaluate_expression(expression, final_results);
+
+    // create the result obj
+    Result* result_obj = malloc(sizeof(Result));
+    result_obj->num_tuples = expression->num_results;
+    result_obj->payload = final_results;
+    result_obj->data_type = INT;
+    result_obj->bitvector_ints = -1;
+    result_obj->is_posn_vector = true; // not a bitvector, one value per tuple
+
+    // wrap the results appropriately
+    GeneralizedColumnHandle result_wrapper;
+    strcpy(result_wrapper.name, expression->handle);
+    result_wrapper.generalized_column.column_type = RESULT;
+    result_wrapper.generalized_column.column_pointer.result = result_obj;
+    // add this value to the client context variable pool
+    add_to_client_context(context, result_wrapper);
+    return num_divide_by_zero;
+}
+
+/* 
+ * this function evaluates an arithmetic expression over columns, results and
+ * constants and stores the result in the client context
+ */
+void db_expression(DbOperator* query, message* send_message) {
+    log_info("calling db_expression\n");
+
+    int num_divide_by_zero = store_expression_result(&(query->operator_fields.expression_operator), query->context);
+
+    const char* result_message = num_divide_by_zero == 0 ?
+        "expression successful" : "expression successful, division by zero evaluated to 0";
+    char* result_message_ptr = malloc(strlen(result_message) + 1);
+    strcpy(result_message_ptr, result_message);
+    send_message->payload = result_message_ptr;
+    send_message->status = OK_DONE;
+    return;
+}
@@ -0,0 +1,274 @@
+#include <string.h>
+#include "db_group_by.h"
+#include "client_context.h"
+#include "utils.h"
+#include "db_helpers.h"
+
+// number of rows a thread claims at a time
+#define GROUP_BY_MORSEL_SIZE ((int) 1 << 16)
+// number of rows we hand the aggregation table at a time
+#define GROUP_BY_VECTOR_SIZE 1024
+// number of groups a thread local table holds before spilling, sized so the
+// slots (at our load ratio) stay resident in L2
+#define GROUP_BY_LOCAL_GROUPS ((int) 1 << 13)
+#define GROUP_BY_MAX_THREADS 4
+#define GROUP_BY_PARTITION_START_SIZE 1024
+
+/*
+ * appends a partially aggregated group to a partition, growing it if necessary
+ */
+static void group_by_partition_append(GroupByPartition* partition, aggTableEntry* entry) {
+    // double size if necessary before appending
+    if (partition->num_entries == partition->size) {
+        aggTableEntry* old_entries = partition->entries;
+        int old_size = partition->size;
+        partition->size = old_size == 0 ? GROUP_BY_PARTITION_START_SIZE : 2 * old_size;
+        partition->entries = malloc(sizeof(aggTableEntry) * partition->size);
+        if (old_entries != NULL) {
+            memcpy(partition->entries, old_entries, sizeof(aggTableEntry) * old_size);
+            free(old_entries);
+        }
+    }
+    partition->entries[partition->num_entries++] = *entry;
+}
+
+/*
+ * moves every group in a thread's local table out to its partitions and
+ * empties the table
+ */
+static void group_by_spill_local_table(GroupByTask* task) {
+    aggtable* local_table = task->local_table;
+    for (int i = 0; i < local_table->size; ++i) {
+        aggTableEntry* entry = &(local_table->array[i]);
+        if (entry->count != 0) {
+            // partition on the top bits of the hash
+            int partition = multiplicative_hash(entry->key) >> (32 - GROUP_BY_PARTITION_BITS);
+            group_by_partition_append(&(task->partitions[partition]), entry);
+        }
+    }
+    agg_clear(local_table);
+}
+
+/*
+ * this function aggregates the morsels a thread owns into its local table,
+ * spilling to partitions whenever the table outgrows the cache
+ */
+void* group_by_aggregate_morsels(void* task_void) {
+    GroupByTask* task = (GroupByTask*) task_void;
+    aggtable* local_table = task->local_table;
+    // stride through the morsels so every thread gets an even share
+    for (int morsel_start = task->thread_id * GROUP_BY_MORSEL_SIZE;
+         morsel_start < task->num_values;
+         morsel_start += task->num_threads * GROUP_BY_MORSEL_SIZE) {
+        int morsel_end = morsel_start + GROUP_BY_MORSEL_SIZE;
+        if (morsel_end > task->num_values) {
+            morsel_end = task->num_values;
+        }
+        for (int i = morsel_start; i < morsel_end; i += GROUP_BY_VECTOR_SIZE) {
+            int vector_size = morsel_end - i < GROUP_BY_VECTOR_SIZE ? morsel_end - i : GROUP_BY_VECTOR_SIZE;
+            // spill rather than let the table grow out of cache
+            if (local_table->num_entries + vector_size > local_table->size * AGG_TABLE_RATIO) {
+                group_by_spill_local_table(task);
+            }
+            agg_update_batch(local_table, task->keys + i, task->values + i, vector_size);
+        }
+    }
+    // whatever is left over goes to the partitions as well
+    group_by_spill_local_table(task);
+    return NULL;
+}
+
+/*
+ * this function merges every thread's spilled entries for a partition
+ */
+void* group_by_merge_partition(void* merge_task_void) {
+    GroupByMergeTask* merge_task = (GroupByMergeTask*) merge_task_void;
+    // size for the number of partial entries, the true number of groups is
+    // at most this
+    int num_partial_entries = 0;
+    for (int i = 0; i < merge_task->num_tasks; ++i) {
+        num_partial_entries += merge_task->tasks[i].partitions[merge_task->partition].num_entries;
+    }
+    agg_allocate(&(merge_task->merged_table), num_partial_entries, GROUP_BY_PARTITION_BITS);
+    for (int i = 0; i < merge_task->num_tasks; ++i) {
+        GroupByPartition* partition = &(merge_task->tasks[i].partitions[merge_task->partition]);
+        for (int j = 0; j < partition->num_entries; ++j) {
+            agg_merge(merge_task->merged_table, &(partition->entries[j]));
+        }
+    }
+    return NULL;
+}
+
+/*
+ * comparison function for ordering groups by key
+ */
+static int compare_agg_entry_keys(const void* a, const void* b) {
+    int key_a = ((const aggTableEntry*) a)->key;
+    int key_b = ((const aggTableEntry*) b)->key;
+    return (key_a > key_b) - (key_a < key_b);
+}
+
+/*
+ * this function groups a vector of values by a vector of keys, storing one
+ * result with the distinct keys and one with the aggregate for each key
+ */
+void db_group_by(DbOperator* query, message* send_message) {
+    log_info("calling db_group_by\n");
+    GroupByOperator* group_by = &(query->operator_fields.group_by_operator);
+    int num_values = group_by->num_results;
+    int* keys;
+    int* values;
+    // populate both arr pointers
+    if (group_by->keys.column_type == RESULT) {
+        keys = (int*) group_by->keys.column_pointer.result->payload;
+    } else {
+        keys = group_by->keys.column_pointer.column->data;
+    }
+    if (group_by->values.column_type == RESULT) {
+        values = (int*) group_by->values.column_pointer.result->payload;
+    } else {
+        values = group_by->values.column_pointer.column->data;
+    }
+
+    // split the input into morsels, one thread per morsel up to our max
+    int num_morsels = (num_values / GROUP_BY_MORSEL_SIZE) + (num_values % GROUP_BY_MORSEL_SIZE > 0);
+    int num_threads = num_morsels < GROUP_BY_MAX_THREADS ? num_morsels : GROUP_BY_MAX_THREADS;
+    if (num_threads == 0) {
+        num_threads = 1;
+    }
+
+    // AGGREGATE: each thread folds its morsels into a private table
+    GroupByTask* tasks = calloc(num_threads, sizeof(GroupByTask));
+    for (int i = 0; i < num_threads; ++i) {
+        tasks[i].keys = keys;
+        tasks[i].values = values;
+        tasks[i].num_values = num_values;
+        tasks[i].thread_id = i;
+        tasks[i].num_threads = num_threads;
+        agg_allocate(&(tasks[i].local_table), GROUP_BY_LOCAL_GROUPS, 0);
+    }
+    GroupByMergeTask merge_tasks[GROUP_BY_PARTITIONS];
+    for (int i = 0; i < GROUP_BY_PARTITIONS; ++i) {
+        merge_tasks[i].tasks = tasks;
+        merge_tasks[i].num_tasks = num_threads;
+        merge_tasks[i].partition = i;
+        merge_tasks[i].merged_table = NULL;
+    }
+    int failure = run_in_threads(group_by_aggregate_morsels, tasks, sizeof(GroupByTask), num_threads);
+
+    // MERGE: each partition is disjoint, so they can be merged independently
+    if (failure == 0) {
+        // only bother with threads once groups actually spilled
+        int merge_threads = num_values > GROUP_BY_LOCAL_GROUPS ? GROUP_BY_MAX_THREADS : 1;
+        for (int i = 0; i < GROUP_BY_PARTITIONS && failure == 0; i += merge_threads) {
+            failure = run_in_threads(group_by_merge_partition, merge_tasks + i, sizeof(GroupByMergeTask), merge_threads);
+        }
+    }
+
+    // the thread local tables and partitions are no longer needed
+    for (int i = 0; i < num_threads; ++i) {
+        agg_deallocate(tasks[i].local_table);
+        for (int j = 0; j < GROUP_BY_PARTITIONS; ++j) {
+            free(tasks[i].partitions[j].entries);
+        }
+    }
+    free(tasks);
+
+    if (failure != 0) {
+        for (int i = 0; i < GROUP_BY_PARTITIONS; ++i) {
+            if (merge_tasks[i].merged_table != NULL) {
+                agg_deallocate(merge_tasks[i].merged_table);
+            }
+        }
+        const char* result_message = "group by failed to run its threads";
+        char* result_message_ptr = malloc(strlen(result_message) + 1);
+        strcpy(result_message_ptr, result_message);
+        send_message->payload = result_message_ptr;
+        send_message->status = EXECUTION_ERROR;
+        return;
+    }
+
+    // gather the groups from every partition
+    int num_groups = 0;
+    for (int i = 0; i < GROUP_BY_PARTITIONS; ++i) {
+        num_groups += merge_tasks[i].merged_table->num_entries;
+    }
+    aggTableEntry* groups = malloc(sizeof(aggTableEntry) * (num_groups + 1));
+    int group_idx = 0;
+    for (int i = 0; i < GROUP_BY_PARTITIONS; ++i) {
+        aggtable* merged_table = merge_tasks[i].merged_table;
+        for (int j = 0; j < merged_table->size; ++j) {
+            if (merged_table->array[j].count != 0) {
+                groups[group_idx++] = merged_table->array[j];
+            }
+        }
+        agg_deallocate(merged_table);
+    }
+    // hash order is meaningless to the client, hand groups back by key
+    qsort(groups, num_groups, sizeof(aggTableEntry), compare_agg_entry_keys);
+
+    // split the groups into the key and aggregate results
+    int* group_keys = malloc(sizeof(int) * (num_groups + 1));
+    void* group_aggs;
+    int agg_data_type;
+    if (group_by->agg_type == GROUP_BY_AVG) {
+        double* averages = malloc(sizeof(double) * (num_groups + 1));
+        for (int i = 0; i < num_groups; ++i) {
+            averages[i] = (long double) groups[i].sum / (double) groups[i].count;
+        }
+        group_aggs = averages;
+        agg_data_type = DOUBLE;
+    } else if (group_by->agg_type == GROUP_BY_MIN || group_by->agg_type == GROUP_BY_MAX) {
+        int* extremes = malloc(sizeof(int) * (num_groups + 1));
+        for (int i = 0; i < num_groups; ++i) {
+            extremes[i] = group_by->agg_type == GROUP_BY_MIN ? groups[i].min : groups[i].max;
+        }
+        group_aggs = extremes;
+        agg_data_type = INT;
+    } else {
+        long* totals = malloc(sizeof(long) * (num_groups + 1));
+        for (int i = 0; i < num_groups; ++i) {
+            totals[i] = group_by->agg_type == GROUP_BY_SUM ? groups[i].sum : groups[i].count;
+        }
+        group_aggs = totals;
+        agg_data_type = LONG;
+    }
+    for (int i = 0; i < num_groups; ++i) {
+        group_keys[i] = groups[i].key;
+    }
+    free(groups);
+
+    // create the result objs
+    Result* key_result = malloc(sizeof(Result));
+    key_result->num_tuples = num_groups;
+    key_result->payload = group_keys;
+    key_result->data_type = INT;
+    key_result->bitvector_ints = -1;
+    key_result->is_posn_vector = true; // not a bitvector, one value per group
+    Result* agg_result = malloc(sizeof(Result));
+    agg_result->num_tuples = num_groups;
+    agg_result->payload = group_aggs;
+    agg_result->data_type = agg_data_type;
+    agg_result->bitvector_ints = -1;
+    agg_result->is_posn_vector = true; // not a bitvector, one value per group
+
+    // wrap the results appropriately and add them to the client context
+    GeneralizedColumnHandle key_wrapper;
+    strcpy(key_wrapper.name, group_by->key_handle);
+    key_wrapper.generalized_column.column_type = RESULT;
+    key_wrapper.generalized_column.column_pointer.result = key_result;
+    add_to_client_context(query->context, key_wrapper);
+    GeneralizedColumnHandle agg_wrapper;
+    strcpy(agg_wrapper.name, group_by->agg_handle);
+    agg_wrapper.generalized_column.column_type = RESULT;
+    agg_wrapper.generalized_column.column_pointer.result = agg_result;
+    add_to_client_context(query->context, agg_wrapper);
+    log_info("GROUPS: %d\n", num_groups);
+
+    const char* result_message = "group by successful";
+    char* result_message_ptr = malloc(strlen(result_message) + 1);
+    strcpy(result_message_ptr, result_message);
+    send_message->payload = result_message_ptr;
+    send_message->status = OK_DONE;
+    return;
+}
@@ -3,6 +3,7 @@
 #include "cs165_api.h"
 #include "db_helpers.h"
 #include "utils.h"
+#include "worker_pool.h"
 
 /* 
  * this function returns the column by which a table is clustered if it exists
@@ -287,3 +288,12 @@ bool has_clustered_index(Table* table) {
     }
     return false;
 }
+
+/* 
+ * this function runs fn over each of num_args args laid out arg_size bytes
+ * apart on the worker pool, and waits for them all. if there is only one we
+ * stay on the current thread. returns 0 on success and -1 on failure
+ */
+int run_in_threads(void* (*fn)(void*), void* args, size_t arg_size, int num_args) {
+    return worker_pool_run(fn, args, arg_size, num_args);
+}
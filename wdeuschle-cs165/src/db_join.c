@@ -1,5 +1,5 @@
 #include <string.h>
-#include <assert.h>
+#include <time.h>
 #include "cs165_api.h"
 #include "utils.h"
 #include "db_join.h"
@@ -7,23 +7,223 @@
 #include "client_context.h"
 #include "db_helpers.h"
 #include "hash_table.h"
+#include "hardware.h"
+#include "db_sort.h"
+#include "worker_pool.h"
+#include "btree.h"
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
 
-#define INTS_PER_PAGE ((int) (4096 / sizeof(int)))
 #define STARTING_RESULT_CAPACITY 4096
-// eventually figure out how many partitions actually works best, or even do it dynamically
-#define NUM_PARTITIONS 64
+// ints the nested loop join compares per instruction, a whole register's
+// worth. the build only assumes SSE2 unless told it can use AVX2
+#ifdef __AVX2__
+#define NESTED_LOOP_LANES 8
+#else
+#define NESTED_LOOP_LANES 4
+#endif
+// fewest outer values worth a tile (and a task) of their own
+#define NESTED_LOOP_MIN_TILE ((int) 1 << 10)
+// fewest values worth handing a thread of their own when partitioning
+#define JOIN_MIN_VALUES_PER_THREAD ((int) 1 << 16)
+// partitions (and join tasks) we'd like per thread, so stealing can even out
+// partitions of different sizes
+#define JOIN_TASKS_PER_THREAD 4
+// smallest larger side worth building a bloom filter to thin out
+#define JOIN_BLOOM_MIN_PROBE_SIZE ((int) 1 << 14)
+// values of the larger side checked against the filter to see if it's worth it
+#define JOIN_BLOOM_SAMPLE_SIZE 1024
+// most of the sample the filter can let through and still be used
+#define JOIN_BLOOM_MAX_PASS_RATE 0.5
+// how many times the average size a partition has to be to count as skewed
+#define JOIN_SKEW_FACTOR 4
+// fewest probes worth a slice (and a task) of their own in a skewed partition
+#define JOIN_MIN_PROBE_SLICE ((int) 1 << 14)
+// values in the synthetic input the cost model is calibrated on, well past
+// L2 like the joins worth planning
+#define JOIN_CALIBRATION_VALUES ((int) 1 << 19)
+// the nested loop is calibrated on a tile of this many outer values...
+#define JOIN_CALIBRATION_OUTER 256
+// ...against this many inner values
+#define JOIN_CALIBRATION_INNER ((int) 1 << 14)
+// the hash join is calibrated building on this many values, probing with
+// all of them
+#define JOIN_CALIBRATION_BUILD ((int) 1 << 17)
+// times each step is run, the fastest is kept
+#define JOIN_CALIBRATION_RUNS 2
+// values sampled from each side of a join to estimate how many results it has
+#define JOIN_PLAN_SAMPLE_SIZE 4096
+
+// until calibration says otherwise
+static JoinCostModel join_cost_model = { 1e-9, 5e-9, 20e-9, 10e-9, 2e-9 };
+// calibrating runs each step over a few MB, so it waits for the first plan
+static bool join_calibrated = false;
+
+// unaligned, join inputs are only int aligned
+typedef int join_vector __attribute__((vector_size(NESTED_LOOP_LANES * sizeof(int)), aligned(sizeof(int))));
+
+/* 
+ * the number of ints a bitvector over one side of a join's rows needs: as
+ * many as the bitvector its positions were selected in, or enough to hold
+ * its largest position
+ */
+static int join_output_bitvector_ints(Result* pos_result) {
+    if (result_is_bitvector(pos_result)) {
+        return pos_result->bitvector_ints;
+    }
+    int* positions = (int*) pos_result->payload;
+    int max_position = -1;
+    for (size_t i = 0; i < pos_result->num_tuples; ++i) {
+        if (positions[i] > max_position) {
+            max_position = positions[i];
+        }
+    }
+    return num_bitvector_ints_needed(max_position + 1);
+}
+
+/* 
+ * stores one side of a join's results in the client context under handle,
+ * either as the position vector itself or as a bitvector of the rows in it.
+ * takes ownership of result_vector
+ */
+static void add_join_result_to_context(DbOperator* query, char* handle, int* result_vector, int num_results, Result* pos_result) {
+    // create the result object
+    Result* result_obj = malloc(sizeof(Result));
+    result_obj->data_type = INT;
+    if (query->operator_fields.join_operator.bitvector_output) {
+        // only which rows joined matters, so each row is marked once however
+        // many times it matched
+        int bitvector_ints = join_output_bitvector_ints(pos_result);
+        int* bitvector = calloc(bitvector_ints + 1, sizeof(int));
+        mark_bv_from_pos_vec(bitvector, result_vector, num_results);
+        free(result_vector);
+        int num_rows = 0;
+        for (int i = 0; i < bitvector_ints; ++i) {
+            num_rows += __builtin_popcount((unsigned int) bitvector[i]);
+        }
+        result_obj->num_tuples = num_rows;
+        result_obj->payload = bitvector;
+        result_obj->bitvector_ints = bitvector_ints;
+        result_obj->is_posn_vector = false;
+    } else {
+        result_obj->num_tuples = num_results;
+        result_obj->payload = result_vector;
+        result_obj->bitvector_ints = -1; // no bitvector ints, result is not a bitvector
+        result_obj->is_posn_vector = true; // need to specify, because usually we use bitvectors
+    }
+    // wrap the result object appropriately
+    GeneralizedColumnHandle generalized_result_handle;
+    // add name to result wrapper
+    strcpy(generalized_result_handle.name, handle);
+    // update type
+    generalized_result_handle.generalized_column.column_type = RESULT;
+    // add the result
+    generalized_result_handle.generalized_column.column_pointer.result = result_obj;
+    // add this value to the client context variable pool
+    add_to_client_context(query->context, generalized_result_handle);
+}
+
+/* 
+ * stores a join's left and right position vectors in the client context
+ * under the join's handles
+ */
+static void add_join_results_to_context(DbOperator* query, int* left_result_vector, int* right_result_vector, int num_results) {
+    JoinOperator* join_operator = &(query->operator_fields.join_operator);
+    add_join_result_to_context(query, join_operator->left_handle, left_result_vector, num_results, join_operator->pos1_result);
+    add_join_result_to_context(query, join_operator->right_handle, right_result_vector, num_results, join_operator->pos2_result);
+}
+
+/* 
+ * this function points join_positions at a join input's positions, without
+ * copying or decoding them
+ */
+void join_positions_from_result(Result* pos_result, JoinPositions* join_positions) {
+    if (result_is_bitvector(pos_result)) {
+        join_positions->positions = NULL;
+        join_positions->bitvector = (int*) pos_result->payload;
+        join_positions->bitvector_ints = pos_result->bitvector_ints;
+    } else {
+        join_positions->positions = (int*) pos_result->payload;
+        join_positions->bitvector = NULL;
+        join_positions->bitvector_ints = 0;
+    }
+    join_positions->owns_positions = false;
+}
+
+/* 
+ * this function returns one side's positions as a position vector of
+ * num_values positions, decoding them first if they're a bitvector
+ */
+int* join_position_vector(JoinPositions* join_positions, int num_values) {
+    if (join_positions->positions == NULL) {
+        // one set bit per value, so we know exactly how much room it takes
+        join_positions->positions = malloc(sizeof(int) * (num_values + 1));
+        int bv_idx = -1;
+        unsigned int current_bits = 0;
+        next_bitvector_positions(join_positions->bitvector, join_positions->bitvector_ints,
+            &bv_idx, &current_bits, join_positions->positions, num_values);
+        join_positions->owns_positions = true;
+    }
+    return join_positions->positions;
+}
+
+/* 
+ * this function frees any positions decoded for a join
+ */
+void free_join_positions(JoinPositions* join_positions) {
+    if (join_positions->owns_positions) {
+        free(join_positions->positions);
+    }
+    join_positions->positions = NULL;
+    join_positions->owns_positions = false;
+}
+
+/* 
+ * the name a join type is given in a query
+ */
+static const char* join_type_name(int join_type) {
+    if (join_type == NESTED_LOOP_JOIN) {
+        return "nested-loop";
+    } else if (join_type == HASH_JOIN) {
+        return "hash";
+    } else if (join_type == SORT_MERGE_JOIN) {
+        return "sort-merge";
+    } else if (join_type == INDEX_JOIN) {
+        return "index";
+    } else if (join_type == AUTO_JOIN) {
+        return "auto";
+    }
+    return "unknown";
+}
 
 /* 
  * this function handles execution of the join query by delegating to the
- * proper join function
+ * proper join function. an auto join has the planner pick it, and explain
+ * describes the plan rather than running it
  */
 void db_join(DbOperator* query, message* send_message) {
-    if (query->operator_fields.join_operator.join_type == NESTED_LOOP_JOIN) {
+    JoinOperator* join_operator = &(query->operator_fields.join_operator);
+    int join_type = join_operator->join_type;
+    if (join_type == AUTO_JOIN || join_operator->explain) {
+        JoinPlan plan;
+        plan_join(join_operator, &plan);
+        if (join_operator->explain) {
+            send_message->payload = explain_join_plan(&plan);
+            send_message->status = OK_WAIT_FOR_RESPONSE;
+            return;
+        }
+        join_type = plan.join_type;
+    }
+
+    if (join_type == NESTED_LOOP_JOIN) {
         db_join_nested_loop(query, send_message);
-        return;
-    } else if (query->operator_fields.join_operator.join_type == HASH_JOIN) {
+    } else if (join_type == HASH_JOIN) {
         db_join_hash(query, send_message);
-        return;
+    } else if (join_type == SORT_MERGE_JOIN) {
+        db_join_sort_merge(query, send_message);
+    } else if (join_type == INDEX_JOIN) {
+        db_join_index(query, send_message);
     } else {
         log_err("FAILURE, UNRECOGNIZED JOIN ALGORITHM\n");
         const char* result_message = "join failed, unrecognized join algorithm\n";
@@ -32,160 +232,221 @@ void db_join(DbOperator* query, message* send_message) {
         send_message->status = EXECUTION_ERROR;
         send_message->payload = results_str;
     }
+
+    // say which algorithm the planner went with
+    if (join_operator->join_type == AUTO_JOIN && send_message->status == OK_DONE) {
+        char* done_message = send_message->payload;
+        char* result_message_ptr = malloc(strlen(done_message) + HANDLE_MAX_SIZE);
+        sprintf(result_message_ptr, "auto join chose %s: %s", join_type_name(join_type), done_message);
+        free(done_message);
+        send_message->payload = result_message_ptr;
+    }
     return;
 }
 
-/* 
- * this function handles a join using a nested loop algorithm
+/*
+ * turns a comparison result (every lane all ones or all zeros) into one bit
+ * per lane
  */
-void db_join_nested_loop(DbOperator* query, message* send_message) {
-    log_info("db_join_nested_loop\n");
-    // first create our two new results bitvectors
-    // use the size of the input position vectors to create our results bitvectors
-    // TODO: can you use bitvectors here? I don't think so in the end because
-    // of duplicates
-    /*int* left_bitvector_res = calloc(query->operator_fields.join_operator.pos1_result->bitvector_ints, sizeof(int));*/
-    /*int* right_bitvector_res = calloc(query->operator_fields.join_operator.pos2_result->bitvector_ints, sizeof(int));*/
-    int result_arr_size = STARTING_RESULT_CAPACITY;
-    int* left_result_vector = NULL; // need to assign after joining
-    int* right_result_vector = NULL; // need to assign after joining
-    // need position vectors from the position bitvectors
-    int* left_position_vector = pos_vector_from_bv((int*) query->operator_fields.join_operator.pos1_result->payload, query->operator_fields.join_operator.pos1_result->bitvector_ints);
-    int* right_position_vector = pos_vector_from_bv((int*) query->operator_fields.join_operator.pos2_result->payload, query->operator_fields.join_operator.pos2_result->bitvector_ints);
-    int num_results = 0;
+static inline unsigned int nested_loop_lane_bits(join_vector mask) {
+#if defined(__AVX2__)
+    return (unsigned int) _mm256_movemask_ps((__m256) mask);
+#elif defined(__SSE2__)
+    return (unsigned int) _mm_movemask_ps((__m128) mask);
+#else
+    unsigned int bits = 0;
+    for (int lane = 0; lane < NESTED_LOOP_LANES; ++lane) {
+        bits |= (unsigned int) (mask[lane] & 1) << lane;
+    }
+    return bits;
+#endif
+}
 
-    // the larger of the two comparison vectors is the one we want to iterate over
-    // set up the correct result vector for each of them
-    Result* to_iterate = NULL;
-    int* to_iterate_pos_vec = NULL; // hold position information about current values
-    int* to_iterate_res_vec = malloc(sizeof(int) * result_arr_size); // for results
-    Result* hold_in_place = NULL;
-    int* hold_in_place_pos_vec = NULL; // for results
-    int* hold_in_place_res_vec = malloc(sizeof(int) * result_arr_size); // hold position information about current values
-
-    // need to know the size of the left and right results to choose which
-    // we iterate over
-    int left_size = query->operator_fields.join_operator.val1_result->num_tuples;
-    int right_size = query->operator_fields.join_operator.val2_result->num_tuples;
+/*
+ * records a match between a value in a nested loop join's outer tile and an
+ * inner value, growing the match vectors if necessary
+ */
+static inline void nested_loop_append(int** tile_matches, int** inner_matches, int* capacity, int* num_matches,
+    int tile_offset, int inner_idx) {
+    (*tile_matches)[*num_matches] = tile_offset;
+    (*inner_matches)[(*num_matches)++] = inner_idx;
+    // resize if necessary
+    if (*num_matches == *capacity) {
+        int old_size = *capacity;
+        *tile_matches = resize_data(*tile_matches, &old_size);
+        // note we pass capacity here, it's because this function resizes
+        // that parameter
+        *inner_matches = resize_data(*inner_matches, capacity);
+    }
+}
 
-    if (left_size > right_size) {
-        to_iterate = query->operator_fields.join_operator.val1_result;
-        to_iterate_pos_vec = left_position_vector;
-        hold_in_place = query->operator_fields.join_operator.val2_result;
-        hold_in_place_pos_vec = right_position_vector;
-    } else {
-        to_iterate = query->operator_fields.join_operator.val2_result;
-        to_iterate_pos_vec = right_position_vector;
-        hold_in_place = query->operator_fields.join_operator.val1_result;
-        hold_in_place_pos_vec = left_position_vector;
-    }
-
-    int* to_iterate_data = (int*) to_iterate->payload;
-    int* hold_in_place_data = (int*) hold_in_place->payload;
-
-    // determine how many pages of the larger one we need to read in
-    int num_pages_of_larger = (to_iterate->num_tuples / INTS_PER_PAGE) + (to_iterate->num_tuples % INTS_PER_PAGE > 0);
-    // now we iterator over the larger vector, making comparisons as we go
-    for (int i = 0; i < num_pages_of_larger; ++i) {
-        // get the next page of the larger array
-        int* next_larger_page = to_iterate_data + (INTS_PER_PAGE * i);
-        int num_to_iterate;
-        if (i == num_pages_of_larger - 1) {
-            num_to_iterate = to_iterate->num_tuples - (INTS_PER_PAGE * i);
-        } else {
-            num_to_iterate = INTS_PER_PAGE;
-        }
-        for (int j = 0; j < num_to_iterate; ++j) {
-            // get the next value from the larger array
-            int value_from_larger = next_larger_page[j];
-            // iterate over all the values in the smaller array
-            for (int k = 0; k < (int) hold_in_place->num_tuples; ++k) {
-                if (value_from_larger == hold_in_place_data[k]) {
-                    // add position to result vector of the larger and smaller array
-                    int large_pos = to_iterate_pos_vec[(INTS_PER_PAGE * i) + j]; // access the correct position
-                    int small_pos = hold_in_place_pos_vec[k];
-                    to_iterate_res_vec[num_results] = large_pos;
-                    // need to keep the order of the smaller, which could fall
-                    // out of order otherwise
-                    hold_in_place_res_vec[num_results++] = small_pos; // also increment num_results
-
-                    // resize if necessary
-                    if (num_results == result_arr_size) {
-                        int old_size = result_arr_size;
-                        to_iterate_res_vec = resize_data(to_iterate_res_vec, &old_size);
-                        // note we pass result_arr_size here, it's because this
-                        // function resizes that parameter
-                        hold_in_place_res_vec = resize_data(hold_in_place_res_vec, &result_arr_size);
-                    }
-
-                    // from before, when using bitvectors. is this possible?
-                    /*if (!check_bv_position(to_iterate_res_vec, large_pos_to_mark)) {*/
-                        /*// larger*/
-                        /*mark_bv_from_pos_vec(to_iterate_res_vec, &large_pos_to_mark, 1);*/
-                        /*++num_results_larger;*/
-                    /*}*/
-                    /*if (!check_bv_position(hold_in_place_res_vec, small_pos_to_mark)) {*/
-                        /*// smaller*/
-                        /*mark_bv_from_pos_vec(hold_in_place_res_vec, &small_pos_to_mark, 1);*/
-                        /*++num_results_smaller;*/
-                    /*}*/
+/* 
+ * this function joins a task's tile of the outer side with the whole inner
+ * side, a cache sized block of inner values at a time, comparing each outer
+ * value with several inner values per instruction. results come back in
+ * outer order, and in inner order for each outer value
+ */
+void* nested_loop_join_tile(void* task_void) {
+    NestedLoopJoinTask* task = (NestedLoopJoinTask*) task_void;
+    int tile_size = task->end - task->start;
+    int* outer_values = task->outer_values + task->start;
+    int* inner_values = task->inner_values;
+    // matches as (offset into the tile, inner index), block by block
+    int capacity = STARTING_RESULT_CAPACITY;
+    int* tile_matches = malloc(sizeof(int) * capacity);
+    int* inner_matches = malloc(sizeof(int) * capacity);
+    int num_matches = 0;
+
+    // the tile stays in L2 while each inner block is run past it from L1
+    for (int block_start = 0; block_start < task->inner_size; block_start += task->inner_block_size) {
+        int block_end = block_start + task->inner_block_size;
+        if (block_end > task->inner_size) {
+            block_end = task->inner_size;
+        }
+        // two vectors at a time
+        int step = 2 * NESTED_LOOP_LANES;
+        int vector_end = block_start + (((block_end - block_start) / step) * step);
+        for (int i = 0; i < tile_size; ++i) {
+            int value = outer_values[i];
+            join_vector probe;
+            for (int lane = 0; lane < NESTED_LOOP_LANES; ++lane) {
+                probe[lane] = value;
+            }
+            for (int k = block_start; k < vector_end; k += step) {
+                join_vector first = *(join_vector*) (inner_values + k) == probe;
+                join_vector second = *(join_vector*) (inner_values + k + NESTED_LOOP_LANES) == probe;
+                // usually nothing matches, so check both vectors at once
+                if (nested_loop_lane_bits(first | second) == 0) {
+                    continue;
+                }
+                // otherwise each set lane is a match
+                unsigned int bits = nested_loop_lane_bits(first) | (nested_loop_lane_bits(second) << NESTED_LOOP_LANES);
+                while (bits != 0) {
+                    nested_loop_append(&tile_matches, &inner_matches, &capacity, &num_matches, i, k + __builtin_ctz(bits));
+                    bits &= bits - 1;
+                }
+            }
+            // whatever doesn't fill a vector
+            for (int k = vector_end; k < block_end; ++k) {
+                if (inner_values[k] == value) {
+                    nested_loop_append(&tile_matches, &inner_matches, &capacity, &num_matches, i, k);
                 }
             }
         }
     }
 
-    // need to reassign these, they get lost when resizing
-    if (left_size > right_size) {
-        left_result_vector = to_iterate_res_vec;
-        right_result_vector = hold_in_place_res_vec;
-    } else {
-        left_result_vector = hold_in_place_res_vec;
-        right_result_vector = to_iterate_res_vec;
+    // matches came out block by block, put them back in outer order. the
+    // counting sort is stable, so each outer value's matches stay in inner
+    // order
+    int* offsets = calloc(tile_size + 1, sizeof(int));
+    for (int m = 0; m < num_matches; ++m) {
+        ++offsets[tile_matches[m] + 1];
+    }
+    for (int i = 0; i < tile_size; ++i) {
+        offsets[i + 1] += offsets[i];
     }
+    task->outer_results = malloc(sizeof(int) * (num_matches + 1));
+    task->inner_results = malloc(sizeof(int) * (num_matches + 1));
+    for (int m = 0; m < num_matches; ++m) {
+        int destination = offsets[tile_matches[m]]++;
+        task->outer_results[destination] = task->outer_positions[task->start + tile_matches[m]];
+        task->inner_results[destination] = task->inner_positions[inner_matches[m]];
+    }
+    task->num_results = num_matches;
+    free(offsets);
+    free(tile_matches);
+    free(inner_matches);
+    return NULL;
+}
 
-    // copy results into client context
-    // create the left result object
-    Result* left_result_obj = malloc(sizeof(Result));
-    // no tuples in this result object
-    left_result_obj->num_tuples = num_results;
-    left_result_obj->payload = left_result_vector;
-    left_result_obj->data_type = INT;
-    left_result_obj->bitvector_ints = -1; // no bitvector ints, result is not a bitvector
-    left_result_obj->is_posn_vector = true; // need to specify, because usually we use bitvectors
-    // wrap the result object appropriately
-    GeneralizedColumnHandle left_generalized_result_handle;
-    // add name to result wrapper
-    strcpy(left_generalized_result_handle.name, query->operator_fields.join_operator.left_handle);
-    // update type
-    left_generalized_result_handle.generalized_column.column_type = RESULT;
-    // add the result
-    left_generalized_result_handle.generalized_column.column_pointer.result = left_result_obj;
-    // add this value to the client context variable pool
-    add_to_client_context(query->context, left_generalized_result_handle);
-
-    // create the right result object
-    Result* right_result_obj = malloc(sizeof(Result));
-    // no tuples in this result object
-    right_result_obj->num_tuples = num_results;
-    right_result_obj->payload = right_result_vector;
-    right_result_obj->data_type = INT;
-    right_result_obj->bitvector_ints = -1; // no bitvector ints, result is not a bitvector
-    right_result_obj->is_posn_vector = true; // need to specify, because usually we use bitvectors
-    // wrap the result object appropriately
-    GeneralizedColumnHandle right_generalized_result_handle;
-    // add name to result wrapper
-    strcpy(right_generalized_result_handle.name, query->operator_fields.join_operator.right_handle);
-    // update type
-    right_generalized_result_handle.generalized_column.column_type = RESULT;
-    // add the result
-    right_generalized_result_handle.generalized_column.column_pointer.result = right_result_obj;
-    // add this value to the client context variable pool
-    add_to_client_context(query->context, right_generalized_result_handle);
+/* 
+ * this function handles a join using a block nested loop algorithm. the
+ * outer side is split into tiles that fit in L2, and each tile is run past
+ * the inner side in blocks that fit in L1, with tiles spread over the worker
+ * pool
+ */
+void db_join_nested_loop(DbOperator* query, message* send_message) {
+    log_info("db_join_nested_loop\n");
+    JoinOperator* join_operator = &(query->operator_fields.join_operator);
+    int left_size = join_operator->val1_result->num_tuples;
+    int right_size = join_operator->val2_result->num_tuples;
+    // need position vectors, matches look positions up at random
+    JoinPositions left_positions;
+    JoinPositions right_positions;
+    join_positions_from_result(join_operator->pos1_result, &left_positions);
+    join_positions_from_result(join_operator->pos2_result, &right_positions);
+    int* left_position_vector = join_position_vector(&left_positions, left_size);
+    int* right_position_vector = join_position_vector(&right_positions, right_size);
+
+    // the larger side is the outer one we tile, the smaller is scanned over
+    // and over for each tile
+    bool left_is_outer = left_size > right_size;
+    int outer_size = left_is_outer ? left_size : right_size;
+    int inner_size = left_is_outer ? right_size : left_size;
+
+    // half of L1 for an inner block and half of L2 for an outer tile, the
+    // rest is left for the matches. small joins still get a tile per thread
+    int inner_block_size = (int) (cache_size(1) / (2 * sizeof(int)));
+    int tile_size = (int) (cache_size(2) / (2 * sizeof(int)));
+    int num_threads = worker_pool_threads();
+    int tile_per_task = outer_size / (num_threads * JOIN_TASKS_PER_THREAD);
+    if (tile_per_task < tile_size) {
+        tile_size = tile_per_task;
+    }
+    if (tile_size < NESTED_LOOP_MIN_TILE) {
+        tile_size = NESTED_LOOP_MIN_TILE;
+    }
+    int num_tasks = (outer_size / tile_size) + (outer_size % tile_size > 0);
+    NestedLoopJoinTask* tasks = calloc(num_tasks + 1, sizeof(NestedLoopJoinTask));
+    for (int t = 0; t < num_tasks; ++t) {
+        tasks[t].outer_values = (int*) (left_is_outer ? join_operator->val1_result : join_operator->val2_result)->payload;
+        tasks[t].outer_positions = left_is_outer ? left_position_vector : right_position_vector;
+        tasks[t].inner_values = (int*) (left_is_outer ? join_operator->val2_result : join_operator->val1_result)->payload;
+        tasks[t].inner_positions = left_is_outer ? right_position_vector : left_position_vector;
+        tasks[t].inner_size = inner_size;
+        tasks[t].inner_block_size = inner_block_size;
+        tasks[t].start = t * tile_size;
+        tasks[t].end = (t + 1) * tile_size < outer_size ? (t + 1) * tile_size : outer_size;
+    }
+    bool join_failed = run_in_threads(nested_loop_join_tile, tasks, sizeof(NestedLoopJoinTask), num_tasks) != 0;
+
+    // concatenate every tile's results, in tile order
+    int num_results = 0;
+    for (int t = 0; t < num_tasks; ++t) {
+        num_results += tasks[t].num_results;
+    }
+    int* left_result_vector = malloc(sizeof(int) * (num_results + 1));
+    int* right_result_vector = malloc(sizeof(int) * (num_results + 1));
+    int result_idx = 0;
+    for (int t = 0; t < num_tasks; ++t) {
+        memcpy((left_is_outer ? left_result_vector : right_result_vector) + result_idx,
+            tasks[t].outer_results, sizeof(int) * tasks[t].num_results);
+        memcpy((left_is_outer ? right_result_vector : left_result_vector) + result_idx,
+            tasks[t].inner_results, sizeof(int) * tasks[t].num_results);
+        result_idx += tasks[t].num_results;
+        free(tasks[t].outer_results);
+        free(tasks[t].inner_results);
+    }
+    free(tasks);
 
     // free things
     // position vectors
-    free(to_iterate_pos_vec);
-    free(hold_in_place_pos_vec);
+    free_join_positions(&left_positions);
+    free_join_positions(&right_positions);
+
+    if (join_failed) {
+        free(left_result_vector);
+        free(right_result_vector);
+        const char* result_message = "nested join failed to run its threads";
+        char* result_message_ptr = malloc(strlen(result_message) + 1);
+        strcpy(result_message_ptr, result_message);
+        send_message->payload = result_message_ptr;
+        send_message->status = EXECUTION_ERROR;
+        return;
+    }
+
+    // copy results into client context
+    add_join_results_to_context(query, left_result_vector, right_result_vector, num_results);
 
     const char* result_message = "nested join successful";
     char* result_message_ptr = malloc(strlen(result_message) + 1);
@@ -197,139 +458,484 @@ void db_join_nested_loop(DbOperator* query, message* send_message) {
 }
 
 /* 
- * this function given a value and a number of partition buckets, returns the
- * proper bucket for that value
- */
-int get_partition_bucket(int value, int num_buckets) {
-    // the bucket we select is going to be based on the final x digits of the value
-    // first figure out how many digits we're going to use based on the number of buckets
-    int start_val = 1;
-    int num_digits = 0;
-    while (start_val < num_buckets) {
-        start_val *= 2;
-        ++num_digits;
-    }
-    // should only choose power of 2 num_buckets for simplicity
-    assert(start_val = num_buckets);
-    // now create our mask, only use the first num_digits digits
-    // this creates a mask like 0000011111, where there are num_buckets ones
-    int mask = (1 << num_digits) - 1;
-    int bucket_number = value & mask;
-    return bucket_number;
-}
-
-/* 
- * this function generates partitions from two columns so that we can
- * perform a more cache-conscious join
- */
-PartitionSet* generate_partitions(
-    int* left_value_vector, int* left_position_vector, int left_size,
-    int* right_value_vector, int* right_position_vector, int right_size,
-    int num_partitions) {
-    // object to return
-    PartitionSet* partition_set = malloc(sizeof(PartitionSet) * num_partitions);
-    // initialize each PartitionSet to have 0 left and right entries
-    for (int i = 0; i < num_partitions; ++i) {
-        PartitionSet* current_partition = partition_set + i;
-        current_partition->num_entries_left_partition = 0; // currently no entries
-        current_partition->left_partition_size = STARTING_RESULT_CAPACITY; // size of the left arrays
-        current_partition->left_partition_values = malloc(sizeof(int) * current_partition->left_partition_size); // allocate space for the values
-        current_partition->left_partition_positions = malloc(sizeof(int) * current_partition->left_partition_size); // allocate space for the positions
-        // all the same for the right
-        current_partition->num_entries_right_partition = 0;
-        current_partition->right_partition_size = STARTING_RESULT_CAPACITY;
-        current_partition->right_partition_values = malloc(sizeof(int) * current_partition->right_partition_size);
-        current_partition->right_partition_positions = malloc(sizeof(int) * current_partition->right_partition_size);
-    }
-    // now iterate through the left input column, partitioning as we go
-    for (int i = 0; i < left_size; ++i) {
-        int current_val = left_value_vector[i];
-        int current_pos = left_position_vector[i];
-        // get the bucket for this value
-        int bucket = get_partition_bucket(current_val, NUM_PARTITIONS);
-        assert(bucket < NUM_PARTITIONS);
-        // get that partition
-        PartitionSet* this_partition = partition_set + bucket;
-        // now add this value and position to the left portion of that partition
-        this_partition->left_partition_values[this_partition->num_entries_left_partition] = current_val;
-        // increment the number of entries on this one
-        this_partition->left_partition_positions[this_partition->num_entries_left_partition++] = current_pos;
-        // resize the left partition if necessary
-        if (this_partition->num_entries_left_partition == this_partition->left_partition_size) {
-            int old_size = this_partition->left_partition_size;
-            this_partition->left_partition_values = resize_data(this_partition->left_partition_values, &old_size);
-            // note we pass left_partition_size here, it's because this
-            // function resizes that parameter, and we want that to happen, but
-            // not until we've had a chance to resize both the values and positions vectors
-            this_partition->left_partition_positions = resize_data(this_partition->left_partition_positions, &this_partition->left_partition_size);
-        }
-    }
-
-    // now iterate through the right input column, partitioning as we go
-    for (int i = 0; i < right_size; ++i) {
-        int current_val = right_value_vector[i];
-        int current_pos = right_position_vector[i];
-        // get the bucket for this value
-        int bucket = get_partition_bucket(current_val, NUM_PARTITIONS);
-        assert(bucket < NUM_PARTITIONS);
-        // get that partition
-        PartitionSet* this_partition = partition_set + bucket;
-        // now add this value and position to the right portion of that partition
-        this_partition->right_partition_values[this_partition->num_entries_right_partition] = current_val;
-        // increment the number of entries on this one
-        this_partition->right_partition_positions[this_partition->num_entries_right_partition++] = current_pos;
-        // resize the right partition if necessary
-        if (this_partition->num_entries_right_partition == this_partition->right_partition_size) {
-            int old_size = this_partition->right_partition_size;
-            this_partition->right_partition_values = resize_data(this_partition->right_partition_values, &old_size);
-            // note we pass right_partition_size here, it's because this
-            // function resizes that parameter, and we want that to happen, but
-            // not until we've had a chance to resize both the values and positions vectors
-            this_partition->right_partition_positions = resize_data(this_partition->right_partition_positions, &this_partition->right_partition_size);
-        }
-    }
-    // split the data up based on the final digits in the values
-    return partition_set;
-}
-
-/* 
- * this function frees an array of partition sets
- */
-void free_partition_sets(PartitionSet* partition_set, int num_partitions) {
-    for (int i = 0; i < num_partitions; ++i) {
-        // free things in this partition
-        PartitionSet* current_partition = partition_set + i;
-        free(current_partition->left_partition_values);
-        free(current_partition->left_partition_positions);
-        free(current_partition->right_partition_values);
-        free(current_partition->right_partition_positions);
-    }
-    // free the partitions array
-    free(partition_set);
-    return;
+ * this function picks how many partitioning passes a radix join makes, and
+ * on how many bits, so that each partition's hash table over the build side
+ * fits in L2 and each pass writes to few enough partitions to stay within
+ * the L1 cache and TLB. it makes at least min_partitions partitions if it
+ * can, so there's enough of them to go around the threads
+ */
+void plan_radix_join(int build_size, int min_partitions, RadixJoinPlan* plan) {
+    // each partition a pass writes to needs a page in the TLB and a line in
+    // L1 for both its values and its positions
+    int max_pass_partitions = (int) (cache_size(1) / (2 * CACHE_LINE_SIZE));
+    if (max_pass_partitions > RADIX_TLB_ENTRIES) {
+        max_pass_partitions = RADIX_TLB_ENTRIES;
+    }
+    int max_pass_bits = 0;
+    while ((2 << max_pass_bits) <= max_pass_partitions) {
+        ++max_pass_bits;
+    }
+    // the build side's hash table, at its load ratio, over the L2 size
+    long table_bytes = (long) ((double) build_size * sizeof(joinTableEntry) / JOIN_TABLE_RATIO);
+    int total_bits = 0;
+    while (((table_bytes >> total_bits) > cache_size(2) || (1 << total_bits) < min_partitions) &&
+           total_bits < RADIX_MAX_PASSES * max_pass_bits) {
+        ++total_bits;
+    }
+    // spread the bits evenly over as few passes as will do
+    plan->num_passes = (total_bits + max_pass_bits - 1) / max_pass_bits;
+    plan->total_bits = total_bits;
+    for (int i = 0; i < plan->num_passes; ++i) {
+        plan->pass_bits[i] = (total_bits / plan->num_passes) + (i < total_bits % plan->num_passes);
+    }
+    log_info("radix join: %d bits over %d passes\n", total_bits, plan->num_passes);
 }
 
 /* 
- * this function inserts join data into the left and right results, 
- * keeping data in the join in the order of left column (which is arbitryary)
- * this requires shifting data in both columns
+ * this function counts where each tuple in a task's slice goes, leaving out
+ * any its filter rules out
  */
-void insert_to_result_and_maintain_order(int* left_result_column, int left_value, int* right_result_column, int right_value, int* num_results) {
-    // keep data in the join in order of left column, requires shifting
-    int correct_position = find_int_record_position(left_result_column, *num_results, left_value);
-    // shift up from correct_position (both result arrays)
-    shift_int_data_up(left_result_column, *num_results, correct_position, 1);
-    shift_int_data_up(right_result_column, *num_results, correct_position, 1);
-    // then add this value
-    left_result_column[correct_position] = left_value;
-    right_result_column[correct_position] = right_value;
-    // increment number of results
-    ++(*num_results);
-    return;
+void* radix_partition_histogram(void* task_void) {
+    RadixPartitionTask* task = (RadixPartitionTask*) task_void;
+    memset(task->histogram, 0, sizeof(task->histogram));
+    for (int i = task->start; i < task->end; ++i) {
+        if (task->filter != NULL && !bloom_contains(task->filter, task->values_in[i])) {
+            continue;
+        }
+        task->histogram[(multiplicative_hash(task->values_in[i]) >> task->shift) & (task->fanout - 1)]++;
+    }
+    return NULL;
+}
+
+/* 
+ * this function scatters a task's slice to the offsets in its histogram.
+ * positions still in a bitvector are decoded a batch at a time as the
+ * values they go with are scattered
+ */
+void* radix_partition_scatter(void* task_void) {
+    RadixPartitionTask* task = (RadixPartitionTask*) task_void;
+    if (task->positions_in == NULL) {
+        // the slice's first value goes with the start'th set bit
+        int position_batch[JOIN_POSITION_BATCH_SIZE];
+        int bv_idx;
+        unsigned int current_bits;
+        seek_bitvector_positions(task->bitvector_in, task->bitvector_ints, task->start, &bv_idx, &current_bits);
+        for (int i = task->start; i < task->end; i += JOIN_POSITION_BATCH_SIZE) {
+            int batch_size = task->end - i < JOIN_POSITION_BATCH_SIZE ? task->end - i : JOIN_POSITION_BATCH_SIZE;
+            next_bitvector_positions(task->bitvector_in, task->bitvector_ints, &bv_idx, &current_bits,
+                position_batch, batch_size);
+            for (int j = 0; j < batch_size; ++j) {
+                if (task->filter != NULL && !bloom_contains(task->filter, task->values_in[i + j])) {
+                    continue;
+                }
+                int destination = task->histogram[(multiplicative_hash(task->values_in[i + j]) >> task->shift) & (task->fanout - 1)]++;
+                task->values_out[destination] = task->values_in[i + j];
+                task->positions_out[destination] = position_batch[j];
+            }
+        }
+        return NULL;
+    }
+    for (int i = task->start; i < task->end; ++i) {
+        if (task->filter != NULL && !bloom_contains(task->filter, task->values_in[i])) {
+            continue;
+        }
+        int destination = task->histogram[(multiplicative_hash(task->values_in[i]) >> task->shift) & (task->fanout - 1)]++;
+        task->values_out[destination] = task->values_in[i];
+        task->positions_out[destination] = task->positions_in[i];
+    }
+    return NULL;
+}
+
+/* 
+ * this function splits values and their positions into partitions on the
+ * top bits of each value's hash, following plan. each pass counts its
+ * partitions' sizes first, so every tuple is written exactly once per pass.
+ * the first pass splits the input between threads, later passes give each
+ * thread partitions of their own. positions still in a bitvector are decoded
+ * by the first pass as it goes. if filter isn't NULL, the first pass drops
+ * every tuple it rules out. returns 0 on success and -1 on failure
+ */
+int radix_partition(int* values, JoinPositions* positions, int num_values, bloomfilter* filter,
+    RadixJoinPlan* plan, RadixPartitions* partitions) {
+    if (plan->num_passes == 0) {
+        // nothing to scatter, so the positions are needed as they are
+        partitions->values = values;
+        partitions->positions = join_position_vector(positions, num_values);
+        partitions->owns_data = false;
+        if (filter != NULL) {
+            // keep a copy of just what the filter lets through
+            partitions->values = malloc(sizeof(int) * (num_values + 1));
+            partitions->positions = malloc(sizeof(int) * (num_values + 1));
+            partitions->owns_data = true;
+            int num_kept = 0;
+            for (int i = 0; i < num_values; ++i) {
+                if (bloom_contains(filter, values[i])) {
+                    partitions->values[num_kept] = values[i];
+                    partitions->positions[num_kept++] = positions->positions[i];
+                }
+            }
+            num_values = num_kept;
+        }
+        partitions->offsets = malloc(sizeof(int) * 2);
+        partitions->offsets[0] = 0;
+        partitions->offsets[1] = num_values;
+        partitions->num_partitions = 1;
+        return 0;
+    }
+
+    // everything starts in one partition, the input itself
+    int num_partitions = 1;
+    int* offsets = malloc(sizeof(int) * 2);
+    offsets[0] = 0;
+    offsets[1] = num_values;
+    int* values_in = values;
+    int* positions_in = positions->positions;
+    int consumed_bits = 0;
+    int num_threads = num_values / JOIN_MIN_VALUES_PER_THREAD;
+    if (num_threads > worker_pool_threads()) {
+        num_threads = worker_pool_threads();
+    }
+    if (num_threads < 1) {
+        num_threads = 1;
+    }
+
+    for (int pass = 0; pass < plan->num_passes; ++pass) {
+        int fanout = 1 << plan->pass_bits[pass];
+        int shift = 32 - consumed_bits - plan->pass_bits[pass];
+        int* new_offsets = malloc(sizeof(int) * ((num_partitions * fanout) + 1));
+        // the first pass splits the one partition into slices, later passes
+        // split each partition from the last pass on the next bits down
+        int num_slices = pass == 0 ? num_threads : 1;
+        int num_tasks = num_partitions * num_slices;
+        RadixPartitionTask* tasks = malloc(sizeof(RadixPartitionTask) * num_tasks);
+        for (int p = 0; p < num_partitions; ++p) {
+            int partition_size = offsets[p + 1] - offsets[p];
+            for (int t = 0; t < num_slices; ++t) {
+                RadixPartitionTask* task = &(tasks[(p * num_slices) + t]);
+                task->values_in = values_in;
+                task->positions_in = positions_in;
+                task->bitvector_in = positions->bitvector;
+                task->bitvector_ints = positions->bitvector_ints;
+                task->filter = pass == 0 ? filter : NULL;
+                task->start = offsets[p] + (int) (((long) partition_size * t) / num_slices);
+                task->end = offsets[p] + (int) (((long) partition_size * (t + 1)) / num_slices);
+                task->shift = shift;
+                task->fanout = fanout;
+            }
+        }
+        // HISTOGRAM: count where everything goes
+        int failure = run_in_threads(radix_partition_histogram, tasks, sizeof(RadixPartitionTask), num_tasks);
+        // turn the counts into write offsets, slice by slice within each
+        // partition, so partitions stay in hash order
+        int running_offset = 0;
+        for (int p = 0; p < num_partitions; ++p) {
+            for (int d = 0; d < fanout; ++d) {
+                new_offsets[(p * fanout) + d] = running_offset;
+                for (int t = 0; t < num_slices; ++t) {
+                    RadixPartitionTask* task = &(tasks[(p * num_slices) + t]);
+                    int count = task->histogram[d];
+                    task->histogram[d] = running_offset;
+                    running_offset += count;
+                }
+            }
+        }
+        // only as much room as made it past the filter
+        num_values = running_offset;
+        int* values_out = malloc(sizeof(int) * (num_values + 1));
+        int* positions_out = malloc(sizeof(int) * (num_values + 1));
+        for (int t = 0; t < num_tasks; ++t) {
+            tasks[t].values_out = values_out;
+            tasks[t].positions_out = positions_out;
+        }
+        // SCATTER: write each tuple straight to its place
+        if (failure == 0) {
+            failure = run_in_threads(radix_partition_scatter, tasks, sizeof(RadixPartitionTask), num_tasks);
+        }
+        free(tasks);
+        if (failure != 0) {
+            free(values_out);
+            free(positions_out);
+            free(new_offsets);
+            if (pass > 0) {
+                free(values_in);
+                free(positions_in);
+            }
+            free(offsets);
+            return -1;
+        }
+        num_partitions *= fanout;
+        new_offsets[num_partitions] = num_values;
+        // the last pass's output is only needed as this pass's input
+        if (pass > 0) {
+            free(values_in);
+            free(positions_in);
+        }
+        free(offsets);
+        values_in = values_out;
+        positions_in = positions_out;
+        offsets = new_offsets;
+        consumed_bits += plan->pass_bits[pass];
+    }
+
+    partitions->values = values_in;
+    partitions->positions = positions_in;
+    partitions->offsets = offsets;
+    partitions->num_partitions = num_partitions;
+    partitions->owns_data = true;
+    return 0;
+}
+
+/* 
+ * this function frees the partitions made by radix_partition
+ */
+void free_radix_partitions(RadixPartitions* partitions) {
+    if (partitions->owns_data) {
+        free(partitions->values);
+        free(partitions->positions);
+    }
+    free(partitions->offsets);
+}
+
+/* 
+ * this function joins a task's run of partitions, building a hash table on
+ * the smaller side of each and probing it with the larger. skewed partitions
+ * are skipped
+ */
+void* hash_join_partitions(void* task_void) {
+    HashJoinTask* task = (HashJoinTask*) task_void;
+    for (int p = task->first_partition; p < task->end_partition && task->failure == 0; ++p) {
+        if (task->skewed[p]) {
+            continue;
+        }
+        int left_start = task->left->offsets[p];
+        int left_partition_size = task->left->offsets[p + 1] - left_start;
+        int right_start = task->right->offsets[p];
+        int right_partition_size = task->right->offsets[p + 1] - right_start;
+        // skip partition if there are no results on one side
+        if (left_partition_size == 0 || right_partition_size == 0) {
+            continue;
+        }
+        // the probes append (probed position, hashed position) pairs, so
+        // point them at whichever result vectors match that order
+        RadixPartitions* to_hash = task->left;
+        int to_hash_start = left_start;
+        int to_hash_size = left_partition_size;
+        RadixPartitions* to_iterate = task->right;
+        int to_iterate_start = right_start;
+        int to_iterate_size = right_partition_size;
+        int** probe_matches = &(task->right_results);
+        int** build_matches = &(task->left_results);
+        if (left_partition_size > right_partition_size) {
+            to_hash = task->right;
+            to_hash_start = right_start;
+            to_hash_size = right_partition_size;
+            to_iterate = task->left;
+            to_iterate_start = left_start;
+            to_iterate_size = left_partition_size;
+            probe_matches = &(task->left_results);
+            build_matches = &(task->right_results);
+        }
+
+        // bulk build a table over the smaller side, value is the key,
+        // position is the value. every key in it shares the partition bits
+        jointable* jt;
+        if (join_allocate(&jt, to_hash_size, task->skip_bits) != 0) {
+            task->failure = -1;
+            break;
+        }
+        if (join_build(jt, to_hash->values + to_hash_start, to_hash->positions + to_hash_start, to_hash_size) != 0 ||
+            join_probe_batch(jt, to_iterate->values + to_iterate_start, to_iterate->positions + to_iterate_start,
+                to_iterate_size, probe_matches, build_matches, &(task->result_capacity), &(task->num_results)) != 0) {
+            task->failure = -1;
+        }
+        join_deallocate(jt);
+    }
+    return NULL;
 }
 
 /* 
- * this function handles a join using a hash join algorithm
+ * this function probes a task's slice of a partition against the shared
+ * table built over the partition's other side
+ */
+void* hash_join_probe_slice(void* task_void) {
+    HashJoinProbeTask* task = (HashJoinProbeTask*) task_void;
+    int** probe_matches = task->probe_is_left ? &(task->left_results) : &(task->right_results);
+    int** build_matches = task->probe_is_left ? &(task->right_results) : &(task->left_results);
+    if (join_probe_batch(task->table, task->probe_values, task->probe_positions, task->num_probes,
+            probe_matches, build_matches, &(task->result_capacity), &(task->num_results)) != 0) {
+        task->failure = -1;
+    }
+    return NULL;
+}
+
+/* 
+ * splits [start, end) of one side of a partition on bits more hash bits
+ * below shift, into new arrays with sub-partition s at [offsets[s],
+ * offsets[s + 1])
+ */
+static void split_partition(RadixPartitions* partitions, int start, int end, int shift, int bits,
+    int** values_out, int** positions_out, int* offsets) {
+    RadixPartitionTask split;
+    memset(&split, 0, sizeof(RadixPartitionTask));
+    split.values_in = partitions->values;
+    split.positions_in = partitions->positions;
+    split.start = start;
+    split.end = end;
+    split.shift = shift;
+    split.fanout = 1 << bits;
+    *values_out = malloc(sizeof(int) * (end - start + 1));
+    *positions_out = malloc(sizeof(int) * (end - start + 1));
+    split.values_out = *values_out;
+    split.positions_out = *positions_out;
+    radix_partition_histogram(&split);
+    int running_offset = 0;
+    for (int d = 0; d < split.fanout; ++d) {
+        offsets[d] = running_offset;
+        running_offset += split.histogram[d];
+        split.histogram[d] = offsets[d];
+    }
+    offsets[split.fanout] = running_offset;
+    radix_partition_scatter(&split);
+}
+
+/* 
+ * joins one partition far bigger than the rest, which is nearly always down
+ * to a few heavy keys. its smaller side is split further on the next hash
+ * bits until each piece's table fits in L2 (a heavy key's duplicates take a
+ * single slot, so they don't count against it). each table is built once
+ * and shared, while the larger side is probed in slices over the worker
+ * pool. the slices, results and all, are appended to probe_tasks. returns 0
+ * on success and -1 on failure
+ */
+static int hash_join_skewed_partition(RadixPartitions* left, RadixPartitions* right, int partition, int skip_bits,
+    HashJoinProbeTask** probe_tasks, int* num_probe_tasks, int* probe_task_capacity) {
+    int left_start = left->offsets[partition];
+    int left_size = left->offsets[partition + 1] - left_start;
+    int right_start = right->offsets[partition];
+    int right_size = right->offsets[partition + 1] - right_start;
+    if (left_size == 0 || right_size == 0) {
+        return 0;
+    }
+    bool probe_is_left = left_size > right_size;
+    RadixPartitions* build = probe_is_left ? right : left;
+    int build_start = probe_is_left ? right_start : left_start;
+    int build_size = probe_is_left ? right_size : left_size;
+    RadixPartitions* probe = probe_is_left ? left : right;
+    int probe_start = probe_is_left ? left_start : right_start;
+    int probe_size = probe_is_left ? left_size : right_size;
+    log_info("skewed partition %d: %d build and %d probe values\n", partition, build_size, probe_size);
+
+    // split further, as far as one pass can without thrashing the TLB
+    int split_bits = 0;
+    long table_bytes = (long) ((double) build_size * sizeof(joinTableEntry) / JOIN_TABLE_RATIO);
+    while ((table_bytes >> split_bits) > cache_size(2) && (2 << split_bits) <= RADIX_TLB_ENTRIES &&
+           skip_bits + split_bits < 32) {
+        ++split_bits;
+    }
+    int num_splits = 1 << split_bits;
+    int build_offsets[RADIX_TLB_ENTRIES + 1] = { 0, build_size };
+    int probe_offsets[RADIX_TLB_ENTRIES + 1] = { 0, probe_size };
+    int* build_values = build->values + build_start;
+    int* build_positions = build->positions + build_start;
+    int* probe_values = probe->values + probe_start;
+    int* probe_positions = probe->positions + probe_start;
+    if (split_bits > 0) {
+        int shift = 32 - skip_bits - split_bits;
+        split_partition(build, build_start, build_start + build_size, shift, split_bits,
+            &build_values, &build_positions, build_offsets);
+        split_partition(probe, probe_start, probe_start + probe_size, shift, split_bits,
+            &probe_values, &probe_positions, probe_offsets);
+    }
+
+    int failure = 0;
+    for (int s = 0; s < num_splits && failure == 0; ++s) {
+        int split_build_size = build_offsets[s + 1] - build_offsets[s];
+        int split_probe_size = probe_offsets[s + 1] - probe_offsets[s];
+        if (split_build_size == 0 || split_probe_size == 0) {
+            continue;
+        }
+        jointable* jt;
+        if (join_allocate(&jt, split_build_size, skip_bits + split_bits) != 0) {
+            failure = -1;
+            break;
+        }
+        if (join_build(jt, build_values + build_offsets[s], build_positions + build_offsets[s], split_build_size) != 0) {
+            join_deallocate(jt);
+            failure = -1;
+            break;
+        }
+        // BROADCAST: every slice of the larger side probes the same table
+        int num_slices = split_probe_size / JOIN_MIN_PROBE_SLICE;
+        if (num_slices > worker_pool_threads() * JOIN_TASKS_PER_THREAD) {
+            num_slices = worker_pool_threads() * JOIN_TASKS_PER_THREAD;
+        }
+        if (num_slices < 1) {
+            num_slices = 1;
+        }
+        // double size if necessary before appending
+        while (*num_probe_tasks + num_slices > *probe_task_capacity) {
+            *probe_task_capacity = *probe_task_capacity == 0 ? num_slices : 2 * *probe_task_capacity;
+            *probe_tasks = realloc(*probe_tasks, sizeof(HashJoinProbeTask) * *probe_task_capacity);
+        }
+        HashJoinProbeTask* slices = *probe_tasks + *num_probe_tasks;
+        memset(slices, 0, sizeof(HashJoinProbeTask) * num_slices);
+        for (int t = 0; t < num_slices; ++t) {
+            int slice_start = probe_offsets[s] + (int) (((long) split_probe_size * t) / num_slices);
+            int slice_end = probe_offsets[s] + (int) (((long) split_probe_size * (t + 1)) / num_slices);
+            slices[t].table = jt;
+            slices[t].probe_values = probe_values + slice_start;
+            slices[t].probe_positions = probe_positions + slice_start;
+            slices[t].num_probes = slice_end - slice_start;
+            slices[t].probe_is_left = probe_is_left;
+        }
+        *num_probe_tasks += num_slices;
+        failure = run_in_threads(hash_join_probe_slice, slices, sizeof(HashJoinProbeTask), num_slices);
+        for (int t = 0; t < num_slices; ++t) {
+            failure = failure != 0 ? failure : slices[t].failure;
+        }
+        join_deallocate(jt);
+    }
+
+    if (split_bits > 0) {
+        free(build_values);
+        free(build_positions);
+        free(probe_values);
+        free(probe_positions);
+    }
+    return failure;
+}
+
+/* 
+ * builds a bloom filter over a hash join's smaller side, if it rules out
+ * enough of an even sample of the larger side to pay for checking every
+ * value. returns NULL if it doesn't
+ */
+static bloomfilter* hash_join_semi_join_filter(int* build_values, int build_size, int* probe_values, int probe_size) {
+    if (probe_size < JOIN_BLOOM_MIN_PROBE_SIZE) {
+        return NULL;
+    }
+    bloomfilter* filter;
+    if (bloom_allocate(&filter, build_size) != 0) {
+        return NULL;
+    }
+    bloom_insert_batch(filter, build_values, build_size);
+    int num_samples = probe_size < JOIN_BLOOM_SAMPLE_SIZE ? probe_size : JOIN_BLOOM_SAMPLE_SIZE;
+    int num_passed = 0;
+    for (int i = 0; i < num_samples; ++i) {
+        num_passed += bloom_contains(filter, probe_values[(int) (((long) probe_size * i) / num_samples)]);
+    }
+    log_info("bloom filter lets through %d of %d sampled values\n", num_passed, num_samples);
+    if (num_passed > num_samples * JOIN_BLOOM_MAX_PASS_RATE) {
+        bloom_deallocate(filter);
+        return NULL;
+    }
+    return filter;
+}
+
+/* 
+ * this function handles a join using a hash join algorithm. when most of the
+ * larger side can't match, a bloom filter over the smaller side drops those
+ * values while the larger side is partitioned
  */
 void db_join_hash(DbOperator* query, message* send_message) {
     log_info("db_join_hash\n");
@@ -339,14 +945,16 @@ void db_join_hash(DbOperator* query, message* send_message) {
     // value information
     int* left_value_vector = (int*) query->operator_fields.join_operator.val1_result->payload;
     int* right_value_vector = (int*) query->operator_fields.join_operator.val2_result->payload;
-    // positional information: need position vectors from the position bitvectors
-    int* left_position_vector = pos_vector_from_bv((int*) query->operator_fields.join_operator.pos1_result->payload, query->operator_fields.join_operator.pos1_result->bitvector_ints);
-    int* right_position_vector = pos_vector_from_bv((int*) query->operator_fields.join_operator.pos2_result->payload, query->operator_fields.join_operator.pos2_result->bitvector_ints);
+    // positional information: bitvectors are decoded while partitioning
+    JoinPositions left_positions;
+    JoinPositions right_positions;
+    join_positions_from_result(query->operator_fields.join_operator.pos1_result, &left_positions);
+    join_positions_from_result(query->operator_fields.join_operator.pos2_result, &right_positions);
     // eventual results
-    int result_arr_size = STARTING_RESULT_CAPACITY;
-    int* left_result_vector = malloc(sizeof(int) * result_arr_size);
-    int* right_result_vector = malloc(sizeof(int) * result_arr_size);
+    int* left_result_vector = NULL;
+    int* right_result_vector = NULL;
     int num_results = 0;
+    bool join_failed = false;
 
     bool empty_join = false;
     // we might not have to do any work if it's a join on nothing
@@ -355,181 +963,152 @@ void db_join_hash(DbOperator* query, message* send_message) {
     }
 
     if (!empty_join) {
-        // TODO: recursively partition until we get the optimal size for the partitions?
-        // partition prior to hashing and joining
-        PartitionSet* partitions = generate_partitions(
-            left_value_vector, left_position_vector, left_size,
-            right_value_vector, right_position_vector, right_size,
-            NUM_PARTITIONS);
-
-        // grace hash join: partition and hash smaller partition, probe from larger partition
-        // now perform a join on all of our partitions
-        for (int p = 0; p < NUM_PARTITIONS; ++p) {
-            PartitionSet* current_partition = partitions + p;
-            // skip partition if there are no results on one side
-            if (current_partition->num_entries_left_partition == 0 || current_partition->num_entries_right_partition == 0) {
-                continue;
+        // partition both sides the same way, sized for the side we'll mostly
+        // be hashing. big joins get enough partitions to keep every thread busy
+        int num_threads = worker_pool_threads();
+        int min_partitions = 1;
+        if (left_size + right_size >= 2 * JOIN_MIN_VALUES_PER_THREAD) {
+            min_partitions = num_threads * JOIN_TASKS_PER_THREAD;
+        }
+        RadixJoinPlan plan;
+        plan_radix_join(left_size < right_size ? left_size : right_size, min_partitions, &plan);
+        // semi join the larger side against the smaller before partitioning it
+        bool left_is_build = left_size < right_size;
+        bloomfilter* filter = left_is_build ?
+            hash_join_semi_join_filter(left_value_vector, left_size, right_value_vector, right_size) :
+            hash_join_semi_join_filter(right_value_vector, right_size, left_value_vector, left_size);
+        RadixPartitions left_partitions;
+        RadixPartitions right_partitions;
+        if (radix_partition(left_value_vector, &left_positions, left_size, left_is_build ? NULL : filter,
+                &plan, &left_partitions) != 0) {
+            join_failed = true;
+        } else if (radix_partition(right_value_vector, &right_positions, right_size, left_is_build ? filter : NULL,
+                &plan, &right_partitions) != 0) {
+            free_radix_partitions(&left_partitions);
+            join_failed = true;
+        }
+        if (filter != NULL) {
+            bloom_deallocate(filter);
+        }
+
+        if (!join_failed) {
+            // SKEW: a partition many times the average size is down to heavy
+            // keys, and would leave one thread working long after the rest.
+            // it's left out of the runs and joined on its own
+            int num_partitions = left_partitions.num_partitions;
+            bool* skewed = calloc(num_partitions, sizeof(bool));
+            long skew_threshold = JOIN_SKEW_FACTOR * ((long) left_partitions.offsets[num_partitions] +
+                right_partitions.offsets[num_partitions]) / num_partitions;
+            if (skew_threshold < JOIN_MIN_VALUES_PER_THREAD) {
+                skew_threshold = JOIN_MIN_VALUES_PER_THREAD;
             }
-            // organize the data stuctures for this partition
-            int left_partition_size = current_partition->num_entries_left_partition;
-            int right_partition_size = current_partition->num_entries_right_partition;
-            // intermediate results for working
-            int* to_iterate_value_vector = NULL;
-            int* to_hash_value_vector = NULL;
-            // need positional information
-            int* to_iterate_pos_vector = NULL;
-            int* to_hash_pos_vector = NULL;
-            // need number of tuples
-            int to_iterate_size;
-            int to_hash_size;
-
-            // assign to_iterate/to_hash based on partition column sizes
-            if (left_partition_size > right_partition_size) {
-                // partition specific stuff
-                to_iterate_value_vector = current_partition->left_partition_values;
-                to_iterate_pos_vector = current_partition->left_partition_positions;
-                to_iterate_size = left_partition_size;
-                to_hash_value_vector = current_partition->right_partition_values;
-                to_hash_pos_vector = current_partition->right_partition_positions;
-                to_hash_size = right_partition_size;
-            } else {
-                // partition specific stuff
-                to_iterate_value_vector = current_partition->right_partition_values;
-                to_iterate_pos_vector = current_partition->right_partition_positions;
-                to_iterate_size = right_partition_size;
-                to_hash_value_vector = current_partition->left_partition_values;
-                to_hash_pos_vector = current_partition->left_partition_positions;
-                to_hash_size = left_partition_size;
+            for (int p = 0; p < num_partitions; ++p) {
+                skewed[p] = (long) (left_partitions.offsets[p + 1] - left_partitions.offsets[p]) +
+                    (right_partitions.offsets[p + 1] - right_partitions.offsets[p]) > skew_threshold;
             }
 
-            // hash the smaller column
-            hashtable* ht;
-            allocate(&ht, to_hash_size);
-            for (int i = 0; i < to_hash_size; ++i) {
-                // hash every value
-                // value is the key, position is the value
-                put(ht, to_hash_value_vector[i], to_hash_pos_vector[i]);
+            // grace hash join: the partitions are independent, so hand runs of
+            // them out to the worker pool, each task keeping its own results
+            int num_tasks = num_threads * JOIN_TASKS_PER_THREAD;
+            if (num_tasks > num_partitions) {
+                num_tasks = num_partitions;
+            }
+            HashJoinTask* tasks = calloc(num_tasks, sizeof(HashJoinTask));
+            for (int t = 0; t < num_tasks; ++t) {
+                tasks[t].left = &left_partitions;
+                tasks[t].right = &right_partitions;
+                tasks[t].skip_bits = plan.total_bits;
+                tasks[t].first_partition = (int) (((long) num_partitions * t) / num_tasks);
+                tasks[t].end_partition = (int) (((long) num_partitions * (t + 1)) / num_tasks);
+                tasks[t].skewed = skewed;
             }
+            join_failed = run_in_threads(hash_join_partitions, tasks, sizeof(HashJoinTask), num_tasks) != 0;
 
-            // iterate over the larger column, probe into the smaller
-            for (int i = 0; i < to_iterate_size; ++i) {
-                int probe_value = to_iterate_value_vector[i];
-                int num_results_in_ht;
-                int hashed_position;
-                int* hashed_position_arr = NULL;
-                int result = get(ht, probe_value, &hashed_position, 1, &num_results_in_ht);
-                if (result == 0) {
-                    // success
-                    if (num_results_in_ht == 1) {
-                        // success, found one result
-                        // add this to our results arrays, get left and right result values
-                        int left_value, right_value;
-                        if (left_partition_size > right_partition_size) {
-                            left_value = to_iterate_pos_vector[i]; // need the probed position
-                            right_value = hashed_position;
-                        } else {
-                            left_value = hashed_position;
-                            right_value = to_iterate_pos_vector[i]; // need the probed position
-                        }
-                        // insert while maintaining order, also increments num_results
-                        insert_to_result_and_maintain_order(left_result_vector, left_value, right_result_vector, right_value, &num_results);
-                        // resize results array if necessary
-                        if (num_results == result_arr_size) {
-                            int old_size = result_arr_size;
-                            left_result_vector = resize_data(left_result_vector, &old_size);
-                            // note we pass result_arr_size here, it's because this
-                            // function resizes that parameter
-                            right_result_vector = resize_data(right_result_vector, &result_arr_size);
-                        }
-                    } else if (num_results_in_ht > 1) {
-                        // need to use an array for this
-                        hashed_position_arr = malloc(sizeof(int) * num_results_in_ht);
-                        // get the results again
-                        int second_result = get(ht, probe_value, hashed_position_arr, num_results_in_ht, &num_results_in_ht);
-                        assert(second_result == 0);
-                        // now add all of these values
-                        for (int j = 0; j < num_results_in_ht; ++j) {
-                            // add this to our results arrays, get left and right result values
-                            int left_value, right_value;
-                            if (left_partition_size > right_partition_size) {
-                                left_value = to_iterate_pos_vector[i]; // need the probed position
-                                right_value = hashed_position_arr[j];
-                            } else {
-                                left_value = hashed_position_arr[j];
-                                right_value = to_iterate_pos_vector[i]; // need the probed position
-                            }
-                            // insert while maintaining order, also increments num_results
-                            insert_to_result_and_maintain_order(left_result_vector, left_value, right_result_vector, right_value, &num_results);
-                            // resize results array if necessary
-                            if (num_results == result_arr_size) {
-                                int old_size = result_arr_size;
-                                left_result_vector = resize_data(left_result_vector, &old_size);
-                                // note we pass result_arr_size here, it's because this
-                                // function resizes that parameter
-                                right_result_vector = resize_data(right_result_vector, &result_arr_size);
-                            }
-                        }
-                    } else {
-                        log_info("found no matches in the hash table\n");
-                    }
-                } else {
-                    // error
-                    log_err("HASH TABLE ERROR\n");
-                    abort();
+            // then each skewed partition, with every thread probing it
+            HashJoinProbeTask* probe_tasks = NULL;
+            int num_probe_tasks = 0;
+            int probe_task_capacity = 0;
+            for (int p = 0; p < num_partitions && !join_failed; ++p) {
+                if (skewed[p]) {
+                    join_failed = hash_join_skewed_partition(&left_partitions, &right_partitions, p, plan.total_bits,
+                        &probe_tasks, &num_probe_tasks, &probe_task_capacity) != 0;
                 }
-                // free the hashed_position_arr (we may or may not have used it)
-                free(hashed_position_arr);
             }
-            // free the hashtable
-            deallocate(ht);
+            free(skewed);
+
+            // concatenate every task's results
+            for (int t = 0; t < num_tasks; ++t) {
+                join_failed = join_failed || tasks[t].failure != 0;
+                num_results += tasks[t].num_results;
+            }
+            for (int t = 0; t < num_probe_tasks; ++t) {
+                num_results += probe_tasks[t].num_results;
+            }
+            left_result_vector = malloc(sizeof(int) * (num_results + 1));
+            right_result_vector = malloc(sizeof(int) * (num_results + 1));
+            int result_idx = 0;
+            for (int t = 0; t < num_tasks; ++t) {
+                memcpy(left_result_vector + result_idx, tasks[t].left_results, sizeof(int) * tasks[t].num_results);
+                memcpy(right_result_vector + result_idx, tasks[t].right_results, sizeof(int) * tasks[t].num_results);
+                result_idx += tasks[t].num_results;
+                free(tasks[t].left_results);
+                free(tasks[t].right_results);
+            }
+            for (int t = 0; t < num_probe_tasks; ++t) {
+                memcpy(left_result_vector + result_idx, probe_tasks[t].left_results, sizeof(int) * probe_tasks[t].num_results);
+                memcpy(right_result_vector + result_idx, probe_tasks[t].right_results, sizeof(int) * probe_tasks[t].num_results);
+                result_idx += probe_tasks[t].num_results;
+                free(probe_tasks[t].left_results);
+                free(probe_tasks[t].right_results);
+            }
+            free(tasks);
+            free(probe_tasks);
+
+            // finished with joining, free the partition data structures
+            free_radix_partitions(&left_partitions);
+            free_radix_partitions(&right_partitions);
         }
 
-        // finished with joining, free the partition data structures
-        free_partition_sets(partitions, NUM_PARTITIONS);
+        // partitions come out in hash order, hand results back in the order
+        // of the left positions. the sort is stable, so matches for the same
+        // left position keep the order they were probed in. bitvectors have
+        // no order to restore
+        if (!join_failed && !query->operator_fields.join_operator.bitvector_output) {
+            int* sorted_left = malloc(sizeof(int) * (num_results + 1));
+            int* sorted_order = malloc(sizeof(int) * (num_results + 1));
+            int* sorted_right = malloc(sizeof(int) * (num_results + 1));
+            join_failed = radix_sort(left_result_vector, num_results, sorted_left, sorted_order) != 0;
+            for (int i = 0; i < num_results && !join_failed; ++i) {
+                sorted_right[i] = right_result_vector[sorted_order[i]];
+            }
+            free(sorted_order);
+            free(left_result_vector);
+            free(right_result_vector);
+            left_result_vector = sorted_left;
+            right_result_vector = sorted_right;
+        }
+    } else {
+        left_result_vector = malloc(sizeof(int));
+        right_result_vector = malloc(sizeof(int));
     }
 
     // free position vectors
-    free(left_position_vector);
-    free(right_position_vector);
+    free_join_positions(&left_positions);
+    free_join_positions(&right_positions);
+
+    if (join_failed) {
+        free(left_result_vector);
+        free(right_result_vector);
+        const char* result_message = "hash join failed to run its threads";
+        char* result_message_ptr = malloc(strlen(result_message) + 1);
+        strcpy(result_message_ptr, result_message);
+        send_message->payload = result_message_ptr;
+        send_message->status = EXECUTION_ERROR;
+        return;
+    }
 
     // copy results into client context
-    // create the left result object
-    Result* left_result_obj = malloc(sizeof(Result));
-    // no tuples in this result object
-    left_result_obj->num_tuples = num_results;
-    left_result_obj->payload = left_result_vector;
-    left_result_obj->data_type = INT;
-    left_result_obj->bitvector_ints = -1; // no bitvector ints, result is not a bitvector
-    left_result_obj->is_posn_vector = true; // need to specify, because usually we use bitvectors
-    // wrap the result object appropriately
-    GeneralizedColumnHandle left_generalized_result_handle;
-    // add name to result wrapper
-    strcpy(left_generalized_result_handle.name, query->operator_fields.join_operator.left_handle);
-    // update type
-    left_generalized_result_handle.generalized_column.column_type = RESULT;
-    // add the result
-    left_generalized_result_handle.generalized_column.column_pointer.result = left_result_obj;
-    // add this value to the client context variable pool
-    add_to_client_context(query->context, left_generalized_result_handle);
-
-    // create the right result object
-    Result* right_result_obj = malloc(sizeof(Result));
-    // no tuples in this result object
-    right_result_obj->num_tuples = num_results;
-    right_result_obj->payload = right_result_vector;
-    right_result_obj->data_type = INT;
-    right_result_obj->bitvector_ints = -1; // no bitvector ints, result is not a bitvector
-    right_result_obj->is_posn_vector = true; // need to specify, because usually we use bitvectors
-    // wrap the result object appropriately
-    GeneralizedColumnHandle right_generalized_result_handle;
-    // add name to result wrapper
-    strcpy(right_generalized_result_handle.name, query->operator_fields.join_operator.right_handle);
-    // update type
-    right_generalized_result_handle.generalized_column.column_type = RESULT;
-    // add the result
-    right_generalized_result_handle.generalized_column.column_pointer.result = right_result_obj;
-    // add this value to the client context variable pool
-    add_to_client_context(query->context, right_generalized_result_handle);
+    add_join_results_to_context(query, left_result_vector, right_result_vector, num_results);
 
     const char* result_message = "hash join successful";
     char* result_message_ptr = malloc(strlen(result_message) + 1);
@@ -539,3 +1118,787 @@ void db_join_hash(DbOperator* query, message* send_message) {
 
     return;
 }
+
+/* 
+ * this function gets one side of a join into value order, along with the
+ * position that goes with each value. values that are already in order
+ * (e.g. fetched off a clustered sorted column) are used as they are, and
+ * *sorted_copy is left false. returns 0 on success and -1 on failure
+ */
+int sort_join_input(int* values, int* positions, int num_values,
+    int** sorted_values, int** sorted_positions, bool* sorted_copy) {
+    // one pass to see if there's anything to sort
+    int i = 1;
+    while (i < num_values && values[i - 1] <= values[i]) {
+        ++i;
+    }
+    if (i >= num_values) {
+        log_info("join input already sorted, skipping the sort\n");
+        *sorted_values = values;
+        *sorted_positions = positions;
+        *sorted_copy = false;
+        return 0;
+    }
+
+    // the radix sort hands back where each sorted value came from, which is
+    // where to find its position
+    *sorted_values = malloc(sizeof(int) * (num_values + 1));
+    *sorted_positions = malloc(sizeof(int) * (num_values + 1));
+    int* order = malloc(sizeof(int) * (num_values + 1));
+    if (radix_sort(values, num_values, *sorted_values, order) != 0) {
+        free(*sorted_values);
+        free(*sorted_positions);
+        free(order);
+        return -1;
+    }
+    for (int j = 0; j < num_values; ++j) {
+        (*sorted_positions)[j] = positions[order[j]];
+    }
+    free(order);
+    *sorted_copy = true;
+    return 0;
+}
+
+/* 
+ * this function handles a join by sorting both sides (unless they already
+ * are) and merging them. results come back in value order
+ */
+void db_join_sort_merge(DbOperator* query, message* send_message) {
+    log_info("db_join_sort_merge\n");
+    int left_size = query->operator_fields.join_operator.val1_result->num_tuples;
+    int right_size = query->operator_fields.join_operator.val2_result->num_tuples;
+    // value information
+    int* left_value_vector = (int*) query->operator_fields.join_operator.val1_result->payload;
+    int* right_value_vector = (int*) query->operator_fields.join_operator.val2_result->payload;
+    // positional information: the sort moves positions around with their
+    // values, so it needs them as position vectors
+    JoinPositions left_join_positions;
+    JoinPositions right_join_positions;
+    join_positions_from_result(query->operator_fields.join_operator.pos1_result, &left_join_positions);
+    join_positions_from_result(query->operator_fields.join_operator.pos2_result, &right_join_positions);
+    int* left_position_vector = join_position_vector(&left_join_positions, left_size);
+    int* right_position_vector = join_position_vector(&right_join_positions, right_size);
+    // eventual results
+    int result_arr_size = STARTING_RESULT_CAPACITY;
+    int* left_result_vector = malloc(sizeof(int) * result_arr_size);
+    int* right_result_vector = malloc(sizeof(int) * result_arr_size);
+    int num_results = 0;
+
+    // SORT: both sides into value order
+    int* left_values;
+    int* left_positions;
+    bool left_sorted_copy = false;
+    int* right_values;
+    int* right_positions;
+    bool right_sorted_copy = false;
+    bool join_failed = sort_join_input(left_value_vector, left_position_vector, left_size,
+        &left_values, &left_positions, &left_sorted_copy) != 0;
+    if (!join_failed && sort_join_input(right_value_vector, right_position_vector, right_size,
+            &right_values, &right_positions, &right_sorted_copy) != 0) {
+        if (left_sorted_copy) {
+            free(left_values);
+            free(left_positions);
+        }
+        join_failed = true;
+    }
+
+    // MERGE: walk both sides once, pairing up each run of equal values
+    int left_idx = 0;
+    int right_idx = 0;
+    while (!join_failed && left_idx < left_size && right_idx < right_size) {
+        int value = left_values[left_idx];
+        if (value < right_values[right_idx]) {
+            ++left_idx;
+            continue;
+        } else if (value > right_values[right_idx]) {
+            ++right_idx;
+            continue;
+        }
+        // find the end of the run on both sides
+        int left_run_end = left_idx + 1;
+        while (left_run_end < left_size && left_values[left_run_end] == value) {
+            ++left_run_end;
+        }
+        int right_run_end = right_idx + 1;
+        while (right_run_end < right_size && right_values[right_run_end] == value) {
+            ++right_run_end;
+        }
+        // every pair in the two runs matches
+        for (int i = left_idx; i < left_run_end; ++i) {
+            for (int j = right_idx; j < right_run_end; ++j) {
+                left_result_vector[num_results] = left_positions[i];
+                right_result_vector[num_results++] = right_positions[j];
+                // resize if necessary
+                if (num_results == result_arr_size) {
+                    int old_size = result_arr_size;
+                    left_result_vector = resize_data(left_result_vector, &old_size);
+                    // note we pass result_arr_size here, it's because this
+                    // function resizes that parameter
+                    right_result_vector = resize_data(right_result_vector, &result_arr_size);
+                }
+            }
+        }
+        left_idx = left_run_end;
+        right_idx = right_run_end;
+    }
+
+    if (!join_failed) {
+        if (left_sorted_copy) {
+            free(left_values);
+            free(left_positions);
+        }
+        if (right_sorted_copy) {
+            free(right_values);
+            free(right_positions);
+        }
+    }
+    // free position vectors
+    free_join_positions(&left_join_positions);
+    free_join_positions(&right_join_positions);
+
+    if (join_failed) {
+        free(left_result_vector);
+        free(right_result_vector);
+        const char* result_message = "sort merge join failed to sort its inputs";
+        char* result_message_ptr = malloc(strlen(result_message) + 1);
+        strcpy(result_message_ptr, result_message);
+        send_message->payload = result_message_ptr;
+        send_message->status = EXECUTION_ERROR;
+        return;
+    }
+
+    // copy results into client context
+    add_join_results_to_context(query, left_result_vector, right_result_vector, num_results);
+
+    const char* result_message = "sort merge join successful";
+    char* result_message_ptr = malloc(strlen(result_message) + 1);
+    strcpy(result_message_ptr, result_message);
+    send_message->payload = result_message_ptr;
+    send_message->status = OK_DONE;
+    return;
+}
+
+/* 
+ * pairs one matching row of an index join's probed side with every position
+ * in a run of equal values from the other side, appending to the results
+ */
+static void index_join_emit(int* run_positions, int run_size, int row, bool index_on_left,
+    int** left_result_vector, int** right_result_vector, int* result_arr_size, int* num_results) {
+    for (int i = 0; i < run_size; ++i) {
+        (*left_result_vector)[*num_results] = index_on_left ? row : run_positions[i];
+        (*right_result_vector)[(*num_results)++] = index_on_left ? run_positions[i] : row;
+        // resize if necessary
+        if (*num_results == *result_arr_size) {
+            int old_size = *result_arr_size;
+            *left_result_vector = resize_data(*left_result_vector, &old_size);
+            // note we pass result_arr_size here, it's because this
+            // function resizes that parameter
+            *right_result_vector = resize_data(*right_result_vector, result_arr_size);
+        }
+    }
+}
+
+/* 
+ * this function handles a join by probing one side's index (a btree, a
+ * sorted index, or the column itself if it's clustered) with each value from
+ * the other side. the values are sorted first, so the probes walk the index
+ * in order and each distinct value is only looked up once. results come back
+ * in value order
+ */
+void db_join_index(DbOperator* query, message* send_message) {
+    log_info("db_join_index\n");
+    JoinOperator* join_operator = &(query->operator_fields.join_operator);
+    // the side given as a column is probed, the other side's values drive
+    // the probes
+    bool index_on_left = join_operator->column1 != NULL;
+    Column* column = index_on_left ? join_operator->column1 : join_operator->column2;
+    int num_rows = index_on_left ? join_operator->column1_entries : join_operator->column2_entries;
+    Result* outer_value_result = index_on_left ? join_operator->val2_result : join_operator->val1_result;
+    Result* outer_pos_result = index_on_left ? join_operator->pos2_result : join_operator->pos1_result;
+    // only rows selected on the probed side can join. checking a row is a
+    // bit test, so mark a bitvector if they were selected as positions
+    Result* inner_pos_result = index_on_left ? join_operator->pos1_result : join_operator->pos2_result;
+    int* inner_bitvector = (int*) inner_pos_result->payload;
+    bool inner_bitvector_marked = false;
+    if (!result_is_bitvector(inner_pos_result)) {
+        inner_bitvector = calloc(num_bitvector_ints_needed(num_rows) + 1, sizeof(int));
+        mark_bv_from_pos_vec(inner_bitvector, (int*) inner_pos_result->payload, inner_pos_result->num_tuples);
+        inner_bitvector_marked = true;
+    }
+    int outer_size = outer_value_result->num_tuples;
+    JoinPositions outer_join_positions;
+    join_positions_from_result(outer_pos_result, &outer_join_positions);
+    int* outer_position_vector = join_position_vector(&outer_join_positions, outer_size);
+    // eventual results
+    int result_arr_size = STARTING_RESULT_CAPACITY;
+    int* left_result_vector = malloc(sizeof(int) * result_arr_size);
+    int* right_result_vector = malloc(sizeof(int) * result_arr_size);
+    int num_results = 0;
+
+    // batch the probes: in value order, each distinct value is one probe and
+    // the probes only ever move forward through the index
+    int* outer_values;
+    int* outer_positions;
+    bool outer_sorted_copy = false;
+    if (sort_join_input((int*) outer_value_result->payload, outer_position_vector, outer_size,
+            &outer_values, &outer_positions, &outer_sorted_copy) != 0) {
+        free_join_positions(&outer_join_positions);
+        if (inner_bitvector_marked) {
+            free(inner_bitvector);
+        }
+        free(left_result_vector);
+        free(right_result_vector);
+        const char* result_message = "index join failed to sort its input";
+        char* result_message_ptr = malloc(strlen(result_message) + 1);
+        strcpy(result_message_ptr, result_message);
+        send_message->payload = result_message_ptr;
+        send_message->status = EXECUTION_ERROR;
+        return;
+    }
+
+    // a clustered column is sorted itself, an unclustered sorted index is a
+    // sorted array of DataEntry's, and an unclustered btree keeps its
+    // DataEntry's in its leaves
+    bool use_btree = !column->clustered && column->index_type == BTREE;
+    DataEntry* entries = (column->clustered || use_btree) ? NULL : (DataEntry*) column->index;
+    int sorted_cursor = 0;
+    Node* leaf = NULL;
+    int leaf_idx = 0;
+    int run_start = 0;
+    while (run_start < outer_size) {
+        int value = outer_values[run_start];
+        int run_end = run_start + 1;
+        while (run_end < outer_size && outer_values[run_end] == value) {
+            ++run_end;
+        }
+        int* run_positions = outer_positions + run_start;
+        int run_size = run_end - run_start;
+        run_start = run_end;
+
+        if (!use_btree) {
+            // gallop forward from the last match
+            sorted_cursor = sorted_index_gte_from(column->data, entries, sorted_cursor, num_rows, value);
+            for (int i = sorted_cursor; i < num_rows; ++i) {
+                if ((entries == NULL ? column->data[i] : entries[i].value) != value) {
+                    break;
+                }
+                int row = entries == NULL ? i : entries[i].pos;
+                if (check_bv_position(inner_bitvector, row)) {
+                    index_join_emit(run_positions, run_size, row, index_on_left,
+                        &left_result_vector, &right_result_vector, &result_arr_size, &num_results);
+                }
+            }
+            continue;
+        }
+
+        // stay in the current leaf while value could still be in it,
+        // otherwise go back down from the root
+        if (leaf == NULL || leaf->num_entries == 0 || leaf->payload.data[leaf->num_entries - 1].value < value) {
+            leaf = btree_gte_probe((BTree*) column->index, value, &leaf_idx);
+            if (leaf == NULL) {
+                // everything in the index is smaller, and so are all the
+                // values left to probe with
+                break;
+            }
+            if (leaf_idx == -1) {
+                // nothing big enough in this leaf, so start on the next
+                leaf = leaf->next;
+                leaf_idx = 0;
+            }
+        }
+        while (leaf != NULL && leaf_idx < leaf->num_entries && leaf->payload.data[leaf_idx].value < value) {
+            ++leaf_idx;
+        }
+        // walk the matches, across leaves if need be
+        Node* current_node = leaf;
+        int current_idx = leaf_idx;
+        while (current_node != NULL) {
+            if (current_idx >= current_node->num_entries) {
+                current_node = current_node->next;
+                current_idx = 0;
+                continue;
+            }
+            if (current_node->payload.data[current_idx].value != value) {
+                break;
+            }
+            int row = current_node->payload.data[current_idx].pos;
+            if (check_bv_position(inner_bitvector, row)) {
+                index_join_emit(run_positions, run_size, row, index_on_left,
+                    &left_result_vector, &right_result_vector, &result_arr_size, &num_results);
+            }
+            ++current_idx;
+        }
+    }
+
+    if (outer_sorted_copy) {
+        free(outer_values);
+        free(outer_positions);
+    }
+    // free position vectors
+    free_join_positions(&outer_join_positions);
+    if (inner_bitvector_marked) {
+        free(inner_bitvector);
+    }
+
+    // copy results into client context
+    add_join_results_to_context(query, left_result_vector, right_result_vector, num_results);
+
+    const char* result_message = "index join successful";
+    char* result_message_ptr = malloc(strlen(result_message) + 1);
+    strcpy(result_message_ptr, result_message);
+    send_message->payload = result_message_ptr;
+    send_message->status = OK_DONE;
+    return;
+}
+
+/* 
+ * seconds since start
+ */
+static double join_seconds_since(struct timespec* start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) + ((end.tv_nsec - start->tv_nsec) / 1e9);
+}
+
+/* 
+ * keeps the fastest time per unit of work seen so far. a step too quick for
+ * the clock to see doesn't count
+ */
+static double join_fastest(double best, double elapsed) {
+    if (elapsed > 0 && (best < 0 || elapsed < best)) {
+        return elapsed;
+    }
+    return best;
+}
+
+/* 
+ * the threads a join step over num_values values gets, at least
+ * min_per_thread values each
+ */
+static int join_step_threads(double num_values, int min_per_thread, int max_threads) {
+    double num_threads = num_values / min_per_thread;
+    if (num_threads > max_threads) {
+        return max_threads;
+    }
+    return num_threads < 1 ? 1 : (int) num_threads;
+}
+
+/* 
+ * the threads a radix sort of num_values values actually gets
+ */
+static int join_sort_threads(int num_values) {
+    int num_threads = sort_num_threads(num_values);
+    return num_threads < worker_pool_threads() ? num_threads : worker_pool_threads();
+}
+
+/* 
+ * this function measures the join cost model on synthetic inputs, so auto
+ * joins are planned for this machine. each step runs the way a join runs
+ * it, over as many threads, and its time is scaled back to one thread.
+ * the first join planned calls it
+ */
+void join_calibrate(void) {
+    int num_values = JOIN_CALIBRATION_VALUES;
+    int num_threads = worker_pool_threads();
+    int* values = malloc(sizeof(int) * (num_values + 1));
+    int* positions = malloc(sizeof(int) * (num_values + 1));
+    int* sorted_values = malloc(sizeof(int) * (num_values + 1));
+    int* sorted_order = malloc(sizeof(int) * (num_values + 1));
+    // keys drawn from as many as there are values, so most probes match
+    unsigned int seed = 1;
+    for (int i = 0; i < num_values; ++i) {
+        seed = (seed * 1103515245) + 12345;
+        values[i] = (int) ((seed >> 8) % num_values);
+        positions[i] = i;
+    }
+
+    JoinCostModel best = { -1.0, -1.0, -1.0, -1.0, -1.0 };
+    for (int run = 0; run < JOIN_CALIBRATION_RUNS; ++run) {
+        struct timespec start;
+
+        // NESTED LOOP: one tile against the whole inner side
+        NestedLoopJoinTask tile;
+        memset(&tile, 0, sizeof(NestedLoopJoinTask));
+        tile.outer_values = values;
+        tile.outer_positions = positions;
+        tile.inner_values = values + JOIN_CALIBRATION_OUTER;
+        tile.inner_positions = positions + JOIN_CALIBRATION_OUTER;
+        tile.inner_size = JOIN_CALIBRATION_INNER;
+        tile.inner_block_size = (int) (cache_size(1) / (2 * sizeof(int)));
+        tile.end = JOIN_CALIBRATION_OUTER;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        nested_loop_join_tile(&tile);
+        best.nested_loop_pair = join_fastest(best.nested_loop_pair,
+            join_seconds_since(&start) / ((double) JOIN_CALIBRATION_OUTER * JOIN_CALIBRATION_INNER));
+        free(tile.outer_results);
+        free(tile.inner_results);
+
+        // PARTITION: both sides of a hash join, planned as db_join_hash would
+        RadixJoinPlan radix_plan;
+        plan_radix_join(JOIN_CALIBRATION_BUILD, num_threads * JOIN_TASKS_PER_THREAD, &radix_plan);
+        JoinPositions build_positions = { positions, NULL, 0, false };
+        JoinPositions probe_positions = { positions, NULL, 0, false };
+        RadixPartitions build_partitions;
+        RadixPartitions probe_partitions;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        int failure = radix_partition(values, &build_positions, JOIN_CALIBRATION_BUILD, NULL, &radix_plan,
+            &build_partitions);
+        if (failure == 0 && radix_partition(values, &probe_positions, num_values, NULL, &radix_plan,
+                &probe_partitions) != 0) {
+            free_radix_partitions(&build_partitions);
+            failure = -1;
+        }
+        if (failure != 0) {
+            break;
+        }
+        double partition_time = join_seconds_since(&start) / (radix_plan.num_passes > 0 ? radix_plan.num_passes : 1);
+        best.partition_tuple = join_fastest(best.partition_tuple,
+            (partition_time * join_step_threads(num_values, JOIN_MIN_VALUES_PER_THREAD, num_threads)) /
+            (JOIN_CALIBRATION_BUILD + num_values));
+
+        // HASH: then the partitions joined by the pool
+        int num_partitions = build_partitions.num_partitions;
+        int num_tasks = num_threads * JOIN_TASKS_PER_THREAD < num_partitions ?
+            num_threads * JOIN_TASKS_PER_THREAD : num_partitions;
+        bool* skewed = calloc(num_partitions, sizeof(bool));
+        HashJoinTask* tasks = calloc(num_tasks, sizeof(HashJoinTask));
+        for (int t = 0; t < num_tasks; ++t) {
+            tasks[t].left = &build_partitions;
+            tasks[t].right = &probe_partitions;
+            tasks[t].skip_bits = radix_plan.total_bits;
+            tasks[t].first_partition = (int) (((long) num_partitions * t) / num_tasks);
+            tasks[t].end_partition = (int) (((long) num_partitions * (t + 1)) / num_tasks);
+            tasks[t].skewed = skewed;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        run_in_threads(hash_join_partitions, tasks, sizeof(HashJoinTask), num_tasks);
+        best.hash_tuple = join_fastest(best.hash_tuple,
+            (join_seconds_since(&start) * (num_tasks < num_threads ? num_tasks : num_threads)) /
+            (JOIN_CALIBRATION_BUILD + num_values));
+        for (int t = 0; t < num_tasks; ++t) {
+            free(tasks[t].left_results);
+            free(tasks[t].right_results);
+        }
+        free(tasks);
+        free(skewed);
+        free_radix_partitions(&build_partitions);
+        free_radix_partitions(&probe_partitions);
+
+        // SORT: then one pass over the sorted values, which finds nothing to do
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        radix_sort(values, num_values, sorted_values, sorted_order);
+        best.sort_tuple = join_fastest(best.sort_tuple,
+            (join_seconds_since(&start) * join_sort_threads(num_values)) / num_values);
+        int* scanned_values;
+        int* scanned_positions;
+        bool scanned_copy = false;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        sort_join_input(sorted_values, sorted_order, num_values, &scanned_values, &scanned_positions, &scanned_copy);
+        best.scan_tuple = join_fastest(best.scan_tuple, join_seconds_since(&start) / num_values);
+    }
+    free(values);
+    free(positions);
+    free(sorted_values);
+    free(sorted_order);
+
+    // anything the clock couldn't see keeps its default
+    if (best.nested_loop_pair > 0) {
+        join_cost_model.nested_loop_pair = best.nested_loop_pair;
+    }
+    if (best.partition_tuple > 0) {
+        join_cost_model.partition_tuple = best.partition_tuple;
+    }
+    if (best.hash_tuple > 0) {
+        join_cost_model.hash_tuple = best.hash_tuple;
+    }
+    if (best.sort_tuple > 0) {
+        join_cost_model.sort_tuple = best.sort_tuple;
+    }
+    if (best.scan_tuple > 0) {
+        join_cost_model.scan_tuple = best.scan_tuple;
+    }
+    join_calibrated = true;
+    log_info("calibrated joins (ns): %f per nested loop pair, %f partition, %f hash, %f sort, %f scan per tuple\n",
+             join_cost_model.nested_loop_pair * 1e9, join_cost_model.partition_tuple * 1e9,
+             join_cost_model.hash_tuple * 1e9, join_cost_model.sort_tuple * 1e9, join_cost_model.scan_tuple * 1e9);
+}
+
+/* 
+ * one pass over a side's values for their range and whether they're
+ * already in order
+ */
+static void join_input_stats(int* values, int num_values, JoinInputStats* stats) {
+    stats->num_values = num_values;
+    stats->is_column = false;
+    stats->sorted = true;
+    stats->min_value = num_values > 0 ? values[0] : 0;
+    stats->max_value = stats->min_value;
+    for (int i = 1; i < num_values; ++i) {
+        int value = values[i];
+        stats->sorted = stats->sorted && values[i - 1] <= value;
+        if (value < stats->min_value) {
+            stats->min_value = value;
+        }
+        if (value > stats->max_value) {
+            stats->max_value = value;
+        }
+    }
+}
+
+/*
+ * comparison function for ordering sampled values
+ */
+static int compare_sampled_values(const void* a, const void* b) {
+    int value_a = *(const int*) a;
+    int value_b = *(const int*) b;
+    return (value_a > value_b) - (value_a < value_b);
+}
+
+/* 
+ * takes up to JOIN_PLAN_SAMPLE_SIZE values spread evenly over a side and
+ * sorts them. returns how many were taken
+ */
+static int sample_join_input(int* values, int num_values, int* sample) {
+    int sample_size = num_values < JOIN_PLAN_SAMPLE_SIZE ? num_values : JOIN_PLAN_SAMPLE_SIZE;
+    for (int i = 0; i < sample_size; ++i) {
+        sample[i] = values[(int) (((long) num_values * i) / sample_size)];
+    }
+    qsort(sample, sample_size, sizeof(int), compare_sampled_values);
+    return sample_size;
+}
+
+/* 
+ * guesses how many matches a join makes by joining a sample of each side
+ * and scaling the matches up. min and max can be thrown off by a few
+ * outliers, and keys are rarely spread evenly between them, so the ranges
+ * only settle joins that can't match at all. a side given as a column has
+ * no values to sample, so each probe into it is taken to match once
+ */
+static long estimate_join_results(int* left_values, JoinInputStats* left, int* right_values, JoinInputStats* right) {
+    if (left->is_column || right->is_column) {
+        return left->is_column ? right->num_values : left->num_values;
+    }
+    if (left->num_values == 0 || right->num_values == 0 ||
+        left->max_value < right->min_value || right->max_value < left->min_value) {
+        return 0;
+    }
+    int* left_sample = malloc(sizeof(int) * JOIN_PLAN_SAMPLE_SIZE);
+    int* right_sample = malloc(sizeof(int) * JOIN_PLAN_SAMPLE_SIZE);
+    int left_sample_size = sample_join_input(left_values, left->num_values, left_sample);
+    int right_sample_size = sample_join_input(right_values, right->num_values, right_sample);
+    // merge the samples, each run of equal values matching every value in
+    // the other side's run
+    long matches = 0;
+    int l = 0;
+    int r = 0;
+    while (l < left_sample_size && r < right_sample_size) {
+        if (left_sample[l] < right_sample[r]) {
+            ++l;
+        } else if (left_sample[l] > right_sample[r]) {
+            ++r;
+        } else {
+            int value = left_sample[l];
+            long left_run = 0;
+            long right_run = 0;
+            while (l < left_sample_size && left_sample[l] == value) {
+                ++left_run;
+                ++l;
+            }
+            while (r < right_sample_size && right_sample[r] == value) {
+                ++right_run;
+                ++r;
+            }
+            matches += left_run * right_run;
+        }
+    }
+    free(left_sample);
+    free(right_sample);
+    // no matches in the sample only says there are too few to show up in
+    // it, so call it half of what one would have meant. exact when the
+    // samples are the whole sides
+    double scale = ((double) left->num_values / left_sample_size) * ((double) right->num_values / right_sample_size);
+    return matches > 0 ? (long) (matches * scale) : (long) (scale / 2);
+}
+
+/* 
+ * what sorting one side of a join would cost: just the pass that checks if
+ * it's already in order, or a radix sort
+ */
+static double join_sort_cost(JoinInputStats* stats) {
+    double cost = stats->num_values * join_cost_model.scan_tuple;
+    if (!stats->sorted) {
+        cost += stats->num_values * join_cost_model.sort_tuple / join_sort_threads(stats->num_values);
+    }
+    return cost;
+}
+
+/* 
+ * this function estimates what each join algorithm would cost on a join's
+ * inputs and, for an auto join, picks the cheapest that fits in memory.
+ * otherwise the requested algorithm is kept
+ */
+void plan_join(JoinOperator* join_operator, JoinPlan* plan) {
+    if (!join_calibrated) {
+        join_calibrate();
+    }
+    memset(plan, 0, sizeof(JoinPlan));
+    JoinCostModel* model = &join_cost_model;
+    int num_threads = worker_pool_threads();
+    // STATS: a side given as a column is only ever probed through its index
+    if (join_operator->val1_result != NULL) {
+        join_input_stats((int*) join_operator->val1_result->payload, join_operator->val1_result->num_tuples,
+            &(plan->left));
+    } else {
+        plan->left.is_column = true;
+        plan->left.num_values = join_operator->column1_entries;
+    }
+    if (join_operator->val2_result != NULL) {
+        join_input_stats((int*) join_operator->val2_result->payload, join_operator->val2_result->num_tuples,
+            &(plan->right));
+    } else {
+        plan->right.is_column = true;
+        plan->right.num_values = join_operator->column2_entries;
+    }
+    plan->estimated_results = estimate_join_results(
+        join_operator->val1_result != NULL ? (int*) join_operator->val1_result->payload : NULL, &(plan->left),
+        join_operator->val2_result != NULL ? (int*) join_operator->val2_result->payload : NULL, &(plan->right));
+    double left_size = plan->left.num_values;
+    double right_size = plan->right.num_values;
+    double results = plan->estimated_results;
+    long result_bytes = 2 * sizeof(int) * plan->estimated_results;
+    for (int t = 1; t <= JOIN_ALGORITHMS; ++t) {
+        plan->costs[t] = -1.0;
+    }
+
+    if (!plan->left.is_column && !plan->right.is_column) {
+        // NESTED LOOP: every pair, in tiles of the larger side spread over
+        // the pool. each tile's results, then all of them together
+        double outer_size = left_size > right_size ? left_size : right_size;
+        plan->costs[NESTED_LOOP_JOIN] = (left_size * right_size * model->nested_loop_pair /
+            join_step_threads(outer_size, NESTED_LOOP_MIN_TILE, num_threads)) + (results * model->scan_tuple);
+        plan->memory[NESTED_LOOP_JOIN] = 2 * result_bytes;
+
+        // HASH: partitioned as db_join_hash would, then a table built over
+        // the smaller side of each partition and probed with the larger.
+        // results are sorted back into left position order
+        int min_partitions = 1;
+        if (left_size + right_size >= 2 * JOIN_MIN_VALUES_PER_THREAD) {
+            min_partitions = num_threads * JOIN_TASKS_PER_THREAD;
+        }
+        RadixJoinPlan radix_plan;
+        plan_radix_join((int) (left_size < right_size ? left_size : right_size), min_partitions, &radix_plan);
+        plan->radix_passes = radix_plan.num_passes;
+        double partition_cost = radix_plan.num_passes * model->partition_tuple *
+            ((left_size / join_step_threads(left_size, JOIN_MIN_VALUES_PER_THREAD, num_threads)) +
+             (right_size / join_step_threads(right_size, JOIN_MIN_VALUES_PER_THREAD, num_threads)));
+        int hash_threads = (1 << radix_plan.total_bits) < num_threads ? (1 << radix_plan.total_bits) : num_threads;
+        double build_probe_cost = (left_size + right_size) * model->hash_tuple / hash_threads;
+        double result_sort_cost = join_operator->bitvector_output ? 0.0 :
+            results * model->sort_tuple / join_sort_threads((int) plan->estimated_results);
+        plan->costs[HASH_JOIN] = partition_cost + build_probe_cost + result_sort_cost + (results * model->scan_tuple);
+        // a partitioned copy of both sides (two while passes ping pong), a
+        // table per thread, and the results three times over as they're
+        // gathered and sorted
+        int partition_copies = radix_plan.num_passes < 2 ? radix_plan.num_passes : 2;
+        plan->memory[HASH_JOIN] = ((long) (left_size + right_size) * 2 * sizeof(int) * partition_copies) +
+            (hash_threads * cache_size(2)) + (3 * result_bytes);
+
+        // SORT MERGE: sort whichever sides aren't in order, then one merge.
+        // a radix sort holds seven ints per value at its peak, and the
+        // results grow by doubling
+        plan->costs[SORT_MERGE_JOIN] = join_sort_cost(&(plan->left)) + join_sort_cost(&(plan->right)) +
+            ((left_size + right_size + results) * model->scan_tuple);
+        plan->memory[SORT_MERGE_JOIN] = (plan->left.sorted ? 0 : (long) left_size * 7 * sizeof(int)) +
+            (plan->right.sorted ? 0 : (long) right_size * 7 * sizeof(int)) + (2 * result_bytes);
+    } else {
+        // INDEX: the only way to join a side given as a column. the other
+        // side is sorted, then each probe walks down the index, near where
+        // the last one left off. plus a bitvector over the column's rows
+        JoinInputStats* outer = plan->left.is_column ? &(plan->right) : &(plan->left);
+        JoinInputStats* inner = plan->left.is_column ? &(plan->left) : &(plan->right);
+        int index_levels = 1;
+        while (index_levels < 31 && (1 << index_levels) < inner->num_values) {
+            ++index_levels;
+        }
+        plan->costs[INDEX_JOIN] = join_sort_cost(outer) +
+            ((double) outer->num_values * index_levels * model->scan_tuple) + (results * model->scan_tuple);
+        plan->memory[INDEX_JOIN] = (outer->sorted ? 0 : (long) outer->num_values * 7 * sizeof(int)) +
+            (inner->num_values / 8) + (2 * result_bytes);
+    }
+
+    // the cheapest that fits in memory, or if none do, the one that comes
+    // closest
+    plan->available_memory = available_memory();
+    plan->requested = join_operator->join_type != AUTO_JOIN;
+    plan->join_type = join_operator->join_type;
+    if (!plan->requested) {
+        int cheapest = 0;
+        int smallest = 0;
+        for (int t = 1; t <= JOIN_ALGORITHMS; ++t) {
+            if (plan->costs[t] < 0) {
+                continue;
+            }
+            if (smallest == 0 || plan->memory[t] < plan->memory[smallest]) {
+                smallest = t;
+            }
+            bool fits = plan->available_memory < 0 || plan->memory[t] <= plan->available_memory;
+            if (fits && (cheapest == 0 || plan->costs[t] < plan->costs[cheapest])) {
+                cheapest = t;
+            }
+        }
+        plan->join_type = cheapest != 0 ? cheapest : smallest;
+    }
+    log_info("join plan: %s, %ld estimated results\n", join_type_name(plan->join_type), plan->estimated_results);
+}
+
+/* 
+ * this function describes a join plan for explain, one line per fact. the
+ * caller frees the string
+ */
+char* explain_join_plan(JoinPlan* plan) {
+    char explain[2048];
+    int length = 0;
+    length += snprintf(explain + length, sizeof(explain) - length, "join: %s, %s\n",
+        join_type_name(plan->join_type), plan->requested ? "as requested" : "the cheapest that fits in memory");
+    JoinInputStats* sides[2] = { &(plan->left), &(plan->right) };
+    const char* side_names[2] = { "left", "right" };
+    for (int s = 0; s < 2; ++s) {
+        if (sides[s]->is_column) {
+            length += snprintf(explain + length, sizeof(explain) - length, "%s: indexed column, %d rows\n",
+                side_names[s], sides[s]->num_values);
+        } else if (sides[s]->num_values == 0) {
+            length += snprintf(explain + length, sizeof(explain) - length, "%s: no values\n", side_names[s]);
+        } else {
+            length += snprintf(explain + length, sizeof(explain) - length, "%s: %d values, keys %d to %d, %s\n",
+                side_names[s], sides[s]->num_values, sides[s]->min_value, sides[s]->max_value,
+                sides[s]->sorted ? "sorted" : "unsorted");
+        }
+    }
+    length += snprintf(explain + length, sizeof(explain) - length, "estimated results: %ld\n",
+        plan->estimated_results);
+    if (plan->available_memory >= 0) {
+        length += snprintf(explain + length, sizeof(explain) - length, "memory available: %.1f MB\n",
+            plan->available_memory / (double) (1 << 20));
+    }
+    for (int t = 1; t <= JOIN_ALGORITHMS; ++t) {
+        if (plan->costs[t] < 0) {
+            length += snprintf(explain + length, sizeof(explain) - length, "%s: can't run on these inputs\n",
+                join_type_name(t));
+            continue;
+        }
+        length += snprintf(explain + length, sizeof(explain) - length, "%s: %.3f ms, %.1f MB",
+            join_type_name(t), plan->costs[t] * 1e3, plan->memory[t] / (double) (1 << 20));
+        if (t == HASH_JOIN && plan->radix_passes > 0) {
+            length += snprintf(explain + length, sizeof(explain) - length, ", radix partitioned in %d pass%s",
+                plan->radix_passes, plan->radix_passes > 1 ? "es" : "");
+        } else if (t == HASH_JOIN) {
+            length += snprintf(explain + length, sizeof(explain) - length, ", fits in cache unpartitioned");
+        }
+        length += snprintf(explain + length, sizeof(explain) - length, "\n");
+    }
+    // the client ends the message with a newline of its own
+    explain[length - 1] = '\0';
+    char* explain_ptr = malloc(length);
+    strcpy(explain_ptr, explain);
+    return explain_ptr;
+}
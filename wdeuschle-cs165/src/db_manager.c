@@ -7,6 +7,7 @@
 #include "utils.h"
 #include "client_context.h"
 #include "btree.h"
+#include "db_sample.h"
 #include "db_manager.h"
 
 
@@ -15,6 +16,10 @@
 #define STARTING_TABLE_CAPACITY 4096
 // TODO: need to do this a better way
 #define BUFFER_SIZE 4096
+// binary db files start with these, the version goes up whenever a struct
+// written to the file changes so older files are refused, not misread
+#define BINARY_DB_MAGIC "CS165DB"
+#define BINARY_DB_VERSION 2
 
 // In this class, there will always be only one active database at a time
 Db *current_db = NULL;
@@ -171,6 +176,9 @@ Table* create_table_helper(char* name, size_t col_count, size_t table_capacity)
     table->table_size = 0; // currently columns are empty, assign size of 0
     table->columns = malloc(col_count * sizeof(Column)); // initialize space for table columns
     memset(table->columns, 0, col_count * sizeof(Column));
+    table->sample = NULL; // built as rows come in
+    table->sample_size = 0;
+    table->sample_rows_seen = 0;
     
     return table;
 }
@@ -598,6 +606,11 @@ Status shutdown_database_binary(Db* db) {
     FILE* fp;
     fp = fopen(db_file_name, "wb");
 
+    // say which layout the rest of the file is in
+    int version = BINARY_DB_VERSION;
+    fwrite(BINARY_DB_MAGIC, sizeof(BINARY_DB_MAGIC), 1, fp);
+    fwrite(&version, sizeof(int), 1, fp);
+
     // first line is for the db structure itself
     fwrite(db, sizeof(Db), 1, fp);
     // db_name, tables_size, tables_capacity
@@ -645,6 +658,10 @@ Status shutdown_database_binary(Db* db) {
                 }
             }
         }
+        // now the sample, if it's worth keeping
+        if (t->sample != NULL && t->sample_rows_seen == t->table_size) {
+            fwrite(t->sample, sizeof(int), t->col_capacity * TABLE_SAMPLE_CAPACITY, fp);
+        }
     }
 
     // close file
@@ -684,6 +701,16 @@ Status db_load_binary(const char* file_name) {
         return ret_status;
     }
 
+    // the structs are read back raw, so only a file in our layout will do
+    char magic[sizeof(BINARY_DB_MAGIC)];
+    int version;
+    if (fread(magic, sizeof(magic), 1, fp) != 1 || fread(&version, sizeof(int), 1, fp) != 1 ||
+        memcmp(magic, BINARY_DB_MAGIC, sizeof(magic)) != 0 || version != BINARY_DB_VERSION) {
+        log_err("%s isn't a version %d db file, refusing to load it\n", db_file_name, BINARY_DB_VERSION);
+        fclose(fp);
+        ret_status.code = ERROR;
+        return ret_status;
+    }
 
     // initialize new db object
     Db* db = malloc(sizeof(Db)); // allocate space
@@ -824,6 +851,16 @@ Status db_load_binary(const char* file_name) {
                 }
             }
         }
+        // now the sample, only written out if it was up to date
+        if (t->sample != NULL && t->sample_rows_seen == t->table_size) {
+            t->sample = malloc(sizeof(int) * t->col_capacity * TABLE_SAMPLE_CAPACITY);
+            fread(t->sample, sizeof(int), t->col_capacity * TABLE_SAMPLE_CAPACITY, fp);
+        } else {
+            // rebuilt from the table when it's next needed
+            t->sample = NULL;
+            t->sample_size = 0;
+            t->sample_rows_seen = 0;
+        }
     }
 
     // close file
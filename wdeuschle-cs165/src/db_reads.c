@@ -7,6 +7,12 @@
 #include "client_context.h"
 #include "db_reads_indexed.h"
 #include "btree.h"
+#include "db_expression.h"
+#include "db_sample.h"
+
+// number of positions fetch_many decodes at a time, every column is gathered
+// with a batch before moving on to the next
+#define FETCH_MANY_BATCH_SIZE 1024
 
 /*
  * This function takes an array of integers, the quantity of them, their
@@ -485,6 +491,117 @@ void db_fetch(DbOperator* query, message* send_message) {
     }
 }
 
+/* 
+ * this fetches several columns at the same positions, decoding the positions
+ * once. stores one result per column, or sends the rows to the client
+ * already interleaved if no handles were given
+ */
+void db_fetch_many(DbOperator* query, message* send_message) {
+    log_info("calling db_fetch_many\n");
+    FetchManyOperator* fetch_many = &(query->operator_fields.fetch_many_operator);
+    Result* ids_result = fetch_many->ids_result;
+    int num_columns = fetch_many->num_columns;
+    int num_results = ids_result->num_tuples;
+    bool interleave = fetch_many->handles == NULL;
+
+    // where each column's values go. interleaved, column i starts at rows[i]
+    // and every row is num_columns wide
+    int* rows = NULL;
+    int* outputs[num_columns];
+    Result* reused[num_columns];
+    if (interleave) {
+        rows = malloc(sizeof(int) * ((num_results * num_columns) + 1));
+    } else {
+        for (int i = 0; i < num_columns; ++i) {
+            char* handle = fetch_many->handles + (HANDLE_MAX_SIZE * i);
+            // overwrite the handle's old values in place if they fit, unless
+            // they are the very positions we're reading
+            reused[i] = lookup_reusable_result(handle, num_results, query->context);
+            if (reused[i] == ids_result) {
+                reused[i] = NULL;
+            }
+            outputs[i] = reused[i] != NULL ? (int*) reused[i]->payload : malloc(sizeof(int) * (num_results + 1));
+        }
+    }
+
+    // decode a batch of positions once, then gather every column with it
+    bool bitvector = result_is_bitvector(ids_result);
+    int position_batch[FETCH_MANY_BATCH_SIZE];
+    int bv_idx = -1;
+    unsigned int current_bits = 0;
+    int num_fetched = 0;
+    while (num_fetched < num_results) {
+        int* positions;
+        int num_positions;
+        if (bitvector) {
+            positions = position_batch;
+            num_positions = next_bitvector_positions((int*) ids_result->payload, ids_result->bitvector_ints,
+                &bv_idx, &current_bits, position_batch, FETCH_MANY_BATCH_SIZE);
+            if (num_positions == 0) {
+                break;
+            }
+        } else {
+            positions = (int*) ids_result->payload + num_fetched;
+            num_positions = num_results - num_fetched < FETCH_MANY_BATCH_SIZE ? num_results - num_fetched : FETCH_MANY_BATCH_SIZE;
+        }
+        for (int i = 0; i < num_columns; ++i) {
+            int* column = fetch_many->columns[i]->data;
+            if (interleave) {
+                int* out = rows + (num_fetched * num_columns) + i;
+                for (int j = 0; j < num_positions; ++j) {
+                    out[j * num_columns] = column[positions[j]];
+                }
+            } else {
+                int* out = outputs[i] + num_fetched;
+                for (int j = 0; j < num_positions; ++j) {
+                    out[j] = column[positions[j]];
+                }
+            }
+        }
+        num_fetched += num_positions;
+    }
+
+    if (interleave) {
+        // already in the layout the client prints
+        send_message->num_columns = num_columns;
+        send_message->data_type = INT;
+        send_message->status = OK_WAIT_FOR_DATA;
+        send_message->payload = (char*) rows;
+        send_message->length = num_fetched * num_columns * sizeof(int);
+        return;
+    }
+
+    for (int i = 0; i < num_columns; ++i) {
+        if (reused[i] != NULL) {
+            reused[i]->bitvector_ints = -1;
+            reused[i]->is_posn_vector = true;
+            continue;
+        }
+        // create the result object
+        Result* result_obj = malloc(sizeof(Result));
+        result_obj->num_tuples = num_fetched;
+        result_obj->payload = outputs[i];
+        result_obj->data_type = INT;
+        result_obj->bitvector_ints = -1;
+        result_obj->is_posn_vector = true; // this isn't a bitvector, it's the results from a fetch
+
+        // wrap the result object appropriately
+        GeneralizedColumnHandle generalized_result_handle;
+        strcpy(generalized_result_handle.name, fetch_many->handles + (HANDLE_MAX_SIZE * i));
+        generalized_result_handle.generalized_column.column_type = RESULT;
+        generalized_result_handle.generalized_column.column_pointer.result = result_obj;
+        // add this value to the client context variable pool
+        add_to_client_context(query->context, generalized_result_handle);
+    }
+
+    char* result_message = "fetch many successful";
+    char* result_message_ptr = malloc(strlen(result_message) + 1);
+    strcpy(result_message_ptr, result_message);
+    send_message->payload = result_message_ptr;
+    send_message->status = OK_DONE;
+    return;
+}
+
 /* 
  * this sums the values in a column
  */
@@ -496,6 +613,50 @@ long sum(int* arr, int num_entries) {
     return total;
 }
 
+/* 
+ * this tries to answer an avg or sum from its table's sample. returns false
+ * if an exact answer was asked for or the sample can't meet the error bound
+ */
+static bool approximate_aggregate(GeneralizedColumn* generalized_column, Table* table, double approx,
+    bool is_sum, double* estimate, double* half_width) {
+    // results have no sample to draw from
+    if (approx <= 0.0 || generalized_column->column_type != COLUMN) {
+        return false;
+    }
+    if (sample_estimate(table, generalized_column->column_pointer.column, is_sum, approx, estimate, half_width)) {
+        return true;
+    }
+    log_info("sample too noisy for %f, computing exactly\n", approx);
+    return false;
+}
+
+/* 
+ * this stores the confidence interval half width of an aggregate, if the
+ * query asked for it
+ */
+static void store_aggregate_error(ClientContext* context, char* error_handle, double half_width) {
+    if (error_handle[0] == '\0') {
+        return;
+    }
+    double* error = malloc(1 * sizeof(double));
+    *error = half_width;
+
+    // create the result obj
+    Result* result_obj = malloc(sizeof(Result));
+    result_obj->num_tuples = 1;
+    result_obj->payload = error;
+    result_obj->data_type = DOUBLE;
+    result_obj->bitvector_ints = -1;
+    result_obj->is_posn_vector = false;
+
+    // wrap the results appropriately
+    GeneralizedColumnHandle result_wrapper;
+    strcpy(result_wrapper.name, error_handle);
+    result_wrapper.generalized_column.column_type = RESULT;
+    result_wrapper.generalized_column.column_pointer.result = result_obj;
+    add_to_client_context(context, result_wrapper);
+}
+
 /* 
  * this sums the results in a column
  */
@@ -505,16 +666,26 @@ void db_sum(DbOperator* query, message* send_message) {
     long total_tally = 0;
     int* results;
     int num_results = query->operator_fields.sum_operator.num_results;
-
-    if (query->operator_fields.sum_operator.generalized_column.column_type == RESULT) {
-        // result type
-        results = (int*) query->operator_fields.sum_operator.generalized_column.column_pointer.result->payload;
+    double estimate;
+    double half_width = 0.0;
+
+    if (approximate_aggregate(&(query->operator_fields.sum_operator.generalized_column),
+            query->operator_fields.sum_operator.table, query->operator_fields.sum_operator.approx,
+            true, &estimate, &half_width)) {
+        // the sample was good enough, round the estimate
+        total_tally = (long) (estimate + (estimate < 0 ? -0.5 : 0.5));
     } else {
-        // column type
-        results = (int*) query->operator_fields.sum_operator.generalized_column.column_pointer.column->data;
+        half_width = 0.0;
+        if (query->operator_fields.sum_operator.generalized_column.column_type == RESULT) {
+            // result type
+            results = (int*) query->operator_fields.sum_operator.generalized_column.column_pointer.result->payload;
+        } else {
+            // column type
+            results = (int*) query->operator_fields.sum_operator.generalized_column.column_pointer.column->data;
+        }
+        // sum the results
+        total_tally = sum(results, num_results);
     }
-    // sum the results
-    total_tally = sum(results, num_results);
 
     // return res
     long* total = malloc(1 * sizeof(long)); 
@@ -530,6 +701,7 @@ void db_sum(DbOperator* query, message* send_message) {
     }
     result_obj->payload = total;
     result_obj->data_type = LONG;
+    result_obj->bitvector_ints = -1;
     result_obj->is_posn_vector = false;
 
     // wrap the results appropriately
@@ -542,6 +714,7 @@ void db_sum(DbOperator* query, message* send_message) {
     result_wrapper.generalized_column.column_pointer.result = result_obj;
     // add this value to the client context variable pool
     add_to_client_context(query->context, result_wrapper);
+    store_aggregate_error(query->context, query->operator_fields.sum_operator.error_handle, half_width);
     log_info("SUM: %li\n", *total);
 
     const char* result_message = "sum successful";
@@ -582,6 +755,7 @@ void db_min(DbOperator* query, message* send_message) {
     result_obj->num_tuples = 1;
     result_obj->payload = final_result;
     result_obj->data_type = INT;
+    result_obj->bitvector_ints = -1;
     result_obj->is_posn_vector = false;
 
     // wrap the results appropriately
@@ -634,6 +808,7 @@ void db_max(DbOperator* query, message* send_message) {
     result_obj->num_tuples = 1;
     result_obj->payload = final_result;
     result_obj->data_type = INT;
+    result_obj->bitvector_ints = -1;
     result_obj->is_posn_vector = false;
 
     // wrap the results appropriately
@@ -665,28 +840,38 @@ void db_average(DbOperator* query, message* send_message) {
     long total = 0;
     int* results;
     int num_results = query->operator_fields.average_operator.num_results;
-
-    if (query->operator_fields.average_operator.generalized_column.column_type == RESULT) {
-        // result type
-        results = (int*) query->operator_fields.average_operator.generalized_column.column_pointer.result->payload;
-    } else {
-        // column type
-        results = (int*) query->operator_fields.average_operator.generalized_column.column_pointer.column->data;
-    }
-    // sum the results
-    total = sum(results, num_results);
-    log_info("TOTAL: %d\n", total);
-    log_info("NUMBER OF RESULTS: %d\n", num_results);
+    double estimate;
+    double half_width = 0.0;
 
     // average
     double* average = malloc(1 * sizeof(double)); 
-    *average = (long double) total / (double) num_results;
+    if (approximate_aggregate(&(query->operator_fields.average_operator.generalized_column),
+            query->operator_fields.average_operator.table, query->operator_fields.average_operator.approx,
+            false, &estimate, &half_width)) {
+        // the sample was good enough
+        *average = estimate;
+    } else {
+        half_width = 0.0;
+        if (query->operator_fields.average_operator.generalized_column.column_type == RESULT) {
+            // result type
+            results = (int*) query->operator_fields.average_operator.generalized_column.column_pointer.result->payload;
+        } else {
+            // column type
+            results = (int*) query->operator_fields.average_operator.generalized_column.column_pointer.column->data;
+        }
+        // sum the results
+        total = sum(results, num_results);
+        log_info("TOTAL: %d\n", total);
+        log_info("NUMBER OF RESULTS: %d\n", num_results);
+        *average = (long double) total / (double) num_results;
+    }
 
     // create the result obj
     Result* result_obj = malloc(sizeof(Result));
     result_obj->num_tuples = 1;
     result_obj->payload = average;
     result_obj->data_type = DOUBLE;
+    result_obj->bitvector_ints = -1;
     result_obj->is_posn_vector = false;
 
     // wrap the results appropriately
@@ -699,6 +884,7 @@ void db_average(DbOperator* query, message* send_message) {
     result_wrapper.generalized_column.column_pointer.result = result_obj;
     // add this value to the client context variable pool
     add_to_client_context(query->context, result_wrapper);
+    store_aggregate_error(query->context, query->operator_fields.average_operator.error_handle, half_width);
     log_info("AVERAGE: %f\n", *average);
 
     const char* result_message = "average successful";
@@ -709,6 +895,60 @@ void db_average(DbOperator* query, message* send_message) {
     return;
 }
 
+/* 
+ * this answers an exact avg, sum, min or max from totals gathered while its
+ * input was being produced, so the input doesn't need a pass of its own
+ */
+void db_aggregate_from_totals(DbOperator* query, long total, int min, int max, message* send_message) {
+    log_info("calling db_aggregate_from_totals\n");
+    Result* result_obj = malloc(sizeof(Result));
+    result_obj->num_tuples = 1;
+    result_obj->bitvector_ints = -1;
+    result_obj->is_posn_vector = false;
+    char* handle;
+    const char* result_message;
+    if (query->type == AVERAGE) {
+        double* average = malloc(1 * sizeof(double));
+        *average = (long double) total / (double) query->operator_fields.average_operator.num_results;
+        result_obj->payload = average;
+        result_obj->data_type = DOUBLE;
+        handle = query->operator_fields.average_operator.handle;
+        result_message = "average successful";
+    } else if (query->type == SUM) {
+        long* sum_total = malloc(1 * sizeof(long));
+        *sum_total = total;
+        // account for situations where we are adding 0 elements
+        if (query->operator_fields.sum_operator.num_results == 0) {
+            result_obj->num_tuples = 0;
+        }
+        result_obj->payload = sum_total;
+        result_obj->data_type = LONG;
+        handle = query->operator_fields.sum_operator.handle;
+        result_message = "sum successful";
+    } else {
+        int* extreme = malloc(1 * sizeof(int));
+        *extreme = query->type == MIN ? min : max;
+        result_obj->payload = extreme;
+        result_obj->data_type = INT;
+        handle = query->type == MIN ? query->operator_fields.min_operator.handle : query->operator_fields.max_operator.handle;
+        result_message = query->type == MIN ? "min successful" : "max successful";
+    }
+
+    // wrap the results appropriately
+    GeneralizedColumnHandle result_wrapper;
+    strcpy(result_wrapper.name, handle);
+    result_wrapper.generalized_column.column_type = RESULT;
+    result_wrapper.generalized_column.column_pointer.result = result_obj;
+    // add this value to the client context variable pool
+    add_to_client_context(query->context, result_wrapper);
+
+    char* result_message_ptr = malloc(strlen(result_message) + 1);
+    strcpy(result_message_ptr, result_message);
+    send_message->payload = result_message_ptr;
+    send_message->status = OK_DONE;
+    return;
+}
+
 /* 
  * this adds the results in two columns
  */
@@ -735,29 +975,24 @@ void db_add(DbOperator* query, message* send_message, int mult_factor) {
         arr2 = (int*) query->operator_fields.add_operator.generalized_column2.column_pointer.column->data;
     }
 
-    int* final_results = malloc(sizeof(int) * num_results);
-
-    for (int i = 0; i < num_results; ++i) {
-        final_results[i] = arr1[i] + (mult_factor * arr2[i]);
-    }
-
-    // create the result obj
-    Result* result_obj = malloc(sizeof(Result));
-    result_obj->num_tuples = num_results;
-    result_obj->payload = final_results;
-    result_obj->data_type = INT;
-    result_obj->is_posn_vector = false;
-
-    // wrap the results appropriately
-    GeneralizedColumnHandle result_wrapper;
-    // add name, total to result_wrapper
-    strcpy(result_wrapper.name, query->operator_fields.add_operator.handle);
-    // update type
-    result_wrapper.generalized_column.column_type = RESULT;
-    // add the result
-    result_wrapper.generalized_column.column_pointer.result = result_obj;
-    // add this value to the client context variable pool
-    add_to_client_context(query->context, result_wrapper);
+    // evaluate as the expression arr1 +/- arr2 so we share its vectorized
+    // kernel and can overwrite the old buffer of the handle in place
+    ExprNode nodes[3];
+    nodes[0].type = EXPR_OPERATION;
+    nodes[0].op = mult_factor == 1 ? '+' : '-';
+    nodes[0].left = 1;
+    nodes[0].right = 2;
+    nodes[1].type = EXPR_VECTOR;
+    nodes[1].data = arr1;
+    nodes[2].type = EXPR_VECTOR;
+    nodes[2].data = arr2;
+    ExpressionOperator expression;
+    expression.nodes = nodes;
+    expression.num_nodes = 3;
+    expression.root = 0;
+    expression.num_results = num_results;
+    strcpy(expression.handle, query->operator_fields.add_operator.handle);
+    store_expression_result(&expression, query->context);
 
     const char* result_message = "add successful";
     char* result_message_ptr = malloc(strlen(result_message) + 1);
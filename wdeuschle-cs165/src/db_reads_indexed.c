@@ -4,6 +4,7 @@
 #include "cs165_api.h"
 #include "utils.h"
 #include "db_helpers.h"
+#include "btree.h"
 
 #define STARTING_RESULT_CAPACITY 4096
 
@@ -115,7 +116,8 @@ int* sorted_data_entry_select_range(DataEntry* data, int low_value, int high_val
     // now start is the starting index of qualifying values
 
     int current_idx = start;
-    while (data[current_idx].value < high_value) {
+    // stop at the end of the index as well
+    while (current_idx < num_entries && data[current_idx].value < high_value) {
         // check if we need to resize our position_vector
         if (results_count == current_pos_vector_sz) {
             // resize
@@ -132,6 +134,91 @@ int* sorted_data_entry_select_range(DataEntry* data, int low_value, int high_val
     return position_vector;
 }
 
+/* 
+ * returns the number of values less than value in a sorted array of data, or
+ * of DataEntry's if entries is given
+ */
+static int sorted_count_less_than(int* data, DataEntry* entries, int num_records, int value) {
+    int low = 0;
+    int high = num_records;
+    while (low < high) {
+        int middle_idx = low + ((high - low) / 2);
+        int middle_val = entries == NULL ? data[middle_idx] : entries[middle_idx].value;
+        if (middle_val < value) {
+            low = middle_idx + 1;
+        } else {
+            high = middle_idx;
+        }
+    }
+    return low;
+}
+
+/* 
+ * this function counts the values in [low_value, high_value) of a column
+ * through its index, without building a result. sorted data is binary
+ * searched, an unclustered btree is counted by walking its leaves across
+ * the range a leaf at a time
+ */
+int index_count_range(Column* column, int num_entries, int low_value, int high_value) {
+    if (low_value >= high_value) {
+        return 0;
+    }
+    if (column->clustered || column->index_type == SORTED) {
+        // a clustered column is sorted itself
+        DataEntry* entries = column->clustered ? NULL : (DataEntry*) column->index;
+        return sorted_count_less_than(column->data, entries, num_entries, high_value) -
+               sorted_count_less_than(column->data, entries, num_entries, low_value);
+    }
+
+    int first_idx;
+    Node* current_node = btree_gte_probe((BTree*) column->index, low_value, &first_idx);
+    if (current_node == NULL || first_idx == -1) {
+        // found nothing
+        return 0;
+    }
+    int count = 0;
+    int current_idx = first_idx;
+    while (current_node != NULL) {
+        // whole leaves below high_value count without looking at each entry
+        if (current_node->num_entries == 0 ||
+            current_node->payload.data[current_node->num_entries - 1].value < high_value) {
+            count += current_node->num_entries - current_idx;
+            current_node = current_node->next;
+            current_idx = 0;
+            continue;
+        }
+        while (current_node->payload.data[current_idx].value < high_value) {
+            ++count;
+            ++current_idx;
+        }
+        break;
+    }
+    return count;
+}
+
+/* 
+ * this function finds the first index at or after start holding a value
+ * greater than or equal to value, in sorted data or, if entries isn't NULL,
+ * a sorted index of DataEntry's. it gallops out from start before binary
+ * searching, so looking up increasing values walks the data in order
+ */
+int sorted_index_gte_from(int* data, DataEntry* entries, int start, int num_records, int value) {
+    // double the step until we pass value (or the end)
+    int low = start;
+    int step = 1;
+    while (low + step <= num_records) {
+        int probe_val = entries == NULL ? data[low + step - 1] : entries[low + step - 1].value;
+        if (probe_val >= value) {
+            break;
+        }
+        low += step;
+        step *= 2;
+    }
+    int high = low + step < num_records ? low + step : num_records;
+    return low + sorted_count_less_than(entries == NULL ? data + low : NULL,
+        entries == NULL ? NULL : entries + low, high - low, value);
+}
+
 /* 
  * this function takes a start and end value, and marks the values in between
  * them (inclusive) as present (1) in the bit vector result
@@ -247,3 +334,52 @@ int* pos_vector_from_bv(int* bv, int num_bv_ints) {
     }
     return position_vector;
 }
+
+/*
+ * this function decodes up to max_positions set bits of a bitvector into positions, picking
+ * up where the last call left off. bv_idx and current_bits hold that state
+ * and should start at -1 and 0. returns the number of positions decoded
+ */
+int next_bitvector_positions(int* bv, int num_bv_ints, int* bv_idx,
+    unsigned int* current_bits, int* positions, int max_positions) {
+    int num_positions = 0;
+    while (num_positions < max_positions) {
+        // skip ahead to the next int with a bit set
+        while (*current_bits == 0) {
+            if (++(*bv_idx) >= num_bv_ints) {
+                return num_positions;
+            }
+            *current_bits = bv[*bv_idx];
+        }
+        // lowest set bit is the next position, then clear it
+        positions[num_positions++] = (*bv_idx * BITS_PER_INT) + __builtin_ctz(*current_bits);
+        *current_bits &= *current_bits - 1;
+    }
+    return num_positions;
+}
+
+/*
+ * this function sets up the state next_bitvector_positions works from so
+ * that the first position it decodes is the one after the first skip set
+ * bits of a bitvector
+ */
+void seek_bitvector_positions(int* bv, int num_bv_ints, int skip, int* bv_idx, unsigned int* current_bits) {
+    // count whole ints until we reach the one holding the bit we want
+    for (int i = 0; i < num_bv_ints; ++i) {
+        int bits_set = __builtin_popcount((unsigned int) bv[i]);
+        if (skip < bits_set) {
+            // clear the bits in this int that come before it
+            unsigned int bits = bv[i];
+            for (; skip > 0; --skip) {
+                bits &= bits - 1;
+            }
+            *bv_idx = i;
+            *current_bits = bits;
+            return;
+        }
+        skip -= bits_set;
+    }
+    // fewer bits set than skip, there's nothing left to decode
+    *bv_idx = num_bv_ints;
+    *current_bits = 0;
+}
@@ -0,0 +1,138 @@
+#include <math.h>
+#include <string.h>
+#include "db_sample.h"
+#include "utils.h"
+
+// xorshift state for picking which rows get replaced
+static unsigned long long sample_random_state = 0x9E3779B97F4A7C15ULL;
+
+/*
+ * returns a random number in [0, bound)
+ */
+static size_t sample_random(size_t bound) {
+    sample_random_state ^= sample_random_state >> 12;
+    sample_random_state ^= sample_random_state << 25;
+    sample_random_state ^= sample_random_state >> 27;
+    return (size_t) ((sample_random_state * 0x2545F4914F6CDD1DULL) % bound);
+}
+
+/*
+ * returns the slot the next row seen should go in, or -1 if it stays out of
+ * the sample (algorithm R)
+ */
+static int sample_next_slot(Table* table) {
+    if (table->sample == NULL) {
+        // column by column, TABLE_SAMPLE_CAPACITY values per column
+        table->sample = malloc(sizeof(int) * table->col_capacity * TABLE_SAMPLE_CAPACITY);
+    }
+    size_t rows_seen = table->sample_rows_seen++;
+    if (table->sample_size < (size_t) TABLE_SAMPLE_CAPACITY) {
+        return (int) table->sample_size++;
+    }
+    size_t slot = sample_random(rows_seen + 1);
+    return slot < (size_t) TABLE_SAMPLE_CAPACITY ? (int) slot : -1;
+}
+
+/* 
+ * this function offers a newly inserted row to its table's reservoir sample.
+ * must be called before the table size is incremented
+ */
+void table_sample_offer(Table* table, int* row) {
+    // a stale sample is rebuilt wholesale when it's next needed
+    if (table->sample_rows_seen != table->table_size) {
+        return;
+    }
+    int slot = sample_next_slot(table);
+    if (slot == -1) {
+        return;
+    }
+    for (size_t i = 0; i < table->col_capacity; ++i) {
+        table->sample[(i * TABLE_SAMPLE_CAPACITY) + slot] = row[i];
+    }
+}
+
+/* 
+ * this function marks a table's sample as out of date, it gets rebuilt the
+ * next time an approximate aggregate needs it
+ */
+void table_sample_invalidate(Table* table) {
+    table->sample_size = 0;
+    table->sample_rows_seen = 0;
+}
+
+/*
+ * rebuilds a stale sample with one pass over the table
+ */
+static void table_sample_refresh(Table* table) {
+    if (table->sample_rows_seen == table->table_size) {
+        return;
+    }
+    log_info("rebuilding sample for table: %s\n", table->name);
+    table_sample_invalidate(table);
+    for (size_t row = 0; row < table->table_size; ++row) {
+        int slot = sample_next_slot(table);
+        if (slot == -1) {
+            continue;
+        }
+        for (size_t i = 0; i < table->col_size; ++i) {
+            table->sample[(i * TABLE_SAMPLE_CAPACITY) + slot] = table->columns[i].data[row];
+        }
+    }
+}
+
+/* 
+ * this function estimates the average or sum of a column from its table's
+ * sample, setting the estimate and the half width of its confidence interval.
+ * returns false if the interval is wider than max_relative_error allows
+ */
+bool sample_estimate(Table* table, Column* column, bool is_sum, double max_relative_error,
+    double* estimate, double* half_width) {
+    table_sample_refresh(table);
+    size_t num_rows = table->table_size;
+    size_t sample_size = table->sample_size;
+    if (sample_size == 0) {
+        return false;
+    }
+    int* values = table->sample + ((column - table->columns) * TABLE_SAMPLE_CAPACITY);
+
+    // mean and variance of the sample
+    long total = 0;
+    for (size_t i = 0; i < sample_size; ++i) {
+        total += values[i];
+    }
+    double mean = (double) total / (double) sample_size;
+    double squared_deviations = 0.0;
+    for (size_t i = 0; i < sample_size; ++i) {
+        double deviation = values[i] - mean;
+        squared_deviations += deviation * deviation;
+    }
+    double variance = sample_size > 1 ? squared_deviations / (double) (sample_size - 1) : 0.0;
+
+    // standard error of the mean, corrected for sampling without replacement
+    // from a finite table. a sample of the whole table has no error at all
+    double population_correction = 1.0 - ((double) sample_size / (double) num_rows);
+    double standard_error = sqrt((variance / (double) sample_size) * population_correction);
+
+    *estimate = is_sum ? mean * (double) num_rows : mean;
+    *half_width = SAMPLE_CONFIDENCE_Z * standard_error * (is_sum ? (double) num_rows : 1.0);
+    log_info("ESTIMATE: %f +/- %f from %zu of %zu rows\n", *estimate, *half_width, sample_size, num_rows);
+    return *half_width <= max_relative_error * fabs(*estimate);
+}
+
+/* 
+ * this function estimates the fraction of a column's values in [low, high)
+ * from its table's sample. returns -1 if the table has no sample
+ */
+double sample_selectivity(Table* table, Column* column, long low, long high) {
+    table_sample_refresh(table);
+    size_t sample_size = table->sample_size;
+    if (sample_size == 0) {
+        return -1.0;
+    }
+    int* values = table->sample + ((column - table->columns) * TABLE_SAMPLE_CAPACITY);
+    size_t num_matches = 0;
+    for (size_t i = 0; i < sample_size; ++i) {
+        num_matches += values[i] >= low && values[i] < high;
+    }
+    return (double) num_matches / (double) sample_size;
+}
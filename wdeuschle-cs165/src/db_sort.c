@@ -0,0 +1,425 @@
+#include <limits.h>
+#include <string.h>
+#include "db_sort.h"
+#include "client_context.h"
+#include "utils.h"
+#include "db_helpers.h"
+#include "btree.h"
+#include "db_reads_indexed.h"
+
+// past this k a heap stops paying off, sort everything and take a prefix
+#define TOPK_HEAP_MAX 4096
+#define SORT_KEY_BITS 32
+#define SORT_SIGN_FLIP 0x80000000u
+// don't spin up a thread for less than this many values
+#define SORT_MIN_VALUES_PER_THREAD ((int) 1 << 16)
+#define SORT_MAX_THREADS 4
+
+/*
+ * returns whether entry a comes before entry b in the sort order. ascending
+ * breaks ties on the earlier position, descending is the exact reverse
+ */
+static bool sort_entry_before(SortEntry a, SortEntry b, bool descending) {
+    if (descending) {
+        return a.value > b.value || (a.value == b.value && a.pos > b.pos);
+    }
+    return a.value < b.value || (a.value == b.value && a.pos < b.pos);
+}
+
+/*
+ * restores the heap below idx. the root of our heaps is the entry that comes
+ * last, so it's the one to evict when something better shows up
+ */
+static void heap_sift_down(SortEntry* heap, int heap_size, int idx, bool descending) {
+    while (true) {
+        int last = idx;
+        int left = (2 * idx) + 1;
+        int right = left + 1;
+        if (left < heap_size && sort_entry_before(heap[last], heap[left], descending)) {
+            last = left;
+        }
+        if (right < heap_size && sort_entry_before(heap[last], heap[right], descending)) {
+            last = right;
+        }
+        if (last == idx) {
+            return;
+        }
+        SortEntry tmp = heap[idx];
+        heap[idx] = heap[last];
+        heap[last] = tmp;
+        idx = last;
+    }
+}
+
+/*
+ * adds an entry to a heap with room for it
+ */
+static void heap_push(SortEntry* heap, int* heap_size, SortEntry entry, bool descending) {
+    int idx = (*heap_size)++;
+    heap[idx] = entry;
+    // move up while our parent comes before us
+    while (idx > 0 && sort_entry_before(heap[(idx - 1) / 2], heap[idx], descending)) {
+        SortEntry tmp = heap[idx];
+        heap[idx] = heap[(idx - 1) / 2];
+        heap[(idx - 1) / 2] = tmp;
+        idx = (idx - 1) / 2;
+    }
+}
+
+/*
+ * offers an entry to a heap holding the best k entries so far
+ */
+static void heap_offer(SortEntry* heap, int* heap_size, int k, SortEntry entry, bool descending) {
+    if (*heap_size < k) {
+        heap_push(heap, heap_size, entry, descending);
+    } else if (sort_entry_before(entry, heap[0], descending)) {
+        // better than the worst we're keeping, replace it
+        heap[0] = entry;
+        heap_sift_down(heap, *heap_size, 0, descending);
+    }
+}
+
+/*
+ * this function keeps the best k values of a thread's slice in a heap
+ */
+void* topk_heap_slice(void* task_void) {
+    TopKTask* task = (TopKTask*) task_void;
+    task->heap_size = 0;
+    for (int i = task->start; i < task->end; ++i) {
+        SortEntry entry;
+        entry.value = task->values[i];
+        entry.pos = i;
+        heap_offer(task->heap, &(task->heap_size), task->k, entry, task->descending);
+    }
+    return NULL;
+}
+
+/*
+ * this function counts the radix digits of a thread's slice
+ */
+void* radix_sort_histogram(void* task_void) {
+    RadixSortTask* task = (RadixSortTask*) task_void;
+    memset(task->histogram, 0, sizeof(task->histogram));
+    for (int i = task->start; i < task->end; ++i) {
+        task->histogram[(task->keys_in[i] >> task->shift) & (SORT_RADIX_BUCKETS - 1)]++;
+    }
+    return NULL;
+}
+
+/*
+ * this function scatters a thread's slice to the offsets in its histogram
+ */
+void* radix_sort_scatter(void* task_void) {
+    RadixSortTask* task = (RadixSortTask*) task_void;
+    for (int i = task->start; i < task->end; ++i) {
+        int digit = (task->keys_in[i] >> task->shift) & (SORT_RADIX_BUCKETS - 1);
+        int destination = task->histogram[digit]++;
+        task->keys_out[destination] = task->keys_in[i];
+        task->positions_out[destination] = task->positions_in[i];
+    }
+    return NULL;
+}
+
+/*
+ * this function returns the number of threads worth using to radix sort
+ * num_values values
+ */
+int sort_num_threads(int num_values) {
+    int num_threads = num_values / SORT_MIN_VALUES_PER_THREAD;
+    if (num_threads > SORT_MAX_THREADS) {
+        return SORT_MAX_THREADS;
+    }
+    return num_threads < 1 ? 1 : num_threads;
+}
+
+/*
+ * this function sorts values ascending, stable, with a parallel LSD radix
+ * sort. positions start as 0...n - 1 and are carried along with the values.
+ * returns 0 on success and -1 on failure
+ */
+int radix_sort(int* values, int num_values, int* sorted_values, int* sorted_positions) {
+    // ping pong between two copies of the keys and positions
+    unsigned int* keys[2];
+    int* positions[2];
+    for (int i = 0; i < 2; ++i) {
+        keys[i] = malloc(sizeof(unsigned int) * (num_values + 1));
+        positions[i] = malloc(sizeof(int) * (num_values + 1));
+    }
+    // flip the sign bit so negative values sort before positive ones
+    for (int i = 0; i < num_values; ++i) {
+        keys[0][i] = (unsigned int) values[i] ^ SORT_SIGN_FLIP;
+        positions[0][i] = i;
+    }
+
+    int num_threads = sort_num_threads(num_values);
+    RadixSortTask tasks[num_threads];
+    int current = 0;
+    int failure = 0;
+    for (int shift = 0; shift < SORT_KEY_BITS && failure == 0; shift += SORT_RADIX_BITS) {
+        for (int t = 0; t < num_threads; ++t) {
+            tasks[t].keys_in = keys[current];
+            tasks[t].positions_in = positions[current];
+            tasks[t].keys_out = keys[current ^ 1];
+            tasks[t].positions_out = positions[current ^ 1];
+            tasks[t].start = (int) (((long) num_values * t) / num_threads);
+            tasks[t].end = (int) (((long) num_values * (t + 1)) / num_threads);
+            tasks[t].shift = shift;
+        }
+        failure = run_in_threads(radix_sort_histogram, tasks, sizeof(RadixSortTask), num_threads);
+        if (failure != 0) {
+            break;
+        }
+
+        // turn the counts into write offsets, thread by thread within a digit
+        // so the sort stays stable. if one digit holds everything this pass
+        // wouldn't move anything, so skip it
+        bool skip_pass = false;
+        int running_offset = 0;
+        for (int digit = 0; digit < SORT_RADIX_BUCKETS; ++digit) {
+            int digit_total = 0;
+            for (int t = 0; t < num_threads; ++t) {
+                int count = tasks[t].histogram[digit];
+                tasks[t].histogram[digit] = running_offset;
+                running_offset += count;
+                digit_total += count;
+            }
+            if (digit_total == num_values) {
+                skip_pass = true;
+            }
+        }
+        if (skip_pass) {
+            continue;
+        }
+        failure = run_in_threads(radix_sort_scatter, tasks, sizeof(RadixSortTask), num_threads);
+        current ^= 1;
+    }
+
+    if (failure == 0) {
+        for (int i = 0; i < num_values; ++i) {
+            sorted_values[i] = (int) (keys[current][i] ^ SORT_SIGN_FLIP);
+        }
+        memcpy(sorted_positions, positions[current], sizeof(int) * num_values);
+    }
+    for (int i = 0; i < 2; ++i) {
+        free(keys[i]);
+        free(positions[i]);
+    }
+    return failure;
+}
+
+/*
+ * the best k values of a column, read straight off its index. returns false
+ * if the column has no index to read them from
+ */
+static bool sort_from_index(Column* column, int num_values, int k, bool descending, int* values, int* positions) {
+    if (column->index_type == NO_INDEX) {
+        return false;
+    }
+    if (column->clustered) {
+        // the base data is kept in sorted order
+        for (int i = 0; i < k; ++i) {
+            int idx = descending ? num_values - 1 - i : i;
+            values[i] = column->data[idx];
+            positions[i] = idx;
+        }
+    } else if (column->index_type == SORTED) {
+        // (value, pos) pairs kept in sorted order
+        DataEntry* entries = (DataEntry*) column->index;
+        for (int i = 0; i < k; ++i) {
+            DataEntry entry = entries[descending ? num_values - 1 - i : i];
+            values[i] = entry.value;
+            positions[i] = entry.pos;
+        }
+    } else {
+        // walk the leaves of the btree, from whichever end we need
+        int idx;
+        Node* node = btree_gte_probe((BTree*) column->index, INT_MIN, &idx);
+        if (node == NULL || idx == -1) {
+            return k == 0;
+        }
+        if (descending) {
+            while (node->next != NULL) {
+                node = node->next;
+            }
+            idx = node->num_entries - 1;
+        }
+        int i = 0;
+        while (i < k && node != NULL) {
+            if (idx < 0 || idx >= node->num_entries) {
+                node = descending ? node->prev : node->next;
+                idx = descending && node != NULL ? node->num_entries - 1 : 0;
+                continue;
+            }
+            values[i] = node->payload.data[idx].value;
+            positions[i] = node->payload.data[idx].pos;
+            ++i;
+            idx += descending ? -1 : 1;
+        }
+        // an index that disagrees with the table is no use to us
+        return i == k;
+    }
+    return true;
+}
+
+/*
+ * the best k values of a vector by keeping a heap per thread, then merging
+ * the heaps. returns 0 on success and -1 on failure
+ */
+static int topk_with_heaps(int* data, int num_values, int k, bool descending, int* values, int* positions) {
+    int num_threads = sort_num_threads(num_values);
+    TopKTask tasks[num_threads];
+    for (int t = 0; t < num_threads; ++t) {
+        tasks[t].values = data;
+        tasks[t].start = (int) (((long) num_values * t) / num_threads);
+        tasks[t].end = (int) (((long) num_values * (t + 1)) / num_threads);
+        tasks[t].k = k;
+        tasks[t].descending = descending;
+        tasks[t].heap = malloc(sizeof(SortEntry) * (k + 1));
+    }
+    int failure = run_in_threads(topk_heap_slice, tasks, sizeof(TopKTask), num_threads);
+
+    if (failure == 0) {
+        // merge every thread's candidates into the first thread's heap
+        SortEntry* heap = tasks[0].heap;
+        int heap_size = tasks[0].heap_size;
+        for (int t = 1; t < num_threads; ++t) {
+            for (int i = 0; i < tasks[t].heap_size; ++i) {
+                heap_offer(heap, &heap_size, k, tasks[t].heap[i], descending);
+            }
+        }
+        // heap sort: pull the last entry off the root into the back
+        for (int size = heap_size; size > 1; --size) {
+            SortEntry tmp = heap[0];
+            heap[0] = heap[size - 1];
+            heap[size - 1] = tmp;
+            heap_sift_down(heap, size - 1, 0, descending);
+        }
+        for (int i = 0; i < heap_size; ++i) {
+            values[i] = heap[i].value;
+            positions[i] = heap[i].pos;
+        }
+    }
+    for (int t = 0; t < num_threads; ++t) {
+        free(tasks[t].heap);
+    }
+    return failure;
+}
+
+/*
+ * the best k values of a vector by radix sorting all of it. returns 0 on
+ * success and -1 on failure
+ */
+static int topk_with_radix_sort(int* data, int num_values, int k, bool descending, int* values, int* positions) {
+    int* sorted_values = malloc(sizeof(int) * (num_values + 1));
+    int* sorted_positions = malloc(sizeof(int) * (num_values + 1));
+    int failure = radix_sort(data, num_values, sorted_values, sorted_positions);
+    if (failure == 0) {
+        // descending is the ascending order read backwards
+        for (int i = 0; i < k; ++i) {
+            int idx = descending ? num_values - 1 - i : i;
+            values[i] = sorted_values[idx];
+            positions[i] = sorted_positions[idx];
+        }
+    }
+    free(sorted_values);
+    free(sorted_positions);
+    return failure;
+}
+
+/*
+ * turns the indexes of sorted values back into the rows of the result's
+ * source positions, a bitvector or a position vector with one per value
+ */
+static void map_sorted_positions(Result* source, int num_values, int* positions, int k) {
+    int* rows = (int*) source->payload;
+    int* decoded = NULL;
+    if (result_is_bitvector(source)) {
+        decoded = malloc(sizeof(int) * (num_values + 1));
+        int bv_idx = -1;
+        unsigned int current_bits = 0;
+        next_bitvector_positions(rows, source->bitvector_ints, &bv_idx, &current_bits, decoded, num_values);
+        rows = decoded;
+    }
+    for (int i = 0; i < k; ++i) {
+        positions[i] = rows[positions[i]];
+    }
+    free(decoded);
+}
+
+/*
+ * this function sorts a column or result, or keeps only its first k values,
+ * storing the values and the rows they came from in the client context
+ */
+void db_sort(DbOperator* query, message* send_message) {
+    log_info("calling db_sort\n");
+    SortOperator* sort_operator = &(query->operator_fields.sort_operator);
+    int num_values = sort_operator->num_results;
+    int k = sort_operator->k < num_values ? sort_operator->k : num_values;
+    bool descending = sort_operator->descending;
+
+    int* values = malloc(sizeof(int) * (k + 1));
+    int* positions = malloc(sizeof(int) * (k + 1));
+    int failure = 0;
+    if (sort_operator->generalized_column.column_type == COLUMN &&
+        sort_from_index(sort_operator->generalized_column.column_pointer.column, num_values, k, descending, values, positions)) {
+        log_info("sorted off an index\n");
+    } else {
+        int* data = sort_operator->generalized_column.column_type == RESULT ?
+            (int*) sort_operator->generalized_column.column_pointer.result->payload :
+            sort_operator->generalized_column.column_pointer.column->data;
+        if (k <= TOPK_HEAP_MAX && k < num_values) {
+            failure = topk_with_heaps(data, num_values, k, descending, values, positions);
+        } else {
+            failure = topk_with_radix_sort(data, num_values, k, descending, values, positions);
+        }
+    }
+
+    if (failure != 0) {
+        free(values);
+        free(positions);
+        const char* result_message = "sort failed to run its threads";
+        char* result_message_ptr = malloc(strlen(result_message) + 1);
+        strcpy(result_message_ptr, result_message);
+        send_message->payload = result_message_ptr;
+        send_message->status = EXECUTION_ERROR;
+        return;
+    }
+
+    // a result's indexes only mean something next to its values
+    if (sort_operator->positions != NULL) {
+        map_sorted_positions(sort_operator->positions, num_values, positions, k);
+    }
+
+    // create the result objs
+    Result* value_result = malloc(sizeof(Result));
+    value_result->num_tuples = k;
+    value_result->payload = values;
+    value_result->data_type = INT;
+    value_result->bitvector_ints = -1;
+    value_result->is_posn_vector = true; // not a bitvector, one value per tuple
+    Result* position_result = malloc(sizeof(Result));
+    position_result->num_tuples = k;
+    position_result->payload = positions;
+    position_result->data_type = INT;
+    position_result->bitvector_ints = -1;
+    position_result->is_posn_vector = true;
+
+    // wrap the results appropriately and add them to the client context
+    GeneralizedColumnHandle value_wrapper;
+    strcpy(value_wrapper.name, sort_operator->value_handle);
+    value_wrapper.generalized_column.column_type = RESULT;
+    value_wrapper.generalized_column.column_pointer.result = value_result;
+    add_to_client_context(query->context, value_wrapper);
+    GeneralizedColumnHandle position_wrapper;
+    strcpy(position_wrapper.name, sort_operator->position_handle);
+    position_wrapper.generalized_column.column_type = RESULT;
+    position_wrapper.generalized_column.column_pointer.result = position_result;
+    add_to_client_context(query->context, position_wrapper);
+
+    const char* result_message = "sort successful";
+    char* result_message_ptr = malloc(strlen(result_message) + 1);
+    strcpy(result_message_ptr, result_message);
+    send_message->payload = result_message_ptr;
+    send_message->status = OK_DONE;
+    return;
+}
@@ -6,6 +6,7 @@
 #include "db_helpers.h"
 #include "btree.h"
 #include "db_reads_indexed.h"
+#include "db_sample.h"
 
 
 /* 
@@ -128,6 +129,9 @@ void insert_row(Table* table, int* input_values) {
         }
     }
 
+    // keep the table's sample up to date
+    table_sample_offer(table, input_values);
+
     // update the table size
     table->table_size++;
 
@@ -215,6 +219,9 @@ int* delete_row(Table* table, Result* row_to_delete) {
         }
     }
 
+    // a sample can't forget a row, so start it over
+    table_sample_invalidate(table);
+
     // now decrement the number of entries in the table
     --table->table_size;
     // return the deleted row
@@ -293,6 +300,18 @@ void db_delete(DbOperator* query, message* send_message) {
     return;
 }
         
+/*
+ * comparison function for ordering data entries by value, then position
+ */
+static int compare_data_entries(const void* a, const void* b) {
+    const DataEntry* entry_a = (const DataEntry*) a;
+    const DataEntry* entry_b = (const DataEntry*) b;
+    if (entry_a->value != entry_b->value) {
+        return (entry_a->value > entry_b->value) - (entry_a->value < entry_b->value);
+    }
+    return (entry_a->pos > entry_b->pos) - (entry_a->pos < entry_b->pos);
+}
+
 /* 
  * this function updates btree indexes after a table load
  */
@@ -331,20 +350,32 @@ void btree_update_for_indexed_table(Table* table) {
                 // this tree needs updating
                 assert(current_col != NULL);
                 assert(btree != NULL);
-                // so this btree needs updating. iterate through every item in the
-                // column, updating the pos of that element in the btree as we go
-                for (unsigned int i = 0; i < table->table_size; ++i) {
-                    int current_val = current_col->data[i]; // get this value
-                    // get the node and index with this value from the btree
-                    int node_idx = -1;
-                    // get the node and index
-                    Node* this_node = btree_gte_probe(btree, current_val, &node_idx);
-                    assert(node_idx != -1);
-                    // needs to be the same
-                    assert(this_node->payload.data[node_idx].value == current_val);
-                    // update the position associated with this value
-                    this_node->payload.data[node_idx].pos = i;
+                // so this btree needs updating. its leaves hold the column's
+                // values in sorted order, so pair them with the column's
+                // positions sorted by value. probing for each value instead
+                // would hand every duplicate's position to the same entry
+                int num_rows = (int) table->table_size;
+                DataEntry* entries = malloc(sizeof(DataEntry) * (num_rows + 1));
+                for (int i = 0; i < num_rows; ++i) {
+                    entries[i].value = current_col->data[i];
+                    entries[i].pos = i;
+                }
+                qsort(entries, num_rows, sizeof(DataEntry), compare_data_entries);
+                Node* current_node = btree->root;
+                while (!current_node->is_leaf) {
+                    current_node = current_node->payload.signposts[0].node_pointer;
+                }
+                int entry_idx = 0;
+                while (current_node) {
+                    for (int i = 0; i < current_node->num_entries; ++i) {
+                        // needs to be the same
+                        assert(current_node->payload.data[i].value == entries[entry_idx].value);
+                        current_node->payload.data[i].pos = entries[entry_idx++].pos;
+                    }
+                    current_node = current_node->next;
                 }
+                assert(entry_idx == num_rows);
+                free(entries);
             }
         }
     }
@@ -0,0 +1,190 @@
+#define _GNU_SOURCE
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "hardware.h"
+#include "utils.h"
+
+#define CACHE_SYSFS_PATH "/sys/devices/system/cpu/cpu0/cache"
+#define MAX_CACHE_LEVEL 3
+
+/*
+ * reads a cgroup's cpu quota as a whole number of cpus, rounding up. returns
+ * 0 if there is no quota
+ */
+static int cgroup_cpu_limit(void) {
+    long quota = -1;
+    long period = 0;
+    // cgroup v2 keeps both in one file: "<quota|max> <period>"
+    FILE* fp = fopen("/sys/fs/cgroup/cpu.max", "r");
+    if (fp != NULL) {
+        char quota_str[32];
+        if (fscanf(fp, "%31s %ld", quota_str, &period) == 2 && strcmp(quota_str, "max") != 0) {
+            quota = atol(quota_str);
+        }
+        fclose(fp);
+    } else {
+        // cgroup v1 splits them up, with -1 for no quota
+        fp = fopen("/sys/fs/cgroup/cpu/cpu.cfs_quota_us", "r");
+        if (fp != NULL) {
+            if (fscanf(fp, "%ld", &quota) != 1) {
+                quota = -1;
+            }
+            fclose(fp);
+        }
+        fp = fopen("/sys/fs/cgroup/cpu/cpu.cfs_period_us", "r");
+        if (fp != NULL) {
+            if (fscanf(fp, "%ld", &period) != 1) {
+                period = 0;
+            }
+            fclose(fp);
+        }
+    }
+    if (quota <= 0 || period <= 0) {
+        return 0;
+    }
+    return (int) ((quota + period - 1) / period);
+}
+
+/* 
+ * this function returns how many cpus this process may run on, taking its
+ * affinity mask and any cgroup cpu quota into account
+ */
+int available_cpus(void) {
+    // doesn't change under us, only look it up once
+    static int num_cpus = 0;
+    if (num_cpus > 0) {
+        return num_cpus;
+    }
+    cpu_set_t cpu_set;
+    int count = 0;
+    if (sched_getaffinity(0, sizeof(cpu_set), &cpu_set) == 0) {
+        count = CPU_COUNT(&cpu_set);
+    }
+    if (count <= 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        count = online > 0 ? (int) online : 1;
+    }
+    int limit = cgroup_cpu_limit();
+    if (limit > 0 && limit < count) {
+        count = limit;
+    }
+    log_info("available cpus: %d\n", count);
+    num_cpus = count;
+    return num_cpus;
+}
+
+/*
+ * reads one of a cache's sysfs attributes into buffer. returns false if it
+ * doesn't exist
+ */
+static bool read_cache_attribute(int index, const char* attribute, char* buffer, int buffer_size) {
+    char path[128];
+    snprintf(path, sizeof(path), "%s/index%d/%s", CACHE_SYSFS_PATH, index, attribute);
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL) {
+        return false;
+    }
+    bool success = fgets(buffer, buffer_size, fp) != NULL;
+    fclose(fp);
+    return success;
+}
+
+/* 
+ * this function returns the size in bytes of the data cache at a level
+ * (1, 2 or 3), as reported by sysfs for the first cpu
+ */
+long cache_size(int level) {
+    // doesn't change under us, only look it up once
+    static long sizes[MAX_CACHE_LEVEL + 1];
+    static bool looked_up = false;
+    if (!looked_up) {
+        sizes[1] = DEFAULT_L1_CACHE_SIZE;
+        sizes[2] = DEFAULT_L2_CACHE_SIZE;
+        sizes[3] = DEFAULT_L3_CACHE_SIZE;
+        char level_str[16];
+        char type_str[32];
+        char size_str[32];
+        for (int index = 0; read_cache_attribute(index, "level", level_str, sizeof(level_str)); ++index) {
+            int cache_level = atoi(level_str);
+            if (cache_level < 1 || cache_level > MAX_CACHE_LEVEL ||
+                !read_cache_attribute(index, "type", type_str, sizeof(type_str)) ||
+                strncmp(type_str, "Instruction", 11) == 0 ||
+                !read_cache_attribute(index, "size", size_str, sizeof(size_str))) {
+                continue;
+            }
+            // sizes look like "48K" or "32M"
+            char* unit;
+            long size = strtol(size_str, &unit, 10);
+            if (*unit == 'K') {
+                size <<= 10;
+            } else if (*unit == 'M') {
+                size <<= 20;
+            } else if (*unit == 'G') {
+                size <<= 30;
+            }
+            if (size > 0) {
+                sizes[cache_level] = size;
+            }
+        }
+        log_info("caches: L1 %ld, L2 %ld, L3 %ld\n", sizes[1], sizes[2], sizes[3]);
+        looked_up = true;
+    }
+    if (level < 1 || level > MAX_CACHE_LEVEL) {
+        return 0;
+    }
+    return sizes[level];
+}
+
+/*
+ * reads a single number of bytes from a cgroup file. returns -1 if it can't
+ * be read or there's no limit ("max")
+ */
+static long read_cgroup_bytes(const char* path) {
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL) {
+        return -1;
+    }
+    long bytes = -1;
+    if (fscanf(fp, "%ld", &bytes) != 1) {
+        bytes = -1;
+    }
+    fclose(fp);
+    return bytes;
+}
+
+/* 
+ * this function returns how many bytes of memory we could still allocate
+ * without swapping: what the system reports as available, or what's left
+ * under our cgroup's memory limit if that's less. returns -1 if neither
+ * can be read
+ */
+long available_memory(void) {
+    // changes as we go, so it's read fresh every time
+    long available = -1;
+    FILE* fp = fopen("/proc/meminfo", "r");
+    if (fp != NULL) {
+        char line[128];
+        long kilobytes;
+        while (fgets(line, sizeof(line), fp) != NULL) {
+            if (sscanf(line, "MemAvailable: %ld kB", &kilobytes) == 1) {
+                available = kilobytes << 10;
+                break;
+            }
+        }
+        fclose(fp);
+    }
+    // cgroup v2 only, v1 keeps the limit far from where we'd look
+    long limit = read_cgroup_bytes("/sys/fs/cgroup/memory.max");
+    long usage = read_cgroup_bytes("/sys/fs/cgroup/memory.current");
+    if (limit > 0 && usage >= 0) {
+        long left = limit > usage ? limit - usage : 0;
+        if (available < 0 || left < available) {
+            available = left;
+        }
+    }
+    return available;
+}
@@ -1,6 +1,7 @@
 #include <stdlib.h>
 #include <limits.h>
 #include <stdbool.h>
+#include <string.h>
 
 #include "hash_table.h"
 
@@ -9,6 +10,8 @@ int generateNextDoubledPrime(int prevPrime);
 int hashingFn(keyType key, int size);
 
 #define HT_SIZE_RATIO 0.6 // the ratio that determines when we resize our hash table, can play with this to find a nice balance
+#define AGG_HASH_BATCH 256 // number of keys we hash ahead of probing in the aggregation table
+#define JOIN_HASH_BATCH 256 // number of keys we hash ahead of placing or probing them in the join table
 
 // Initialize the components of a hashtable.
 // The size parameter is the expected number of elements to be inserted.
@@ -274,3 +277,340 @@ int deallocate(hashtable* ht) {
 
     return 0;
 }
+
+// find the slot holding a key, or the empty slot where it belongs. linear
+// probing from the home slot given by the top bits of the hash (after
+// skipping the bits every key in this table shares)
+static inline int aggSlot(aggtable* at, unsigned int hash, keyType key) {
+    int mask = at->size - 1;
+    int idx = (int) ((hash << at->skip_bits) >> (32 - at->log_size));
+    // stop on the first empty slot or on a match
+    while (at->array[idx].count != 0 && at->array[idx].key != key) {
+        idx = (idx + 1) & mask;
+    }
+    return idx;
+}
+
+// double the number of slots in an aggregation table and rehash every group
+static void aggResize(aggtable* at) {
+    aggTableEntry* oldArray = at->array; // soon-to-be-deprecated slots
+    int oldSize = at->size;
+    at->size = oldSize * 2;
+    at->log_size++;
+    at->array = calloc(at->size, sizeof(aggTableEntry));
+    for (int i = 0; i < oldSize; i++) {
+        if (oldArray[i].count != 0) {
+            // groups are unique, so we can copy the entry straight into its new slot
+            int idx = aggSlot(at, multiplicative_hash(oldArray[i].key), oldArray[i].key);
+            at->array[idx] = oldArray[i];
+        }
+    }
+    free(oldArray);
+}
+
+// Initialize an aggregation table able to hold size groups before it needs to
+// grow. skip_bits is the number of high hash bits all keys share (e.g. because
+// they were partitioned on them), so we index on the bits below them.
+// This method returns an error code, 0 for success and -1 otherwise.
+int agg_allocate(aggtable** at, int size, int skip_bits) {
+    *at = (aggtable*) malloc(sizeof(aggtable));
+    if (*at == NULL) {
+        return -1;
+    }
+    (*at)->num_entries = 0;
+    (*at)->skip_bits = skip_bits;
+    // smallest power of two that keeps us under our load ratio
+    (*at)->size = 16;
+    (*at)->log_size = 4;
+    while ((*at)->size * AGG_TABLE_RATIO < size) {
+        (*at)->size *= 2;
+        (*at)->log_size++;
+    }
+    (*at)->array = calloc((*at)->size, sizeof(aggTableEntry));
+    if ((*at)->array == NULL) {
+        free(*at);
+        return -1;
+    }
+    return 0;
+}
+
+// This method folds a vector of key-value pairs into the aggregation table. We
+// hash a block of keys in one tight loop before probing so the multiplies
+// pipeline instead of waiting behind each probe's cache miss.
+// It returns an error code, 0 for success and -1 otherwise.
+int agg_update_batch(aggtable* at, keyType* keys, valType* values, int num_values) {
+    unsigned int hashes[AGG_HASH_BATCH];
+    for (int start = 0; start < num_values; start += AGG_HASH_BATCH) {
+        int end = start + AGG_HASH_BATCH < num_values ? start + AGG_HASH_BATCH : num_values;
+        // make sure every key in this block fits without a resize mid block
+        while (at->num_entries + (end - start) > at->size * AGG_TABLE_RATIO) {
+            aggResize(at);
+        }
+        // hash the whole block first
+        for (int i = start; i < end; i++) {
+            hashes[i - start] = multiplicative_hash(keys[i]);
+        }
+        // then probe and fold in each value
+        for (int i = start; i < end; i++) {
+            aggTableEntry* entry = &(at->array[aggSlot(at, hashes[i - start], keys[i])]);
+            int value = values[i];
+            if (entry->count == 0) {
+                // first value for this group
+                entry->key = keys[i];
+                entry->min = value;
+                entry->max = value;
+                entry->sum = 0;
+                at->num_entries++;
+            }
+            entry->count++;
+            entry->sum += value;
+            entry->min = value < entry->min ? value : entry->min;
+            entry->max = value > entry->max ? value : entry->max;
+        }
+    }
+    return 0;
+}
+
+// This method folds an already aggregated entry (e.g. from another table) into
+// the aggregation table.
+// It returns an error code, 0 for success and -1 otherwise.
+int agg_merge(aggtable* at, aggTableEntry* entry) {
+    if (at->num_entries + 1 > at->size * AGG_TABLE_RATIO) {
+        aggResize(at);
+    }
+    aggTableEntry* slot = &(at->array[aggSlot(at, multiplicative_hash(entry->key), entry->key)]);
+    if (slot->count == 0) {
+        // new group, take the entry as is
+        *slot = *entry;
+        at->num_entries++;
+    } else {
+        slot->count += entry->count;
+        slot->sum += entry->sum;
+        slot->min = entry->min < slot->min ? entry->min : slot->min;
+        slot->max = entry->max > slot->max ? entry->max : slot->max;
+    }
+    return 0;
+}
+
+// This method empties an aggregation table without giving up its slots.
+// It returns an error code, 0 for success and -1 otherwise.
+int agg_clear(aggtable* at) {
+    memset(at->array, 0, at->size * sizeof(aggTableEntry));
+    at->num_entries = 0;
+    return 0;
+}
+
+// This method frees all memory occupied by the aggregation table.
+// It returns an error code, 0 for success and -1 otherwise.
+int agg_deallocate(aggtable* at) {
+    free(at->array);
+    free(at);
+    return 0;
+}
+
+// is a slot in the join table in use
+static inline bool joinOccupied(jointable* jt, int idx) {
+    return (jt->occupied[idx >> 5] >> (idx & 31)) & 1;
+}
+
+// Initialize a join table able to hold size pairs. Joins know their build side
+// up front, so the table never grows. skip_bits is the number of high hash
+// bits all keys share (e.g. because they were radix partitioned on them).
+// This method returns an error code, 0 for success and -1 otherwise.
+int join_allocate(jointable** jt, int size, int skip_bits) {
+    *jt = (jointable*) malloc(sizeof(jointable));
+    if (*jt == NULL) {
+        return -1;
+    }
+    (*jt)->num_entries = 0;
+    (*jt)->num_values = 0;
+    (*jt)->capacity = size;
+    (*jt)->skip_bits = skip_bits;
+    // smallest power of two that keeps us under our load ratio if every key
+    // is distinct, never fewer slots than there are bits in one occupancy word
+    (*jt)->size = 32;
+    (*jt)->log_size = 5;
+    while ((*jt)->size * JOIN_TABLE_RATIO < size) {
+        (*jt)->size *= 2;
+        (*jt)->log_size++;
+    }
+    (*jt)->array = malloc((*jt)->size * sizeof(joinTableEntry));
+    (*jt)->occupied = calloc((*jt)->size / 32, sizeof(unsigned int));
+    (*jt)->values = malloc((size + 1) * sizeof(valType));
+    if ((*jt)->array == NULL || (*jt)->occupied == NULL || (*jt)->values == NULL) {
+        free((*jt)->array);
+        free((*jt)->occupied);
+        free((*jt)->values);
+        free(*jt);
+        return -1;
+    }
+    return 0;
+}
+
+// This method builds the join table from a vector of key-value pairs. Like
+// the aggregation table we hash a block of keys before placing any of them.
+// Each distinct key takes one slot, counting its pairs, and once every pair
+// is counted each key's values are laid out together in the order given.
+// It returns an error code, 0 for success and -1 otherwise (e.g. if the pairs
+// don't fit in the size the table was allocated for, or it was already built).
+int join_build(jointable* jt, keyType* keys, valType* values, int num_values) {
+    if (jt->num_values != 0 || num_values > jt->capacity) {
+        return -1;
+    }
+    // the slot each pair's key ended up in, so values can be placed without
+    // probing again
+    int* slots = malloc((num_values + 1) * sizeof(int));
+    if (slots == NULL) {
+        return -1;
+    }
+    unsigned int hashes[JOIN_HASH_BATCH];
+    int mask = jt->size - 1;
+    for (int start = 0; start < num_values; start += JOIN_HASH_BATCH) {
+        int end = start + JOIN_HASH_BATCH < num_values ? start + JOIN_HASH_BATCH : num_values;
+        // hash the whole block and start pulling in each home slot
+        for (int i = start; i < end; i++) {
+            hashes[i - start] = (multiplicative_hash(keys[i]) << jt->skip_bits) >> (32 - jt->log_size);
+            __builtin_prefetch(&(jt->occupied[hashes[i - start] >> 5]), 1);
+            __builtin_prefetch(&(jt->array[hashes[i - start]]), 1);
+        }
+        // then walk to the key's slot, or the first free one
+        for (int i = start; i < end; i++) {
+            keyType key = keys[i];
+            int idx = (int) hashes[i - start];
+            while (joinOccupied(jt, idx) && jt->array[idx].key != key) {
+                idx = (idx + 1) & mask;
+            }
+            if (!joinOccupied(jt, idx)) {
+                jt->occupied[idx >> 5] |= 1u << (idx & 31);
+                jt->array[idx].key = key;
+                jt->array[idx].count = 0;
+                jt->num_entries++;
+            }
+            jt->array[idx].count++;
+            slots[i] = idx;
+        }
+    }
+    // give each key a run of the values array, then fill the runs in
+    int offset = 0;
+    for (int idx = 0; idx < jt->size; idx++) {
+        if (joinOccupied(jt, idx)) {
+            jt->array[idx].offset = offset;
+            offset += jt->array[idx].count;
+            // counts back up again as the run is filled
+            jt->array[idx].count = 0;
+        }
+    }
+    for (int i = 0; i < num_values; i++) {
+        joinTableEntry* entry = &(jt->array[slots[i]]);
+        jt->values[entry->offset + entry->count++] = values[i];
+    }
+    jt->num_values = num_values;
+    free(slots);
+    return 0;
+}
+
+// This method probes the join table with a vector of keys. For every stored
+// pair whose key matches keys[i] it appends values[i] to probe_matches and the
+// stored value to build_matches, growing both (and match_capacity) as needed.
+// A key's pairs are all found by one probe, in the order they were built.
+// num_matches is how many pairs are in the match arrays, and is added to.
+// It returns an error code, 0 for success and -1 otherwise.
+int join_probe_batch(jointable* jt, keyType* keys, valType* values, int num_keys,
+    valType** probe_matches, valType** build_matches, int* match_capacity, int* num_matches) {
+    unsigned int hashes[JOIN_HASH_BATCH];
+    int mask = jt->size - 1;
+    for (int start = 0; start < num_keys; start += JOIN_HASH_BATCH) {
+        int end = start + JOIN_HASH_BATCH < num_keys ? start + JOIN_HASH_BATCH : num_keys;
+        // hash the whole block and start pulling in each home slot
+        for (int i = start; i < end; i++) {
+            hashes[i - start] = (multiplicative_hash(keys[i]) << jt->skip_bits) >> (32 - jt->log_size);
+            __builtin_prefetch(&(jt->occupied[hashes[i - start] >> 5]));
+            __builtin_prefetch(&(jt->array[hashes[i - start]]));
+        }
+        // then walk each probe sequence until the key or a free slot
+        for (int i = start; i < end; i++) {
+            keyType key = keys[i];
+            int idx = (int) hashes[i - start];
+            while (joinOccupied(jt, idx) && jt->array[idx].key != key) {
+                idx = (idx + 1) & mask;
+            }
+            if (!joinOccupied(jt, idx)) {
+                continue;
+            }
+            joinTableEntry* entry = &(jt->array[idx]);
+            // grow once for all of the key's matches if necessary
+            if (*num_matches + entry->count > *match_capacity) {
+                int new_capacity = *match_capacity == 0 ? JOIN_HASH_BATCH : 2 * *match_capacity;
+                if (new_capacity < *num_matches + entry->count) {
+                    new_capacity = *num_matches + entry->count;
+                }
+                valType* new_probe_matches = realloc(*probe_matches, new_capacity * sizeof(valType));
+                if (new_probe_matches == NULL) {
+                    return -1;
+                }
+                *probe_matches = new_probe_matches;
+                valType* new_build_matches = realloc(*build_matches, new_capacity * sizeof(valType));
+                if (new_build_matches == NULL) {
+                    return -1;
+                }
+                *build_matches = new_build_matches;
+                *match_capacity = new_capacity;
+            }
+            valType* run = jt->values + entry->offset;
+            for (int j = 0; j < entry->count; j++) {
+                (*probe_matches)[*num_matches + j] = values[i];
+                (*build_matches)[*num_matches + j] = run[j];
+            }
+            *num_matches += entry->count;
+        }
+    }
+    return 0;
+}
+
+// This method frees all memory occupied by the join table.
+// It returns an error code, 0 for success and -1 otherwise.
+int join_deallocate(jointable* jt) {
+    free(jt->array);
+    free(jt->occupied);
+    free(jt->values);
+    free(jt);
+    return 0;
+}
+
+// Initialize a bloom filter sized for num_keys keys, with no keys in it.
+// This method returns an error code, 0 for success and -1 otherwise.
+int bloom_allocate(bloomfilter** bf, int num_keys) {
+    *bf = (bloomfilter*) malloc(sizeof(bloomfilter));
+    if (*bf == NULL) {
+        return -1;
+    }
+    // smallest power of two number of words with the bits we want per key,
+    // at least 2 so the word's hash shift stays under 64
+    (*bf)->log_size = 1;
+    while ((1l << (*bf)->log_size) * 64 < (long) num_keys * BLOOM_BITS_PER_KEY) {
+        (*bf)->log_size++;
+    }
+    (*bf)->words = calloc(1l << (*bf)->log_size, sizeof(unsigned long));
+    if ((*bf)->words == NULL) {
+        free(*bf);
+        return -1;
+    }
+    return 0;
+}
+
+// This method adds a vector of keys to the bloom filter.
+// It returns an error code, 0 for success and -1 otherwise.
+int bloom_insert_batch(bloomfilter* bf, keyType* keys, int num_keys) {
+    for (int i = 0; i < num_keys; i++) {
+        bf->words[bloomWord(bf, keys[i])] |= bloomMask(keys[i]);
+    }
+    return 0;
+}
+
+// This method frees all memory occupied by the bloom filter.
+// It returns an error code, 0 for success and -1 otherwise.
+int bloom_deallocate(bloomfilter* bf) {
+    free(bf->words);
+    free(bf);
+    return 0;
+}
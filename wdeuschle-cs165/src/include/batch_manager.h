@@ -4,7 +4,19 @@
 #include <stdbool.h>
 #include "cs165_api.h"
 
+// starting number of dbo slots in a batch, grows as needed
+#define SHARED_QUERY_START_SIZE 16
 
+/*
+ * the knobs a shared scan runs with. a chunk_size or num_threads of 0 means
+ * chunks sized by the caches, over the whole worker pool
+ */
+typedef struct SharedScanTuning {
+    int chunk_size; // values each task scans
+    int queries_per_task; // most queries a task checks its chunk against
+    int tasks_per_thread; // tasks we aim for per thread
+    int num_threads; // threads a scan runs on
+} SharedScanTuning;
 
 /*
  * add_shared_dbo receives a dbo to add to the batch of queries to be processed together
@@ -46,4 +58,48 @@ void execute_shared_scan_bitvector(DbOperator* shared_dbo, message* send_message
  */
 void execute_shared_scan(DbOperator* shared_dbo, message* send_message);
 
+/*
+ * this function calibrates shared scans on a synthetic column, so they're
+ * tuned for this machine. the first shared scan calls it
+ */
+void shared_scan_calibrate(void);
+
+/*
+ * this function recalibrates shared scans on a column of the database, for
+ * the tune command
+ */
+void shared_scan_tune(DbOperator* query, message* send_message);
+
+/*
+ * this function runs whatever is waiting for a cooperative scan that the
+ * next command might read, before the command is parsed. an aggregate over
+ * a waiting fetch waits along with it, in which case this returns true and
+ * fills in send_message. so does an error from a statement that waited,
+ * which is reported in place of this command's reply, and the command
+ * doesn't run
+ */
+bool cooperative_scan_before_command(const char* command, ClientContext* context, message* send_message);
+
+/*
+ * this function holds back a select over a column, or a fetch at
+ * a bitvector's positions, so it can share a scan with the ones that come
+ * after it. returns true if the query is now waiting, or was dropped to
+ * report an error from one that waited before it, in which case it owns
+ * the dbo and fills in send_message
+ */
+bool cooperative_scan_offer(DbOperator* query, message* send_message);
+
+/*
+ * this function runs the selects and fetches waiting for a cooperative
+ * scan, storing their results in the client context. an error from one of
+ * them is reported on the next command
+ */
+void cooperative_scan_flush(ClientContext* context);
+
+/*
+ * this function drops the selects, fetches and aggregates waiting for a
+ * cooperative scan, for when their client is gone
+ */
+void cooperative_scan_discard(void);
+
 #endif
@@ -11,6 +11,12 @@ Column* lookup_column(char *table_name, char* column_name);
  */
 int lookup_column_idx(char* table_name, char* column_name);
 Result* lookup_handle_result(char* handle, ClientContext* context);
+/*
+ * This function returns the result stored under a handle if its buffer can be
+ * overwritten in place by a new int value vector of num_tuples entries.
+ * Returns NULL if there is no such result.
+ */
+Result* lookup_reusable_result(char* handle, int num_tuples, ClientContext* context);
 void add_to_client_context(ClientContext* context, GeneralizedColumnHandle result_wrapper);
 
 #endif
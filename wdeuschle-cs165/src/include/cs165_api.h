@@ -34,11 +34,24 @@ SOFTWARE.
 #define HANDLE_MAX_SIZE 64
 #define BITVECTOR_DB 1
 #define BINARY_DB 1
+// hold back selects and fetches so the ones that follow can share their
+// scan, 0 runs every statement as it arrives
+#ifndef COOPERATIVE_SCANS
+#define COOPERATIVE_SCANS 1
+#endif
 #define INT 1
 #define LONG 2
 #define DOUBLE 3
 #define NESTED_LOOP_JOIN 1
 #define HASH_JOIN 2
+#define SORT_MERGE_JOIN 3
+#define INDEX_JOIN 4
+#define AUTO_JOIN 5
+#define GROUP_BY_SUM 1
+#define GROUP_BY_AVG 2
+#define GROUP_BY_MIN 3
+#define GROUP_BY_MAX 4
+#define GROUP_BY_COUNT 5
 
 extern bool keep_server_alive;
 // track whether we are loading a table with a btree index
@@ -95,6 +108,11 @@ typedef struct Column {
  * - columns, this is the pointer to an array of columns contained in the table.
  * - table_capacity, the capacity of the columns in the table.
  * - table_size, the current size of the columns in the table.
+ * - sample, a reservoir sample of the table's rows for approximate
+ *     aggregates, stored column by column.
+ * - sample_size, the number of rows currently in the sample.
+ * - sample_rows_seen, the number of rows offered to the sample. the sample
+ *     is only up to date while this matches table_size.
  **/
 
 typedef struct Table {
@@ -104,6 +122,9 @@ typedef struct Table {
     size_t col_size;
     size_t table_capacity;
     size_t table_size;
+    int* sample;
+    size_t sample_size;
+    size_t sample_rows_seen;
 } Table;
 
 // track if we are loading an indexed table
@@ -234,6 +255,7 @@ typedef enum OperatorType {
     OPEN,
     SELECT,
     FETCH,
+    FETCH_MANY,
     JOIN,
     AVERAGE,
     SUM,
@@ -241,10 +263,14 @@ typedef enum OperatorType {
     MAX,
     ADD,
     SUB,
+    GROUP_BY,
+    EXPRESSION,
+    SORT,
     SHUTDOWN,
     SHARED_QUERY_LOGGED,
     SHARED_SCAN,
     PRINT,
+    TUNE,
 } OperatorType;
 
 /*
@@ -317,15 +343,40 @@ typedef struct FetchOperator {
     Column* column;
     char handle[HANDLE_MAX_SIZE];
 } FetchOperator;
+/*
+ * necessary fields for fetching several columns of a table at the same
+ * positions
+ */
+typedef struct FetchManyOperator {
+    Column** columns;
+    int num_columns;
+    Result* ids_result;
+    // num_columns handles, HANDLE_MAX_SIZE apart. NULL if the rows should go
+    // straight to the client instead
+    char* handles;
+} FetchManyOperator;
 /*
  * necessary fields for joining
  */
 typedef struct JoinOperator {
-    int join_type; // NESTED_LOOP_JOIN or HASH_JOIN
+    // NESTED_LOOP_JOIN, HASH_JOIN, SORT_MERGE_JOIN, INDEX_JOIN, or AUTO_JOIN
+    // to have the planner pick one
+    int join_type;
     Result* pos1_result;
     Result* val1_result;
     Result* pos2_result;
     Result* val2_result;
+    // an index join probes one side's index instead of reading its values.
+    // that side is given as its column (and its val result is NULL)
+    Column* column1;
+    int column1_entries; // number of rows in column1's table
+    Column* column2;
+    int column2_entries;
+    // hand back the set of joined rows on each side as bitvectors, rather
+    // than a pair of positions per match
+    bool bitvector_output;
+    // describe how the join would run instead of running it
+    bool explain;
     char left_handle[HANDLE_MAX_SIZE];
     char right_handle[HANDLE_MAX_SIZE];
 } JoinOperator;
@@ -336,6 +387,12 @@ typedef struct AverageOperator {
     GeneralizedColumn generalized_column;
     int num_results;
     char handle[HANDLE_MAX_SIZE];
+    // largest relative error we'll accept from a sampled estimate, 0 for
+    // an exact answer. table is only set for a column
+    double approx;
+    Table* table;
+    // where to put the confidence interval half width, empty if unwanted
+    char error_handle[HANDLE_MAX_SIZE];
 } AverageOperator;
 /*
  * necessary fields for summing
@@ -344,6 +401,12 @@ typedef struct SumOperator {
     GeneralizedColumn generalized_column;
     int num_results;
     char handle[HANDLE_MAX_SIZE];
+    // largest relative error we'll accept from a sampled estimate, 0 for
+    // an exact answer. table is only set for a column
+    double approx;
+    Table* table;
+    // where to put the confidence interval half width, empty if unwanted
+    char error_handle[HANDLE_MAX_SIZE];
 } SumOperator;
 /*
  * necessary fields for min
@@ -371,6 +434,67 @@ typedef struct AddOperator {
     int num_results2;
     char handle[HANDLE_MAX_SIZE];
 } AddOperator;
+/*
+ * necessary fields for sorting, or keeping only the first k values of a sort
+ */
+typedef struct SortOperator {
+    GeneralizedColumn generalized_column;
+    Result* positions; // the rows a result's values came from, NULL for a column
+    int num_results;
+    int k; // number of values to keep, num_results for a full sort
+    bool descending;
+    char value_handle[HANDLE_MAX_SIZE];
+    char position_handle[HANDLE_MAX_SIZE];
+} SortOperator;
+/*
+ * the kinds of node in an arithmetic expression tree
+ */
+typedef enum ExprNodeType {
+    EXPR_CONSTANT,
+    EXPR_VECTOR,
+    EXPR_OPERATION
+} ExprNodeType;
+/*
+ * a node in an arithmetic expression tree. nodes live in one flat array and
+ * refer to their children by index
+ */
+typedef struct ExprNode {
+    ExprNodeType type;
+    char op; // '+', '-', '*' or '/' for operations
+    int constant; // the value of a constant
+    int* data; // the values of a vector (a column or result)
+    int left; // index of the left operand of an operation
+    int right; // index of the right operand of an operation
+} ExprNode;
+/*
+ * necessary fields for evaluating an arithmetic expression
+ */
+typedef struct ExpressionOperator {
+    ExprNode* nodes; // every node in the tree
+    int num_nodes;
+    int root; // index of the root node in nodes
+    int num_results; // length of every vector in the expression
+    char handle[HANDLE_MAX_SIZE];
+} ExpressionOperator;
+/*
+ * necessary fields for grouping values by key and aggregating each group
+ */
+typedef struct GroupByOperator {
+    int agg_type; // GROUP_BY_SUM, GROUP_BY_AVG, GROUP_BY_MIN, GROUP_BY_MAX or GROUP_BY_COUNT
+    GeneralizedColumn keys;
+    GeneralizedColumn values;
+    int num_results;
+    char key_handle[HANDLE_MAX_SIZE];
+    char agg_handle[HANDLE_MAX_SIZE];
+} GroupByOperator;
+/*
+ * necessary fields for tuning shared scans, on a column or, without one, on
+ * a synthetic column
+ */
+typedef struct TuneOperator {
+    Column* column;
+    int num_entries;
+} TuneOperator;
 /*
  * necessary fields for printing
  */
@@ -399,13 +523,18 @@ typedef union OperatorFields {
     OpenOperator open_operator;
     SelectOperator select_operator;
     FetchOperator fetch_operator;
+    FetchManyOperator fetch_many_operator;
     JoinOperator join_operator;
     AverageOperator average_operator;
     SumOperator sum_operator;
     MinOperator min_operator;
     MaxOperator max_operator;
     AddOperator add_operator;
+    GroupByOperator group_by_operator;
+    ExpressionOperator expression_operator;
+    SortOperator sort_operator;
     PrintOperator print_operator;
+    TuneOperator tune_operator;
 } OperatorFields;
 /*
  * DbOperator holds the following fields:
@@ -424,14 +553,13 @@ typedef struct DbOperator {
 /*
  * SharedScanDbOperators holds the necessary information to batch queries together
  * num_dbos - the number of DbOperators we have accumulated for a shared scan
- * dbos - array of DbOperator pointers that need to be executed
+ * dbos - array of DbOperator pointers that need to be executed, the selects
+ *        may be over any columns of any tables
  */
 typedef struct SharedScanDbOperators {
     int num_dbos;
     int dbo_slots;
     DbOperator** dbos;
-    Column* col;
-    int num_entries;
 } SharedScanDbOperators;
 
 extern Db *current_db;
@@ -0,0 +1,44 @@
+#ifndef DB_EXPRESSION_H
+#define DB_EXPRESSION_H
+
+#include <stdbool.h>
+#include "cs165_api.h"
+
+/*
+ * an evaluated operand for one batch: either a pointer to the batch's values
+ * or a single constant standing in for all of them
+ */
+typedef struct ExprOperand {
+    int* data;
+    int constant;
+    bool is_constant;
+} ExprOperand;
+
+/* 
+ * this function applies op elementwise to two operands over num_values values,
+ * writing to out. division by zero evaluates to 0 and is counted in
+ * num_divide_by_zero
+ */
+void expression_apply(char op, ExprOperand left, ExprOperand right, int* out, int num_values, int* num_divide_by_zero);
+
+/* 
+ * this function evaluates an expression tree one cache sized batch at a time,
+ * writing only the final values to output. returns the number of divisions
+ * by zero encountered
+ */
+int evaluate_expression(ExpressionOperator* expression, int* output);
+
+/* 
+ * this function evaluates an expression and stores it in the client context,
+ * overwriting the old buffer of the handle in place when it has the right
+ * size. returns the number of divisions by zero encountered
+ */
+int store_expression_result(ExpressionOperator* expression, ClientContext* context);
+
+/* 
+ * this function evaluates an arithmetic expression over columns, results and
+ * constants and stores the result in the client context
+ */
+void db_expression(DbOperator* query, message* send_message);
+
+#endif
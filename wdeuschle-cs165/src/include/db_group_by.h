@@ -0,0 +1,64 @@
+#ifndef DB_GROUP_BY_H
+#define DB_GROUP_BY_H
+
+#include "cs165_api.h"
+#include "hash_table.h"
+
+// the high hash bits we partition groups on once they spill out of a
+// thread's cache resident table
+#define GROUP_BY_PARTITION_BITS 5
+#define GROUP_BY_PARTITIONS (1 << GROUP_BY_PARTITION_BITS)
+
+/*
+ * a growable run of partially aggregated groups that all fall in the same
+ * partition
+ */
+typedef struct GroupByPartition {
+    aggTableEntry* entries; // the partial aggregates
+    int num_entries; // number of entries currently in entries
+    int size; // number of slots in entries
+} GroupByPartition;
+
+/*
+ * the work a single thread does while aggregating: the morsels it owns, its
+ * private table, and the partitions it spills that table into
+ */
+typedef struct GroupByTask {
+    int* keys; // the full key vector
+    int* values; // the full value vector
+    int num_values; // number of entries in keys/values
+    int thread_id; // this thread processes morsels thread_id, thread_id + num_threads, ...
+    int num_threads; // number of threads aggregating
+    aggtable* local_table; // thread local, cache resident table
+    GroupByPartition partitions[GROUP_BY_PARTITIONS]; // spilled partial aggregates
+} GroupByTask;
+
+/*
+ * the work a single thread does while merging: every thread's spilled
+ * entries for one partition folded into one table
+ */
+typedef struct GroupByMergeTask {
+    GroupByTask* tasks; // the aggregation tasks whose partitions we merge
+    int num_tasks; // number of aggregation tasks
+    int partition; // the partition this merge task owns
+    aggtable* merged_table; // the final groups for this partition
+} GroupByMergeTask;
+
+/* 
+ * this function aggregates the morsels a thread owns into its local table,
+ * spilling to partitions whenever the table outgrows the cache
+ */
+void* group_by_aggregate_morsels(void* task_void);
+
+/* 
+ * this function merges every thread's spilled entries for a partition
+ */
+void* group_by_merge_partition(void* merge_task_void);
+
+/* 
+ * this function groups a vector of values by a vector of keys, storing one
+ * result with the distinct keys and one with the aggregate for each key
+ */
+void db_group_by(DbOperator* query, message* send_message);
+
+#endif
@@ -99,4 +99,11 @@ void delete_and_shift_down_pos(DataEntry* data, int data_sz, int row_pos);
  */
 bool has_clustered_index(Table* table);
 
+/* 
+ * this function runs fn over each of num_args args laid out arg_size bytes
+ * apart on the worker pool, and waits for them all. if there is only one we
+ * stay on the current thread. returns 0 on success and -1 on failure
+ */
+int run_in_threads(void* (*fn)(void*), void* args, size_t arg_size, int num_args);
+
 #endif /* DB_HELPERS_H */
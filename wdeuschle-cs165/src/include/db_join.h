@@ -2,60 +2,311 @@
 #define DB_JOIN_H
 
 #include "cs165_api.h"
+#include "hash_table.h"
 
-typedef struct PartitionSet {
-    int* left_partition_values; // the values from the left column
-    int* left_partition_positions; // the positions of the values in the left column
-    int left_partition_size; // the number of slots in the left_partition_values/positions array
-    int num_entries_left_partition; // the number of entries currently in left_partition_values/positions
-    // all the same meaning as for the data above
-    int* right_partition_values;
-    int* right_partition_positions;
-    int right_partition_size;
-    int num_entries_right_partition;
-} PartitionSet;
+// most partitioning passes a radix join makes over its input
+#define RADIX_MAX_PASSES 2
+// sysfs doesn't report the data TLB, this is the first level dTLB on the
+// machines we run on. a pass writing to more partitions than this misses the
+// TLB on nearly every tuple
+#define RADIX_TLB_ENTRIES 64
+// positions decoded off a bitvector at a time when reading them in step
+// with their values
+#define JOIN_POSITION_BATCH_SIZE 1024
+// join types the planner picks from, NESTED_LOOP_JOIN through INDEX_JOIN
+#define JOIN_ALGORITHMS 4
+
+/*
+ * the positions that go with one side of a join's values, in whatever form
+ * they were selected in. a position vector is read in place, a bitvector is
+ * only decoded once something needs every position at hand
+ */
+typedef struct JoinPositions {
+    int* positions; // NULL until a bitvector is decoded
+    int* bitvector; // NULL if the positions came as a position vector
+    int bitvector_ints;
+    bool owns_positions; // true if positions were decoded here
+} JoinPositions;
+
+/*
+ * how a radix join splits its input: the number of partitioning passes and
+ * the hash bits each one partitions on, most significant first
+ */
+typedef struct RadixJoinPlan {
+    int num_passes;
+    int pass_bits[RADIX_MAX_PASSES];
+    int total_bits; // the sum of pass_bits, there are 1 << total_bits partitions
+} RadixJoinPlan;
+
+/*
+ * one side of a radix join, split into partitions on the top bits of each
+ * value's hash. every partition sits in one contiguous pair of arrays,
+ * partition p being [offsets[p], offsets[p + 1])
+ */
+typedef struct RadixPartitions {
+    int* values;
+    int* positions;
+    int* offsets; // num_partitions + 1 of them
+    int num_partitions;
+    bool owns_data; // false if no passes were needed and values/positions are the input
+} RadixPartitions;
+
+/*
+ * the work a single thread does for a block nested loop join: one tile of
+ * the outer side against every block of the inner side, with result vectors
+ * of its own
+ */
+typedef struct NestedLoopJoinTask {
+    int* outer_values;
+    int* outer_positions;
+    int* inner_values;
+    int* inner_positions;
+    int inner_size;
+    int inner_block_size; // inner values compared with the tile at a time
+    int start; // this task's tile is [start, end) of the outer side
+    int end;
+    int* outer_results;
+    int* inner_results;
+    int num_results;
+} NestedLoopJoinTask;
+
+/*
+ * the work a single thread does for one radix partitioning pass over a slice
+ * of its input: count where each tuple goes, then scatter the slice to the
+ * offsets it was given
+ */
+typedef struct RadixPartitionTask {
+    int* values_in;
+    int* positions_in; // NULL if the first pass decodes them off bitvector_in
+    int* bitvector_in;
+    int bitvector_ints;
+    bloomfilter* filter; // NULL, or tuples it rules out are dropped
+    int* values_out;
+    int* positions_out;
+    int start; // this task's slice is [start, end)
+    int end;
+    int shift; // the hash bits this pass partitions on start here
+    int fanout;
+    int histogram[RADIX_TLB_ENTRIES]; // partition counts, then write offsets
+} RadixPartitionTask;
+
+/*
+ * the work a single thread does joining a run of partitions, with result
+ * vectors of its own
+ */
+typedef struct HashJoinTask {
+    RadixPartitions* left;
+    RadixPartitions* right;
+    int skip_bits; // the hash bits every key in a partition shares
+    int first_partition; // this task joins [first_partition, end_partition)
+    int end_partition;
+    bool* skewed; // partitions left out of the runs, they're joined on their own
+    int* left_results;
+    int* right_results;
+    int result_capacity;
+    int num_results;
+    int failure; // 0 on success and -1 on failure
+} HashJoinTask;
+
+/* 
+ * this function points join_positions at a join input's positions, without
+ * copying or decoding them
+ */
+void join_positions_from_result(Result* pos_result, JoinPositions* join_positions);
+
+/* 
+ * this function returns one side's positions as a position vector of
+ * num_values positions, decoding them first if they're a bitvector
+ */
+int* join_position_vector(JoinPositions* join_positions, int num_values);
+
+/* 
+ * this function frees any positions decoded for a join
+ */
+void free_join_positions(JoinPositions* join_positions);
+
+/*
+ * the work a single thread does probing a slice of an oversized partition's
+ * larger side, against a table over its smaller side that every slice shares
+ */
+typedef struct HashJoinProbeTask {
+    jointable* table;
+    int* probe_values;
+    int* probe_positions;
+    int num_probes;
+    bool probe_is_left; // which result vector the probed positions go in
+    int* left_results;
+    int* right_results;
+    int result_capacity;
+    int num_results;
+    int failure; // 0 on success and -1 on failure
+} HashJoinProbeTask;
+
+/*
+ * seconds each step of a join takes on one thread, measured on this machine
+ * by join_calibrate. estimates divide them over the threads each step
+ * would actually get
+ */
+typedef struct JoinCostModel {
+    double nested_loop_pair; // comparing one outer value to one inner value
+    double partition_tuple; // moving one tuple in a radix partitioning pass
+    double hash_tuple; // building or probing a join table with one tuple
+    double sort_tuple; // radix sorting one tuple
+    double scan_tuple; // one step of a sequential pass, like a merge
+} JoinCostModel;
+
+/*
+ * what the planner knows about one side of a join
+ */
+typedef struct JoinInputStats {
+    int num_values; // rows in the column if is_column
+    int min_value;
+    int max_value;
+    bool sorted;
+    bool is_column; // given as an indexed column, so there are no values to look at
+} JoinInputStats;
+
+/*
+ * how a join will run and why: the estimated time and memory of each
+ * algorithm, indexed by join type. an algorithm that can't run on the
+ * inputs has a cost below 0
+ */
+typedef struct JoinPlan {
+    int join_type; // the algorithm that will run
+    bool requested; // join_type was asked for, not picked
+    JoinInputStats left;
+    JoinInputStats right;
+    long estimated_results;
+    int radix_passes; // partitioning passes the hash join would make
+    double costs[JOIN_ALGORITHMS + 1];
+    long memory[JOIN_ALGORITHMS + 1]; // bytes beyond the inputs
+    long available_memory; // -1 if unknown
+} JoinPlan;
 
 /* 
  * this function handles execution of the join query by delegating to the
- * proper join function
+ * proper join function. an auto join has the planner pick it, and explain
+ * describes the plan rather than running it
  */
 void db_join(DbOperator* query, message* send_message);
 
 /* 
- * this function handles a join using a nested loop algorithm
+ * this function joins a task's tile of the outer side with the whole inner
+ * side, a cache sized block of inner values at a time, comparing each outer
+ * value with several inner values per instruction. results come back in
+ * outer order, and in inner order for each outer value
+ */
+void* nested_loop_join_tile(void* task_void);
+
+/* 
+ * this function handles a join using a block nested loop algorithm. the
+ * outer side is split into tiles that fit in L2, and each tile is run past
+ * the inner side in blocks that fit in L1, with tiles spread over the worker
+ * pool
  */
 void db_join_nested_loop(DbOperator* query, message* send_message);
 
 /* 
- * this function given a value and a number of partition buckets, returns the
- * proper bucket for that value
+ * this function picks how many partitioning passes a radix join makes, and
+ * on how many bits, so that each partition's hash table over the build side
+ * fits in L2 and each pass writes to few enough partitions to stay within
+ * the L1 cache and TLB. it makes at least min_partitions partitions if it
+ * can, so there's enough of them to go around the threads
+ */
+void plan_radix_join(int build_size, int min_partitions, RadixJoinPlan* plan);
+
+/* 
+ * this function counts where each tuple in a task's slice goes, leaving out
+ * any its filter rules out
+ */
+void* radix_partition_histogram(void* task_void);
+
+/* 
+ * this function scatters a task's slice to the offsets in its histogram.
+ * positions still in a bitvector are decoded a batch at a time as the
+ * values they go with are scattered
  */
-int get_partition_bucket(int value, int num_buckets);
+void* radix_partition_scatter(void* task_void);
 
 /* 
- * this function generates partitions from two columns so that we can
- * perform a more cache-conscious join
+ * this function splits values and their positions into partitions on the
+ * top bits of each value's hash, following plan. each pass counts its
+ * partitions' sizes first, so every tuple is written exactly once per pass.
+ * the first pass splits the input between threads, later passes give each
+ * thread partitions of their own. positions still in a bitvector are decoded
+ * by the first pass as it goes. if filter isn't NULL, the first pass drops
+ * every tuple it rules out. returns 0 on success and -1 on failure
  */
-PartitionSet* generate_partitions(
-    int* left_value_vector, int* left_position_vector, int left_size,
-    int* right_value_vector, int* right_position_vector, int right_size,
-    int num_partitions);
+int radix_partition(int* values, JoinPositions* positions, int num_values, bloomfilter* filter,
+    RadixJoinPlan* plan, RadixPartitions* partitions);
 
 /* 
- * this function frees an array of partition sets
+ * this function frees the partitions made by radix_partition
  */
-void free_partition_sets(PartitionSet* partition_set, int num_partitions);
+void free_radix_partitions(RadixPartitions* partitions);
 
 /* 
- * this function inserts join data into the left and right results, 
- * keeping data in the join in the order of left column (which is arbitryary)
- * this requires shifting data in both columns
+ * this function joins a task's run of partitions, building a hash table on
+ * the smaller side of each and probing it with the larger. skewed partitions
+ * are skipped
  */
-void insert_to_result_and_maintain_order(int* left_result_column, int left_value, int* right_result_column, int right_value, int* num_results);
+void* hash_join_partitions(void* task_void);
 
 /* 
- * this function handles a join using a hash join algorithm
+ * this function probes a task's slice of a partition against the shared
+ * table built over the partition's other side
+ */
+void* hash_join_probe_slice(void* task_void);
+
+/* 
+ * this function handles a join using a hash join algorithm. when most of the
+ * larger side can't match, a bloom filter over the smaller side drops those
+ * values while the larger side is partitioned. partitions far bigger than
+ * the rest (heavy hitters) are split further and probed by every thread
  */
 void db_join_hash(DbOperator* query, message* send_message);
 
+/* 
+ * this function gets one side of a join into value order, along with the
+ * position that goes with each value. values that are already in order
+ * (e.g. fetched off a clustered sorted column) are used as they are, and
+ * *sorted_copy is left false. returns 0 on success and -1 on failure
+ */
+int sort_join_input(int* values, int* positions, int num_values,
+    int** sorted_values, int** sorted_positions, bool* sorted_copy);
+
+/* 
+ * this function handles a join by sorting both sides (unless they already
+ * are) and merging them. results come back in value order
+ */
+void db_join_sort_merge(DbOperator* query, message* send_message);
+
+/* 
+ * this function handles a join by probing one side's index (a btree, a
+ * sorted index, or the column itself if it's clustered) with each value from
+ * the other side. the values are sorted first, so the probes walk the index
+ * in order and each distinct value is only looked up once. results come back
+ * in value order
+ */
+void db_join_index(DbOperator* query, message* send_message);
+
+/* 
+ * this function measures the join cost model on synthetic inputs, so auto
+ * joins are planned for this machine. the first join planned calls it
+ */
+void join_calibrate(void);
+
+/* 
+ * this function estimates what each join algorithm would cost on a join's
+ * inputs and, for an auto join, picks the cheapest that fits in memory.
+ * otherwise the requested algorithm is kept
+ */
+void plan_join(JoinOperator* join_operator, JoinPlan* plan);
+
+/* 
+ * this function describes a join plan for explain, one line per fact. the
+ * caller frees the string
+ */
+char* explain_join_plan(JoinPlan* plan);
+
 #endif
@@ -37,11 +37,24 @@ void db_fetch(DbOperator* query, message* send_message);
  */
 void db_fetch(DbOperator* query, message* send_message);
 
+/* 
+ * this fetches several columns at the same positions, decoding the positions
+ * once. stores one result per column, or sends the rows to the client
+ * already interleaved if no handles were given
+ */
+void db_fetch_many(DbOperator* query, message* send_message);
+
 /* 
  * this averages the results in a column
  */
 void db_average(DbOperator* query, message* send_message);
 
+/* 
+ * this answers an exact avg, sum, min or max from totals gathered while its
+ * input was being produced, so the input doesn't need a pass of its own
+ */
+void db_aggregate_from_totals(DbOperator* query, long total, int min, int max, message* send_message);
+
 /* 
  * this sums the results in a column
  */
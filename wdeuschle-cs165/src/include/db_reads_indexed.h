@@ -21,6 +21,22 @@ int sorted_column_index_lt(int* data, int num_records, int high_value);
  */
 int* sorted_data_entry_select_range(DataEntry* data, int low_value, int high_value, int num_entries, int* num_records);
 
+/* 
+ * this function counts the values in [low_value, high_value) of a column
+ * through its index, without building a result. sorted data is binary
+ * searched, an unclustered btree is counted by walking its leaves across
+ * the range a leaf at a time
+ */
+int index_count_range(Column* column, int num_entries, int low_value, int high_value);
+
+/* 
+ * this function finds the first index at or after start holding a value
+ * greater than or equal to value, in sorted data or, if entries isn't NULL,
+ * a sorted index of DataEntry's. it gallops out from start before binary
+ * searching, so looking up increasing values walks the data in order
+ */
+int sorted_index_gte_from(int* data, DataEntry* entries, int start, int num_records, int value);
+
 /* 
  * this function takes a start and end value, and marks the values in between
  * them (inclusive) as present (1) in the bit vector result
@@ -44,4 +60,19 @@ bool check_bv_position(int* bv, int pos);
  */
 int* pos_vector_from_bv(int* bv, int num_bv_ints);
 
+/*
+ * this function decodes up to max_positions set bits of a bitvector into positions, picking
+ * up where the last call left off. bv_idx and current_bits hold that state
+ * and should start at -1 and 0. returns the number of positions decoded
+ */
+int next_bitvector_positions(int* bv, int num_bv_ints, int* bv_idx,
+    unsigned int* current_bits, int* positions, int max_positions);
+
+/*
+ * this function sets up the state next_bitvector_positions works from so
+ * that the first position it decodes is the one after the first skip set
+ * bits of a bitvector
+ */
+void seek_bitvector_positions(int* bv, int num_bv_ints, int skip, int* bv_idx, unsigned int* current_bits);
+
 #endif /* DB_READS_INDEXED_H */
@@ -0,0 +1,38 @@
+#ifndef DB_SAMPLE_H
+#define DB_SAMPLE_H
+
+#include <stdbool.h>
+#include "cs165_api.h"
+
+// rows kept in each table's reservoir sample
+#define TABLE_SAMPLE_CAPACITY ((int) 1 << 14)
+// z score for the confidence intervals we report, 95%
+#define SAMPLE_CONFIDENCE_Z 1.96
+
+/* 
+ * this function offers a newly inserted row to its table's reservoir sample.
+ * must be called before the table size is incremented
+ */
+void table_sample_offer(Table* table, int* row);
+
+/* 
+ * this function marks a table's sample as out of date, it gets rebuilt the
+ * next time an approximate aggregate needs it
+ */
+void table_sample_invalidate(Table* table);
+
+/* 
+ * this function estimates the average or sum of a column from its table's
+ * sample, setting the estimate and the half width of its confidence interval.
+ * returns false if the interval is wider than max_relative_error allows
+ */
+bool sample_estimate(Table* table, Column* column, bool is_sum, double max_relative_error,
+    double* estimate, double* half_width);
+
+/* 
+ * this function estimates the fraction of a column's values in [low, high)
+ * from its table's sample. returns -1 if the table has no sample
+ */
+double sample_selectivity(Table* table, Column* column, long low, long high);
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef DB_SORT_H
+#define DB_SORT_H
+
+#include <stdbool.h>
+#include "cs165_api.h"
+
+#define SORT_RADIX_BITS 8
+#define SORT_RADIX_BUCKETS (1 << SORT_RADIX_BITS)
+
+/*
+ * a value along with the position it came from
+ */
+typedef struct SortEntry {
+    int value;
+    int pos;
+} SortEntry;
+
+/*
+ * the work a single thread does for one radix sort pass: count the digits of
+ * its slice of the input, then scatter that slice to its offsets
+ */
+typedef struct RadixSortTask {
+    unsigned int* keys_in; // keys with the sign bit flipped so they sort unsigned
+    int* positions_in;
+    unsigned int* keys_out;
+    int* positions_out;
+    int start; // this thread's slice is [start, end)
+    int end;
+    int shift; // the digit this pass sorts on
+    int histogram[SORT_RADIX_BUCKETS]; // digit counts, then write offsets
+} RadixSortTask;
+
+/*
+ * the work a single thread does for top-k: keep the best k of its slice
+ */
+typedef struct TopKTask {
+    int* values;
+    int start; // this thread's slice is [start, end)
+    int end;
+    int k;
+    bool descending;
+    SortEntry* heap; // the best k so far, worst at the root
+    int heap_size;
+} TopKTask;
+
+/* 
+ * this function counts the radix digits of a thread's slice
+ */
+void* radix_sort_histogram(void* task_void);
+
+/* 
+ * this function scatters a thread's slice to the offsets in its histogram
+ */
+void* radix_sort_scatter(void* task_void);
+
+/* 
+ * this function sorts values ascending, stable, with a parallel LSD radix
+ * sort. positions start as 0...n - 1 and are carried along with the values.
+ * returns 0 on success and -1 on failure
+ */
+int radix_sort(int* values, int num_values, int* sorted_values, int* sorted_positions);
+
+/*
+ * this function returns the number of threads worth using to radix sort
+ * num_values values
+ */
+int sort_num_threads(int num_values);
+
+/* 
+ * this function keeps the best k values of a thread's slice in a heap
+ */
+void* topk_heap_slice(void* task_void);
+
+/* 
+ * this function sorts a column or result, or keeps only its first k values,
+ * storing the values and the rows they came from in the client context
+ */
+void db_sort(DbOperator* query, message* send_message);
+
+#endif
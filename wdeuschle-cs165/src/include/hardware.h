@@ -0,0 +1,29 @@
+#ifndef HARDWARE_H
+#define HARDWARE_H
+
+// what we assume when sysfs won't tell us
+#define DEFAULT_L1_CACHE_SIZE ((long) 32 << 10)
+#define DEFAULT_L2_CACHE_SIZE ((long) 256 << 10)
+#define DEFAULT_L3_CACHE_SIZE ((long) 8 << 20)
+
+/* 
+ * this function returns how many cpus this process may run on, taking its
+ * affinity mask and any cgroup cpu quota into account
+ */
+int available_cpus(void);
+
+/* 
+ * this function returns the size in bytes of the data cache at a level
+ * (1, 2 or 3), as reported by sysfs for the first cpu
+ */
+long cache_size(int level);
+
+/* 
+ * this function returns how many bytes of memory we could still allocate
+ * without swapping: what the system reports as available, or what's left
+ * under our cgroup's memory limit if that's less. returns -1 if neither
+ * can be read
+ */
+long available_memory(void);
+
+#endif
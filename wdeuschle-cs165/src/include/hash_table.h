@@ -1,6 +1,8 @@
 #ifndef CS165_HASH_TABLE // This is a header guard. It prevents the header from being included more than once.
 #define CS165_HASH_TABLE  
 
+#include <stdbool.h>
+
 typedef int keyType;
 typedef int valType;
 
@@ -21,10 +23,109 @@ typedef struct hashtable {
     hashTableNode** array; // array for storing our elements, pointing to hashTableNode
 } hashtable;
 
+// define the entries in our aggregation table. an entry with a count of 0 is
+// empty, so we don't need a sentinel key
+typedef struct aggTableEntry {
+    keyType key; // the group key
+    int count; // number of values folded into this group
+    int min; // smallest value seen for this group
+    int max; // largest value seen for this group
+    long sum; // running total of the values for this group
+} aggTableEntry;
+
+#define AGG_TABLE_RATIO 0.5 // open addressing degrades quickly past half full
+
+// open addressing table used to aggregate values by key
+typedef struct aggtable {
+    int num_entries; // number of groups in our aggregation table
+    int size; // number of slots, always a power of two
+    int log_size; // log2 of size, used to take the top bits of the hash
+    int skip_bits; // number of high hash bits every key in this table shares
+    aggTableEntry* array; // the slots themselves, probed linearly
+} aggtable;
+
+// define the slots in our join table. each distinct key gets one slot, and
+// its values sit together in the table's values array, so a probe finds all
+// of a key's matches at once however many there are
+typedef struct joinTableEntry {
+    keyType key; // the join key
+    int count; // number of values stored under the key
+    int offset; // where the key's values start in the values array
+} joinTableEntry;
+
+#define JOIN_TABLE_RATIO 0.5 // keep probe sequences short
+
+// open addressing table used to build and probe hash joins. which slots are in
+// use is kept in its own bitmap, so any key (INT_MIN included) can be stored.
+// the table is built in one go, since a key's values have to be laid out
+// together
+typedef struct jointable {
+    int num_entries; // number of distinct keys in our join table
+    int num_values; // number of values stored, duplicates included
+    int capacity; // number of values the table was allocated for
+    int size; // number of slots, always a power of two
+    int log_size; // log2 of size, used to take the top bits of the hash
+    int skip_bits; // number of high hash bits every key in this table shares
+    joinTableEntry* array; // the slots themselves, probed linearly
+    unsigned int* occupied; // one bit per slot, set when the slot is in use
+    valType* values; // every key's values, one run per key
+} jointable;
+
+// multiplicative (fibonacci) hash, the top bits are the well mixed ones
+static inline unsigned int multiplicative_hash(keyType key) {
+    return (unsigned int) key * 2654435769u;
+}
+
+#define BLOOM_BITS_PER_KEY 16 // filter size, about a 1% false positive rate at 4 bits per key
+
+// register blocked bloom filter, used to drop probe keys that can't match a
+// join's build side. every key sets its bits in a single word, so adding or
+// checking one is a single cache miss and a mask compare
+typedef struct bloomfilter {
+    int log_size; // log2 of the number of words
+    unsigned long* words;
+} bloomfilter;
+
+// the word a key's bits go in, from the top bits of a 64 bit multiplicative
+// hash. a different multiplier than multiplicative_hash, so keys that share a
+// radix partition don't share words
+static inline int bloomWord(bloomfilter* bf, keyType key) {
+    return (int) (((unsigned long) (unsigned int) key * 0x9e3779b97f4a7c15ul) >> (64 - bf->log_size));
+}
+
+// the 4 bits a key sets in its word, 6 hash bits apiece
+static inline unsigned long bloomMask(keyType key) {
+    unsigned int hash = (unsigned int) key * 0x85ebca6bu;
+    return (1ul << (hash >> 26)) | (1ul << ((hash >> 20) & 63)) |
+        (1ul << ((hash >> 14) & 63)) | (1ul << ((hash >> 8) & 63));
+}
+
+// could key have been added to the filter
+static inline bool bloom_contains(bloomfilter* bf, keyType key) {
+    unsigned long mask = bloomMask(key);
+    return (bf->words[bloomWord(bf, key)] & mask) == mask;
+}
+
 int allocate(hashtable** ht, int size);
 int put(hashtable* ht, keyType key, valType value);
 int get(hashtable* ht, keyType key, valType *values, int num_values, int* num_results);
 int erase(hashtable* ht, keyType key);
 int deallocate(hashtable* ht);
 
+int agg_allocate(aggtable** at, int size, int skip_bits);
+int agg_update_batch(aggtable* at, keyType* keys, valType* values, int num_values);
+int agg_merge(aggtable* at, aggTableEntry* entry);
+int agg_clear(aggtable* at);
+int agg_deallocate(aggtable* at);
+
+int join_allocate(jointable** jt, int size, int skip_bits);
+int join_build(jointable* jt, keyType* keys, valType* values, int num_values);
+int join_probe_batch(jointable* jt, keyType* keys, valType* values, int num_keys,
+    valType** probe_matches, valType** build_matches, int* match_capacity, int* num_matches);
+int join_deallocate(jointable* jt);
+
+int bloom_allocate(bloomfilter** bf, int num_keys);
+int bloom_insert_batch(bloomfilter* bf, keyType* keys, int num_keys);
+int bloom_deallocate(bloomfilter* bf);
+
 #endif
@@ -30,6 +30,12 @@ int num_bitvector_ints_needed(int num_entries);
  **/
 int* bitvector_to_vector(int* bv, int num_bv_ints, int num_entries);
 
+/**
+ * Returns whether a result holds a position bitvector, as selects produce,
+ * rather than one int per tuple
+ **/
+bool result_is_bitvector(Result* result);
+
 /**
  * Computes the number of batches needed to send an entire message server to client.
  **/
@@ -0,0 +1,82 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+
+// most threads we'll work a job with, counting the thread that submits it
+#define WORKER_POOL_MAX_SIZE 256
+// starting number of task slots in each deque, grows as needed
+#define WORK_DEQUE_START_CAPACITY 64
+#define CACHE_LINE_SIZE 64
+
+/*
+ * a unit of work: a function and the argument to call it with
+ */
+typedef struct WorkerTask {
+    void* (*fn)(void*);
+    void* arg;
+} WorkerTask;
+
+/*
+ * a Chase-Lev work stealing deque. its owner pushes and takes at the bottom
+ * without locking, other threads steal from the top with a single CAS. tasks
+ * are only pushed while no job is running, so growing the array never races
+ * a thief
+ */
+typedef struct WorkDeque {
+    long top; // thieves take from here
+    char top_padding[CACHE_LINE_SIZE - sizeof(long)]; // keep thieves off the owner's line
+    long bottom; // the owner pushes and takes here
+    long capacity; // always a power of 2
+    WorkerTask* tasks;
+    char bottom_padding[CACHE_LINE_SIZE - (2 * sizeof(long)) - sizeof(WorkerTask*)];
+} WorkDeque;
+
+/*
+ * a pool of threads that live for the life of the server. each job's tasks
+ * are dealt out over one deque per thread, and threads that run dry steal
+ * from the others until the job is done
+ */
+typedef struct WorkerPool {
+    int num_workers; // not counting the thread that submits
+    pthread_t* threads;
+    WorkDeque* deques; // one per worker, then one for the submitting thread
+    int num_deques; // allocated, in case some workers failed to start
+    pthread_mutex_t lock;
+    pthread_cond_t job_ready;
+    pthread_cond_t job_done;
+    long job_id; // bumped for every job so idle workers know to wake
+    int remaining_tasks; // tasks of the current job not yet finished
+    int active_workers; // workers still looking for tasks in the current job
+    int job_threads; // threads working the current job, counting the submitter
+    bool shutdown;
+} WorkerPool;
+
+/*
+ * this function runs fn over each of num_args args laid out arg_size bytes
+ * apart on the worker pool, and waits for them all. the calling thread
+ * works on the job as well. calls made from inside a task run inline.
+ * returns 0 on success and -1 on failure
+ */
+int worker_pool_run(void* (*fn)(void*), void* args, size_t arg_size, int num_args);
+
+/*
+ * this function is worker_pool_run on at most num_threads threads, counting
+ * the calling thread. the rest of the pool sits the job out
+ */
+int worker_pool_run_on(void* (*fn)(void*), void* args, size_t arg_size, int num_args, int num_threads);
+
+/*
+ * this function returns how many threads work on each job, counting the
+ * thread that submits it. there's one per cpu we're allowed to use
+ */
+int worker_pool_threads(void);
+
+/*
+ * this function stops the worker pool's threads and frees it
+ */
+void worker_pool_shutdown(void);
+
+#endif
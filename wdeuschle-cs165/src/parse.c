@@ -29,7 +29,6 @@
 #define MAX_FLAG 'h'
 #define ADD_FLAG 'a'
 #define SUB_FLAG 's'
-#define SHARED_QUERY_START_SIZE 16
 
 
 // just declaring
@@ -454,6 +453,123 @@ DbOperator* parse_fetch(char* query_command, char* handle, message* send_message
     }
 }
 
+/**
+ * parse_fetch_many reads the arguments for a fetch_many statement, any number
+ * of columns from one table followed by the positions to fetch, and passes
+ * them on in the form of a DbOperator. With one handle per column the
+ * results are stored in the client context, without handles the rows are
+ * sent back to the client.
+ **/
+
+DbOperator* parse_fetch_many(char* query_command, char* handle, message* send_message, ClientContext* context) {
+    // check for leading '('
+    if (strncmp(query_command, "(", 1) != 0) {
+        send_message->status = UNKNOWN_COMMAND;
+        return NULL;
+    }
+    query_command++;
+    // read and chop off last char, which should be a ')'
+    int last_char = strlen(query_command) - 1;
+    if (last_char < 0 || query_command[last_char] != ')') {
+        send_message->status = INCORRECT_FORMAT;
+        return NULL;
+    }
+    query_command[last_char] = '\0';
+
+    // one more argument than commas, the last one is the positions
+    int num_arguments = 1;
+    for (int i = 0; i < last_char; ++i) {
+        if (query_command[i] == ',') {
+            ++num_arguments;
+        }
+    }
+    int num_columns = num_arguments - 1;
+    if (num_columns < 1) {
+        send_message->status = INCORRECT_FORMAT;
+        return NULL;
+    }
+
+    Column** columns = malloc(sizeof(Column*) * num_columns);
+    Table* fetch_table = NULL;
+    for (int i = 0; i < num_columns; ++i) {
+        char* table_name = strsep(&query_command, ",");
+        // split the database and table
+        split_on_period(&table_name, &send_message->status);
+        // table and column still attached
+        char* column_name = table_name;
+        table_name = split_on_period(&column_name, &send_message->status);
+        if (send_message->status == INCORRECT_FORMAT) {
+            free(columns);
+            return NULL;
+        }
+        Table* table = lookup_table(table_name);
+        columns[i] = lookup_column(table_name, column_name);
+        // every column has to come from the table the positions refer to
+        if (columns[i] == NULL || (fetch_table != NULL && table != fetch_table)) {
+            log_err("fetch_many column not found or from another table\n");
+            send_message->status = OBJECT_NOT_FOUND;
+            free(columns);
+            return NULL;
+        }
+        fetch_table = table;
+    }
+    // make sure our table isn't empty
+    if (fetch_table->table_size == 0) {
+        send_message->status = TABLE_EMPTY;
+        free(columns);
+        return NULL;
+    }
+
+    // make sure we have this ids_handle
+    Result* ids_result = lookup_handle_result(query_command, context);
+    if (ids_result == NULL) {
+        send_message->status = OBJECT_NOT_FOUND;
+        free(columns);
+        return NULL;
+    }
+
+    // one handle per column, if we were given any
+    char* handles = NULL;
+    if (handle != NULL) {
+        handles = malloc(HANDLE_MAX_SIZE * num_columns);
+        int num_handles = 0;
+        char* next_handle;
+        while ((next_handle = strsep(&handle, ",")) != NULL) {
+            if (num_handles == num_columns || strlen(next_handle) >= HANDLE_MAX_SIZE) {
+                num_handles = -1;
+                break;
+            }
+            // each column needs its own output, a repeated handle would
+            // have two columns written into one buffer
+            bool repeated = false;
+            for (int i = 0; i < num_handles; ++i) {
+                repeated = repeated || strcmp(handles + (HANDLE_MAX_SIZE * i), next_handle) == 0;
+            }
+            if (repeated) {
+                num_handles = -1;
+                break;
+            }
+            strcpy(handles + (HANDLE_MAX_SIZE * num_handles++), next_handle);
+        }
+        if (num_handles != num_columns) {
+            log_err("fetch_many needs one distinct handle per column\n");
+            send_message->status = INCORRECT_FORMAT;
+            free(columns);
+            free(handles);
+            return NULL;
+        }
+    }
+
+    // create the fetch many dbo
+    DbOperator* dbo = malloc(sizeof(DbOperator));
+    dbo->operator_fields.fetch_many_operator.columns = columns;
+    dbo->operator_fields.fetch_many_operator.num_columns = num_columns;
+    dbo->operator_fields.fetch_many_operator.ids_result = ids_result;
+    dbo->operator_fields.fetch_many_operator.handles = handles;
+    dbo->type = FETCH_MANY;
+    return dbo;
+}
+
 /**
  * parse_join reads the arguments for a join statement and 
  * then passes these arguments to another function to execute. Also stores the 
@@ -493,17 +609,40 @@ DbOperator* parse_join(char* join_arguments, char* handle, message* send_message
         char val2_str[HANDLE_MAX_SIZE];
         char pos2_str[HANDLE_MAX_SIZE];
         char join_type_str[HANDLE_MAX_SIZE];
+        char output_str[HANDLE_MAX_SIZE];
         int join_type;
+        bool bitvector_output = false;
+        bool explain = false;
 
-        // scan in
-        sscanf(join_arguments, "%[^,],%[^,],%[^,],%[^,],%[^,]", val1_str, pos1_str, val2_str, pos2_str, join_type_str);
+        // scan in, the output format (or explain) is optional
+        int num_arguments = sscanf(join_arguments, "%[^,],%[^,],%[^,],%[^,],%[^,],%[^,]",
+            val1_str, pos1_str, val2_str, pos2_str, join_type_str, output_str);
         log_info("join arguments: %s, %s, %s, %s, %s\n", val1_str, pos1_str, val2_str, pos2_str, join_type_str);
+        if (num_arguments == 6) {
+            if (strcmp(output_str, "bitvector") == 0) {
+                // only the joined rows are wanted, not which matched which
+                bitvector_output = true;
+            } else if (strcmp(output_str, "explain") == 0) {
+                // only how the join would run is wanted
+                explain = true;
+            } else {
+                log_err("Not a known join output\n");
+                send_message->status = UNKNOWN_COMMAND;
+                return NULL;
+            }
+        }
 
         // get the join type
         if (strcmp(join_type_str, "nested-loop") == 0) {
             join_type = NESTED_LOOP_JOIN;
         } else if (strcmp(join_type_str, "hash") == 0) {
             join_type = HASH_JOIN;
+        } else if (strcmp(join_type_str, "sort-merge") == 0 || strcmp(join_type_str, "sort_merge") == 0) {
+            join_type = SORT_MERGE_JOIN;
+        } else if (strcmp(join_type_str, "index") == 0) {
+            join_type = INDEX_JOIN;
+        } else if (strcmp(join_type_str, "auto") == 0) {
+            join_type = AUTO_JOIN;
         } else {
             // incorrect format
             log_err("Not a known type of join\n");
@@ -516,8 +655,38 @@ DbOperator* parse_join(char* join_arguments, char* handle, message* send_message
         Result* pos1_result = lookup_handle_result(pos1_str, context);
         Result* val2_result = lookup_handle_result(val2_str, context);
         Result* pos2_result = lookup_handle_result(pos2_str, context);
-        if (val1_result == NULL || pos1_result == NULL ||
-            val2_result == NULL || pos2_result == NULL) {
+        // an index join takes the side to probe as an indexed column, and
+        // can't run without one. given one, an auto join can only be an
+        // index join
+        Column* columns[2] = { NULL, NULL };
+        int column_entries[2] = { 0, 0 };
+        if (join_type == INDEX_JOIN || (join_type == AUTO_JOIN && (val1_result == NULL || val2_result == NULL))) {
+            char* column_strs[2] = { val1_str, val2_str };
+            Result* val_results[2] = { val1_result, val2_result };
+            for (int i = 0; i < 2; ++i) {
+                GeneralizedColumn generalized_column;
+                if (val_results[i] == NULL &&
+                    find_column_or_result(column_strs[i], &generalized_column, &column_entries[i], context, send_message) == 0 &&
+                    generalized_column.column_type == COLUMN) {
+                    columns[i] = generalized_column.column_pointer.column;
+                }
+            }
+            // the other side has to be values to probe with, and the column
+            // needs an index to probe
+            Column* column = columns[0] != NULL ? columns[0] : columns[1];
+            bool one_column = (columns[0] != NULL) != (columns[1] != NULL);
+            bool values_on_other_side = columns[0] != NULL ? val2_result != NULL : val1_result != NULL;
+            if (!one_column || !values_on_other_side || (column->index_type == NO_INDEX && !column->clustered)) {
+                log_err("An index join needs values on one side and an indexed column on the other\n");
+                send_message->status = OBJECT_NOT_FOUND;
+                return NULL;
+            }
+        } else if (val1_result == NULL || val2_result == NULL) {
+            log_err("Couldn't find one of the necessary positions or values\n");
+            send_message->status = OBJECT_NOT_FOUND;
+            return NULL;
+        }
+        if (pos1_result == NULL || pos2_result == NULL) {
             log_err("Couldn't find one of the necessary positions or values\n");
             send_message->status = OBJECT_NOT_FOUND;
             return NULL;
@@ -530,6 +699,12 @@ DbOperator* parse_join(char* join_arguments, char* handle, message* send_message
         dbo->operator_fields.join_operator.pos1_result = pos1_result;
         dbo->operator_fields.join_operator.val2_result = val2_result;
         dbo->operator_fields.join_operator.pos2_result = pos2_result;
+        dbo->operator_fields.join_operator.column1 = columns[0];
+        dbo->operator_fields.join_operator.column1_entries = column_entries[0];
+        dbo->operator_fields.join_operator.column2 = columns[1];
+        dbo->operator_fields.join_operator.column2_entries = column_entries[1];
+        dbo->operator_fields.join_operator.bitvector_output = bitvector_output;
+        dbo->operator_fields.join_operator.explain = explain;
         strcpy(dbo->operator_fields.join_operator.left_handle, left_handle);
         strcpy(dbo->operator_fields.join_operator.right_handle, right_handle);
         dbo->type = JOIN;
@@ -666,6 +841,466 @@ DbOperator* parse_add(char* query_command, char* handle, message* send_message,
 }
 
 
+/*
+ * state shared by the recursive descent expression parser
+ */
+typedef struct ExprParser {
+    char* cursor; // next character to parse
+    ExpressionOperator* expression; // where nodes are added
+    int num_vector_results; // length of the vectors seen so far, -1 if none
+    ClientContext* context;
+    message* send_message;
+} ExprParser;
+
+static int parse_expr_sum(ExprParser* parser);
+
+/*
+ * adds a node to the expression being parsed, returns its index
+ */
+static int add_expr_node(ExprParser* parser, ExprNode node) {
+    ExpressionOperator* expression = parser->expression;
+    expression->nodes[expression->num_nodes] = node;
+    return expression->num_nodes++;
+}
+
+/*
+ * adds an operation over two nodes, folding it away if both are constants.
+ * returns the index of the resulting node, -1 on failure
+ */
+static int add_expr_operation(ExprParser* parser, char op, int left, int right) {
+    ExprNode* nodes = parser->expression->nodes;
+    ExprNode node = {0};
+    if (nodes[left].type == EXPR_CONSTANT && nodes[right].type == EXPR_CONSTANT) {
+        long x = nodes[left].constant;
+        long y = nodes[right].constant;
+        if (op == '/' && y == 0) {
+            log_err("constant division by zero\n");
+            parser->send_message->status = INCORRECT_FORMAT;
+            return -1;
+        }
+        node.type = EXPR_CONSTANT;
+        node.constant = (int) (op == '+' ? x + y : op == '-' ? x - y : op == '*' ? x * y : x / y);
+        // reuse the left node's slot, the right one is simply left unreferenced
+        nodes[left] = node;
+        return left;
+    }
+    node.type = EXPR_OPERATION;
+    node.op = op;
+    node.left = left;
+    node.right = right;
+    return add_expr_node(parser, node);
+}
+
+/*
+ * parses a factor: a parenthesized sum, a negation, a constant or a handle
+ * (either a result or db.table.column). returns its node index, -1 on failure
+ */
+static int parse_expr_factor(ExprParser* parser) {
+    char* cursor = parser->cursor;
+    ExprNode node = {0};
+    if (*cursor == '(') {
+        parser->cursor++;
+        int inner = parse_expr_sum(parser);
+        if (inner == -1 || *parser->cursor != ')') {
+            parser->send_message->status = INCORRECT_FORMAT;
+            return -1;
+        }
+        parser->cursor++;
+        return inner;
+    } else if (*cursor == '-') {
+        // negation is subtraction from zero
+        parser->cursor++;
+        int negated = parse_expr_factor(parser);
+        if (negated == -1) {
+            return -1;
+        }
+        node.type = EXPR_CONSTANT;
+        node.constant = 0;
+        return add_expr_operation(parser, '-', add_expr_node(parser, node), negated);
+    } else if (isdigit(*cursor)) {
+        node.type = EXPR_CONSTANT;
+        node.constant = (int) strtol(cursor, &parser->cursor, 10);
+        return add_expr_node(parser, node);
+    } else if (isalpha(*cursor) || *cursor == '_') {
+        // handles run until the next operator or paren
+        int length = 0;
+        while (isalnum(cursor[length]) || cursor[length] == '_' || cursor[length] == '.') {
+            ++length;
+        }
+        if (length >= HANDLE_MAX_SIZE * 3) {
+            parser->send_message->status = INCORRECT_FORMAT;
+            return -1;
+        }
+        char name[HANDLE_MAX_SIZE * 3];
+        strncpy(name, cursor, length);
+        name[length] = '\0';
+        parser->cursor += length;
+
+        GeneralizedColumn vector;
+        int num_results;
+        if (find_column_or_result(name, &vector, &num_results, parser->context, parser->send_message) == -1) {
+            log_err("expression operand not found\n");
+            parser->send_message->status = OBJECT_NOT_FOUND;
+            return -1;
+        }
+        // positions and bitvectors aren't values
+        if (vector.column_type == RESULT &&
+            (result_is_bitvector(vector.column_pointer.result) || vector.column_pointer.result->data_type != INT)) {
+            log_err("expression operands must be int value vectors\n");
+            parser->send_message->status = INCORRECT_FORMAT;
+            return -1;
+        }
+        // every vector has to line up
+        if (parser->num_vector_results != -1 && parser->num_vector_results != num_results) {
+            log_err("expression operands differ in length\n");
+            parser->send_message->status = INCORRECT_FORMAT;
+            return -1;
+        }
+        parser->num_vector_results = num_results;
+        node.type = EXPR_VECTOR;
+        node.data = vector.column_type == RESULT ?
+            (int*) vector.column_pointer.result->payload : vector.column_pointer.column->data;
+        return add_expr_node(parser, node);
+    }
+    parser->send_message->status = INCORRECT_FORMAT;
+    return -1;
+}
+
+/*
+ * parses factors joined by '*' or '/', returns the node index, -1 on failure
+ */
+static int parse_expr_product(ExprParser* parser) {
+    int left = parse_expr_factor(parser);
+    while (left != -1 && (*parser->cursor == '*' || *parser->cursor == '/')) {
+        char op = *parser->cursor++;
+        int right = parse_expr_factor(parser);
+        if (right == -1) {
+            return -1;
+        }
+        left = add_expr_operation(parser, op, left, right);
+    }
+    return left;
+}
+
+/*
+ * parses products joined by '+' or '-', returns the node index, -1 on failure
+ */
+static int parse_expr_sum(ExprParser* parser) {
+    int left = parse_expr_product(parser);
+    while (left != -1 && (*parser->cursor == '+' || *parser->cursor == '-')) {
+        char op = *parser->cursor++;
+        int right = parse_expr_product(parser);
+        if (right == -1) {
+            return -1;
+        }
+        left = add_expr_operation(parser, op, left, right);
+    }
+    return left;
+}
+
+/**
+ * parse_expression reads an arithmetic expression over columns, results and
+ * integer constants, e.g. expr((db1.tbl1.col1+r)*3-db1.tbl1.col2/2), into an
+ * expression tree and passes it on in the form of a DbOperator. Also stores
+ * the result in the client context.
+ **/
+DbOperator* parse_expression(char* query_command, char* handle, message* send_message, ClientContext* context) {
+    if (handle == NULL) {
+        send_message->status = INCORRECT_FORMAT;
+        return NULL;
+    }
+    // check for leading '('
+    if (strncmp(query_command, "(", 1) != 0) {
+        send_message->status = UNKNOWN_COMMAND;
+        return NULL;
+    }
+
+    // every node consumes at least one character, plus the zero we add per negation
+    int max_nodes = 2 * strlen(query_command) + 1;
+    ExpressionOperator expression;
+    expression.nodes = malloc(sizeof(ExprNode) * max_nodes);
+    expression.num_nodes = 0;
+    ExprParser parser;
+    parser.cursor = query_command;
+    parser.expression = &expression;
+    parser.num_vector_results = -1;
+    parser.context = context;
+    parser.send_message = send_message;
+
+    // the outer parens parse as a factor
+    expression.root = parse_expr_factor(&parser);
+    if (expression.root == -1 || *parser.cursor != '\0' || parser.num_vector_results == -1) {
+        log_err("expression must be well formed and use at least one column or result\n");
+        if (expression.root != -1) {
+            send_message->status = INCORRECT_FORMAT;
+        }
+        free(expression.nodes);
+        return NULL;
+    }
+    expression.num_results = parser.num_vector_results;
+    strcpy(expression.handle, handle);
+
+    // create the expression dbo
+    DbOperator* dbo = malloc(sizeof(DbOperator));
+    dbo->operator_fields.expression_operator = expression;
+    dbo->type = EXPRESSION;
+    return dbo;
+}
+
+/**
+ * parse_group_by reads the arguments for a group by operation, a key vector, a
+ * value vector and the aggregate to compute per key, and passes these on in
+ * the form of a DbOperator. The key and aggregate results are stored under
+ * the two handles on the left of the '='.
+ **/
+DbOperator* parse_group_by(char* query_command, char* handle, message* send_message, ClientContext* context) {
+    // we need both a key handle and an aggregate handle
+    if (handle == NULL || strchr(handle, ',') == NULL) {
+        send_message->status = INCORRECT_FORMAT;
+        return NULL;
+    }
+    char key_handle[HANDLE_MAX_SIZE];
+    char agg_handle[HANDLE_MAX_SIZE];
+    sscanf(handle, "%[^,],%[^,]", key_handle, agg_handle);
+    log_info("key_handle: %s, agg_handle: %s\n", key_handle, agg_handle);
+
+    // check for leading '('
+    if (strncmp(query_command, "(", 1) == 0) {
+        char* group_by_arguments = query_command + 1;
+
+        // read and chop off last char, which should be a ')'
+        int last_char = strlen(group_by_arguments) - 1;
+        if (group_by_arguments[last_char] != ')') {
+            send_message->status = INCORRECT_FORMAT;
+            return NULL;
+        }
+        // replace the ')' with a null terminating character. 
+        group_by_arguments[last_char] = '\0';
+
+        // should be a key handle, a value handle and an aggregate name
+        char keys_str[HANDLE_MAX_SIZE];
+        char values_str[HANDLE_MAX_SIZE];
+        char agg_str[HANDLE_MAX_SIZE];
+        if (sscanf(group_by_arguments, "%[^,],%[^,],%[^,]", keys_str, values_str, agg_str) != 3) {
+            send_message->status = INCORRECT_FORMAT;
+            return NULL;
+        }
+        log_info("group by arguments: %s, %s, %s\n", keys_str, values_str, agg_str);
+
+        // get the aggregate type
+        int agg_type;
+        if (strcmp(agg_str, "sum") == 0) {
+            agg_type = GROUP_BY_SUM;
+        } else if (strcmp(agg_str, "avg") == 0) {
+            agg_type = GROUP_BY_AVG;
+        } else if (strcmp(agg_str, "min") == 0) {
+            agg_type = GROUP_BY_MIN;
+        } else if (strcmp(agg_str, "max") == 0) {
+            agg_type = GROUP_BY_MAX;
+        } else if (strcmp(agg_str, "count") == 0) {
+            agg_type = GROUP_BY_COUNT;
+        } else {
+            log_err("Not a known type of aggregate\n");
+            send_message->status = UNKNOWN_COMMAND;
+            return NULL;
+        }
+
+        // lookup both handles
+        GeneralizedColumn keys;
+        int num_keys;
+        int success1 = find_column_or_result(keys_str, &keys, &num_keys, context, send_message);
+        GeneralizedColumn values;
+        int num_values;
+        int success2 = find_column_or_result(values_str, &values, &num_values, context, send_message);
+        if (success1 == -1 || success2 == -1) {
+            log_err("failure to find both handles\n");
+            send_message->status = OBJECT_NOT_FOUND;
+            return NULL;
+        }
+        // we group int values, not positions, and need one key per value
+        if (num_keys != num_values ||
+            (keys.column_type == RESULT &&
+             (result_is_bitvector(keys.column_pointer.result) || keys.column_pointer.result->data_type != INT)) ||
+            (values.column_type == RESULT &&
+             (result_is_bitvector(values.column_pointer.result) || values.column_pointer.result->data_type != INT))) {
+            log_err("group by needs int value vectors of the same length\n");
+            send_message->status = INCORRECT_FORMAT;
+            return NULL;
+        }
+
+        // create the group by dbo
+        DbOperator* dbo = malloc(sizeof(DbOperator));
+        dbo->operator_fields.group_by_operator.agg_type = agg_type;
+        dbo->operator_fields.group_by_operator.keys = keys;
+        dbo->operator_fields.group_by_operator.values = values;
+        dbo->operator_fields.group_by_operator.num_results = num_keys;
+        strcpy(dbo->operator_fields.group_by_operator.key_handle, key_handle);
+        strcpy(dbo->operator_fields.group_by_operator.agg_handle, agg_handle);
+        dbo->type = GROUP_BY;
+        return dbo;
+    } else {
+        send_message->status = UNKNOWN_COMMAND;
+        return NULL;
+    }
+}
+
+/**
+ * parse_sort reads the arguments for a topk or sort operation, a column or
+ * value vector, the positions a value vector was fetched from, how many
+ * values to keep (topk only) and an optional asc or desc, and passes these
+ * on in the form of a DbOperator. The values and their positions are stored
+ * under the two handles on the left of the '='.
+ **/
+DbOperator* parse_sort(char* query_command, char* handle, message* send_message, ClientContext* context, bool is_topk) {
+    // we need both a value handle and a position handle
+    if (handle == NULL || strchr(handle, ',') == NULL) {
+        send_message->status = INCORRECT_FORMAT;
+        return NULL;
+    }
+    char value_handle[HANDLE_MAX_SIZE];
+    char position_handle[HANDLE_MAX_SIZE];
+    sscanf(handle, "%[^,],%[^,]", value_handle, position_handle);
+    log_info("value_handle: %s, position_handle: %s\n", value_handle, position_handle);
+
+    // check for leading '('
+    if (strncmp(query_command, "(", 1) == 0) {
+        char* sort_arguments = query_command + 1;
+
+        // read and chop off last char, which should be a ')'
+        int last_char = strlen(sort_arguments) - 1;
+        if (sort_arguments[last_char] != ')') {
+            send_message->status = INCORRECT_FORMAT;
+            return NULL;
+        }
+        // replace the ')' with a null terminating character. 
+        sort_arguments[last_char] = '\0';
+
+        // should be a handle, the positions its values came from if it's a
+        // result, k for topk, and an optional direction
+        char* arguments[4];
+        int num_args = 0;
+        char* argument;
+        while ((argument = strsep(&sort_arguments, ",")) != NULL) {
+            if (num_args == 4) {
+                send_message->status = INCORRECT_FORMAT;
+                return NULL;
+            }
+            arguments[num_args++] = argument;
+        }
+
+        // lookup the handle
+        GeneralizedColumn generalized_column;
+        int num_results;
+        if (find_column_or_result(arguments[0], &generalized_column, &num_results, context, send_message) == -1) {
+            log_err("failure to find handle\n");
+            send_message->status = OBJECT_NOT_FOUND;
+            return NULL;
+        }
+        // we sort values, not positions
+        if (generalized_column.column_type == RESULT &&
+            (result_is_bitvector(generalized_column.column_pointer.result) ||
+             generalized_column.column_pointer.result->data_type != INT)) {
+            log_err("sort needs an int value vector\n");
+            send_message->status = INCORRECT_FORMAT;
+            return NULL;
+        }
+        int next_arg = 1;
+        // a result's indexes aren't rows, so like a join we need the
+        // positions its values were fetched from to hand back row ids
+        Result* positions = NULL;
+        if (generalized_column.column_type == RESULT) {
+            positions = next_arg < num_args ? lookup_handle_result(arguments[next_arg++], context) : NULL;
+            if (positions == NULL || (int) positions->num_tuples != num_results) {
+                log_err("sorting values needs the positions they were fetched from\n");
+                send_message->status = OBJECT_NOT_FOUND;
+                return NULL;
+            }
+        }
+        int k = -1;
+        if (is_topk) {
+            if (next_arg == num_args || sscanf(arguments[next_arg++], "%d", &k) != 1 || k < 0) {
+                send_message->status = INCORRECT_FORMAT;
+                return NULL;
+            }
+        }
+        const char* direction_str = next_arg < num_args ? arguments[next_arg++] : "asc";
+        if (next_arg != num_args) {
+            send_message->status = INCORRECT_FORMAT;
+            return NULL;
+        }
+        log_info("sort arguments: %s, %d, %s\n", arguments[0], k, direction_str);
+
+        bool descending;
+        if (strcmp(direction_str, "asc") == 0) {
+            descending = false;
+        } else if (strcmp(direction_str, "desc") == 0) {
+            descending = true;
+        } else {
+            log_err("Not a known sort direction\n");
+            send_message->status = UNKNOWN_COMMAND;
+            return NULL;
+        }
+
+        // create the sort dbo
+        DbOperator* dbo = malloc(sizeof(DbOperator));
+        dbo->operator_fields.sort_operator.generalized_column = generalized_column;
+        dbo->operator_fields.sort_operator.positions = positions;
+        dbo->operator_fields.sort_operator.num_results = num_results;
+        dbo->operator_fields.sort_operator.k = is_topk && k < num_results ? k : num_results;
+        dbo->operator_fields.sort_operator.descending = descending;
+        strcpy(dbo->operator_fields.sort_operator.value_handle, value_handle);
+        strcpy(dbo->operator_fields.sort_operator.position_handle, position_handle);
+        dbo->type = SORT;
+        return dbo;
+    } else {
+        send_message->status = UNKNOWN_COMMAND;
+        return NULL;
+    }
+}
+
+/**
+ * parse_tune reads the optional column for a tune command, which
+ * recalibrates shared scans on that column, or on a synthetic one without it
+ **/
+DbOperator* parse_tune(char* query_command, message* send_message, ClientContext* context) {
+    // check for leading '('
+    if (strncmp(query_command, "(", 1) == 0) {
+        char* tune_arguments = query_command + 1;
+
+        // read and chop off last char, which should be a ')'
+        int last_char = strlen(tune_arguments) - 1;
+        if (last_char < 0 || tune_arguments[last_char] != ')') {
+            send_message->status = INCORRECT_FORMAT;
+            return NULL;
+        }
+        // replace the ')' with a null terminating character.
+        tune_arguments[last_char] = '\0';
+
+        DbOperator* dbo = malloc(sizeof(DbOperator));
+        dbo->type = TUNE;
+        dbo->operator_fields.tune_operator.column = NULL;
+        dbo->operator_fields.tune_operator.num_entries = 0;
+        if (strlen(tune_arguments) > 0) {
+            // only a column of the database will do
+            GeneralizedColumn generalized_column;
+            int num_results;
+            if (find_column_or_result(tune_arguments, &generalized_column, &num_results, context, send_message) == -1 ||
+                generalized_column.column_type != COLUMN) {
+                log_err("tune needs a column\n");
+                send_message->status = OBJECT_NOT_FOUND;
+                free(dbo);
+                return NULL;
+            }
+            dbo->operator_fields.tune_operator.column = generalized_column.column_pointer.column;
+            dbo->operator_fields.tune_operator.num_entries = num_results;
+        }
+        return dbo;
+    } else {
+        send_message->status = UNKNOWN_COMMAND;
+        return NULL;
+    }
+}
+
 /**
  * parse_aggregate reads the arguments for a sum or avg statement (they take 
  * the same args) and passes these on in the form of a DbOperator to another 
@@ -691,8 +1326,40 @@ DbOperator* parse_aggregate(char* query_command, char* handle, message* send_mes
         ids_handle[last_char] = '\0';
         log_info("result to compute over: %s\n", ids_handle);
 
+        // avg and sum can trade exactness for speed: approx=<relative error>
+        double approx = 0.0;
+        char* approx_str = strchr(ids_handle, ',');
+        if (approx_str != NULL) {
+            *approx_str = '\0';
+            approx_str++;
+            char* approx_end;
+            if ((computation != AVG_FLAG && computation != SUM_FLAG) ||
+                strncmp(approx_str, "approx=", 7) != 0) {
+                send_message->status = INCORRECT_FORMAT;
+                return NULL;
+            }
+            approx = strtod(approx_str + 7, &approx_end);
+            if (approx_end == approx_str + 7 || *approx_end != '\0' || approx <= 0.0) {
+                send_message->status = INCORRECT_FORMAT;
+                return NULL;
+            }
+        }
+        // an approximate answer can also hand back its error, a,e=avg(...)
+        char error_handle[HANDLE_MAX_SIZE];
+        error_handle[0] = '\0';
+        char* error_handle_str = strchr(handle, ',');
+        if (error_handle_str != NULL) {
+            if (approx == 0.0) {
+                send_message->status = INCORRECT_FORMAT;
+                return NULL;
+            }
+            *error_handle_str = '\0';
+            strcpy(error_handle, error_handle_str + 1);
+        }
+
         // find the column we are averaging
         GeneralizedColumn to_compute;
+        Table* table = NULL;
         int num_results;
         // check to see if it's a handle
         Result* result = lookup_handle_result(ids_handle, context);
@@ -720,7 +1387,7 @@ DbOperator* parse_aggregate(char* query_command, char* handle, message* send_mes
                 to_compute.column_type = COLUMN;
                 to_compute.column_pointer.column = column;
                 // get the table so we know the column size
-                Table* table = lookup_table(table_name);
+                table = lookup_table(table_name);
                 num_results = table->table_size;
             }
         } else {
@@ -737,11 +1404,17 @@ DbOperator* parse_aggregate(char* query_command, char* handle, message* send_mes
             dbo->operator_fields.average_operator.generalized_column = to_compute;
             dbo->operator_fields.average_operator.num_results = num_results;
             strcpy(dbo->operator_fields.average_operator.handle, handle);
+            dbo->operator_fields.average_operator.approx = approx;
+            dbo->operator_fields.average_operator.table = table;
+            strcpy(dbo->operator_fields.average_operator.error_handle, error_handle);
             dbo->type = AVERAGE;
         } else if (computation == SUM_FLAG) {
             dbo->operator_fields.sum_operator.generalized_column = to_compute;
             dbo->operator_fields.sum_operator.num_results = num_results;
             strcpy(dbo->operator_fields.sum_operator.handle, handle);
+            dbo->operator_fields.sum_operator.approx = approx;
+            dbo->operator_fields.sum_operator.table = table;
+            strcpy(dbo->operator_fields.sum_operator.error_handle, error_handle);
             dbo->type = SUM;
         } else if (computation == MIN_FLAG) {
             dbo->operator_fields.min_operator.generalized_column = to_compute;
@@ -1169,6 +1842,9 @@ DbOperator* parse_command(char* query_command, message* send_message, int client
     } else if (strncmp(query_command, "select", 6) == 0) {
         query_command += 6;
         dbo = parse_select(query_command, handle, send_message, context);
+    } else if (strncmp(query_command, "fetch_many", 10) == 0) {
+        query_command += 10;
+        dbo = parse_fetch_many(query_command, handle, send_message, context);
     } else if (strncmp(query_command, "fetch", 5) == 0) {
         query_command += 5;
         dbo = parse_fetch(query_command, handle, send_message, context);
@@ -1193,6 +1869,21 @@ DbOperator* parse_command(char* query_command, message* send_message, int client
     } else if (strncmp(query_command, "sub", 3) == 0) {
         query_command += 3;
         dbo = parse_add(query_command, handle, send_message, context, SUB_FLAG);
+    } else if (strncmp(query_command, "expr", 4) == 0) {
+        query_command += 4;
+        dbo = parse_expression(query_command, handle, send_message, context);
+    } else if (strncmp(query_command, "group_by", 8) == 0) {
+        query_command += 8;
+        dbo = parse_group_by(query_command, handle, send_message, context);
+    } else if (strncmp(query_command, "topk", 4) == 0) {
+        query_command += 4;
+        dbo = parse_sort(query_command, handle, send_message, context, true);
+    } else if (strncmp(query_command, "sort", 4) == 0) {
+        query_command += 4;
+        dbo = parse_sort(query_command, handle, send_message, context, false);
+    } else if (strncmp(query_command, "tune", 4) == 0) {
+        query_command += 4;
+        dbo = parse_tune(query_command, send_message, context);
     } else if (strncmp(query_command, "shutdown", 8) == 0) {
         /*if (shutdown_database(current_db).code == OK) {*/
             /*send_message->status = OK_DONE;*/
@@ -1221,7 +1912,10 @@ DbOperator* parse_command(char* query_command, message* send_message, int client
     if (currently_batching_query == true && dbo->type != SHARED_SCAN) {
         log_info("log shared scan, dont execute yet\n");
         // dont send on the actual dbo, log it to be executed later and send
-        // along a different one
+        // along a different one. queries the batch answers through an index
+        // run like lone ones, so they need to know their client
+        dbo->client_fd = client_socket;
+        dbo->context = context;
         add_shared_dbo(dbo);
         DbOperator* new_dbo = malloc(sizeof(DbOperator));
         new_dbo->type = SHARED_QUERY_LOGGED;
@@ -2,44 +2,137 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <assert.h>
+#include <stdbool.h>
+#include <string.h>
 
-#include "hash_table.h"
+#include "../include/hash_table.h"
 
 // This code is designed to stress test your hash table implementation. You do
 // not need to significantly change it, but you may want to vary the value of
 // num_tests to control the amount of time and memory that benchmarking takes
 // up. Compile and run it in the command line by typing:
 // make benchmark; ./benchmark
+//
+// It builds against the server's hash table, and runs the same keys through
+// the chained table and the flat join table so the two can be compared. The
+// second table to run pays for the memory the first one gave back, so for a
+// fair comparison run them one at a time: ./benchmark chained; ./benchmark join
 
+// seconds between two times of day
+static double elapsed(struct timeval start, struct timeval stop) {
+  return (double)(stop.tv_usec - start.tv_usec) / 1000000 + (double)(stop.tv_sec - start.tv_sec);
+}
 
+int main(int argc, char** argv) {
 
-int main(void) {
-
-  hashtable* ht=NULL;
   int num_tests = 50000000;
-  int failure = allocate(&ht, num_tests);
-  assert(!failure);
-
   int seed = 2;
   srand(seed);
-  printf("Performing stress test. Inserting 50 million keys.\n");
+  keyType* keys = malloc(sizeof(keyType) * num_tests);
+  valType* values = malloc(sizeof(valType) * num_tests);
+  assert(keys != NULL && values != NULL);
+  for (int i = 0; i < num_tests; i += 1) {
+    keys[i] = rand();
+    values[i] = rand();
+  }
 
+  bool run_chained = argc < 2 || strcmp(argv[1], "chained") == 0;
+  bool run_join = argc < 2 || strcmp(argv[1], "join") == 0;
   struct timeval stop, start;
-  gettimeofday(&start, NULL);
+  int failure = 0;
 
-  for (int i = 0; i < num_tests; i += 1) {
-    int key = rand();
-    int val = rand();
-    failure = put(ht, key, val);
+  // the chained table, one put and one get at a time. every match is
+  // gathered into pairs, the way the join table's batch probe does
+  if (run_chained) {
+    hashtable* ht=NULL;
+    failure = allocate(&ht, num_tests);
+    assert(!failure);
+    printf("Performing stress test. Inserting 50 million keys.\n");
+
+    gettimeofday(&start, NULL);
+    for (int i = 0; i < num_tests; i += 1) {
+      failure = put(ht, keys[i], values[i]);
+      assert(!failure);
+    }
+    gettimeofday(&stop, NULL);
+    printf("50 million insertions took %f seconds\n", elapsed(start, stop));
+
+    int key_capacity = 16;
+    valType* key_matches = malloc(sizeof(valType) * key_capacity);
+    int match_capacity = 1024;
+    valType* probe_matches = malloc(sizeof(valType) * match_capacity);
+    valType* build_matches = malloc(sizeof(valType) * match_capacity);
+    assert(key_matches != NULL && probe_matches != NULL && build_matches != NULL);
+    long chained_matches = 0;
+    gettimeofday(&start, NULL);
+    for (int i = 0; i < num_tests; i += 1) {
+      int num_results = 0;
+      failure = get(ht, keys[i], key_matches, key_capacity, &num_results);
+      assert(!failure);
+      if (num_results > key_capacity) {
+        // a key with more matches than fit, grow and look it up again
+        while (key_capacity < num_results) {
+          key_capacity *= 2;
+        }
+        key_matches = realloc(key_matches, sizeof(valType) * key_capacity);
+        assert(key_matches != NULL);
+        failure = get(ht, keys[i], key_matches, key_capacity, &num_results);
+        assert(!failure);
+      }
+      if (chained_matches + num_results > match_capacity) {
+        while (chained_matches + num_results > match_capacity) {
+          match_capacity *= 2;
+        }
+        probe_matches = realloc(probe_matches, sizeof(valType) * match_capacity);
+        build_matches = realloc(build_matches, sizeof(valType) * match_capacity);
+        assert(probe_matches != NULL && build_matches != NULL);
+      }
+      for (int j = 0; j < num_results; j += 1) {
+        probe_matches[chained_matches] = values[i];
+        build_matches[chained_matches] = key_matches[j];
+        chained_matches += 1;
+      }
+    }
+    gettimeofday(&stop, NULL);
+    printf("50 million lookups took %f seconds (%ld matches)\n", elapsed(start, stop), chained_matches);
+
+    free(key_matches);
+    free(probe_matches);
+    free(build_matches);
+    failure = deallocate(ht);
     assert(!failure);
   }
 
-  gettimeofday(&stop, NULL);
-  double secs = (double)(stop.tv_usec - start.tv_usec) / 1000000 + (double)(stop.tv_sec - start.tv_sec); 
-  printf("50 million insertions took %f seconds\n", secs);
+  // the flat join table, built and probed in bulk
+  if (run_join) {
+    jointable* jt = NULL;
+    printf("Performing stress test on the join table. Building from 50 million keys.\n");
+
+    gettimeofday(&start, NULL);
+    failure = join_allocate(&jt, num_tests, 0);
+    assert(!failure);
+    failure = join_build(jt, keys, values, num_tests);
+    assert(!failure);
+    gettimeofday(&stop, NULL);
+    printf("50 million insertions took %f seconds\n", elapsed(start, stop));
+
+    valType* probe_matches = NULL;
+    valType* build_matches = NULL;
+    int match_capacity = 0;
+    int num_matches = 0;
+    gettimeofday(&start, NULL);
+    failure = join_probe_batch(jt, keys, values, num_tests, &probe_matches, &build_matches, &match_capacity, &num_matches);
+    assert(!failure);
+    gettimeofday(&stop, NULL);
+    printf("50 million lookups took %f seconds (%d matches)\n", elapsed(start, stop), num_matches);
 
-  failure = deallocate(ht);
-  assert(!failure);
+    free(probe_matches);
+    free(build_matches);
+    failure = join_deallocate(jt);
+    assert(!failure);
+  }
 
+  free(keys);
+  free(values);
   return 0;
 }
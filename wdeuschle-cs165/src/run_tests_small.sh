@@ -88,6 +88,27 @@ echo "Test 40 Errors:" >> test_results.txt
 cat ../project_tests/test40.dsl | ./client > output.txt && diff output.txt ../project_tests/test40.exp >> test_results.txt
 echo "Test 41 Errors:" >> test_results.txt
 cat ../project_tests/test41.dsl | ./client > output.txt && diff output.txt ../project_tests/test41.exp >> test_results.txt
+echo "Extensions"
+echo "Test 42 Errors:" >> test_results.txt
+cat ../project_tests/test42.dsl | ./client > output.txt && diff output.txt ../project_tests/test42.exp >> test_results.txt
+echo "Test 43 Errors:" >> test_results.txt
+cat ../project_tests/test43.dsl | ./client > output.txt && diff output.txt ../project_tests/test43.exp >> test_results.txt
+echo "Test 44 Errors:" >> test_results.txt
+cat ../project_tests/test44.dsl | ./client > output.txt && diff output.txt ../project_tests/test44.exp >> test_results.txt
+echo "Test 45 Errors:" >> test_results.txt
+cat ../project_tests/test45.dsl | ./client > output.txt && diff output.txt ../project_tests/test45.exp >> test_results.txt
+echo "Test 46 Errors:" >> test_results.txt
+cat ../project_tests/test46.dsl | ./client > output.txt && diff output.txt ../project_tests/test46.exp >> test_results.txt
+echo "Test 47 Errors:" >> test_results.txt
+cat ../project_tests/test47.dsl | ./client > output.txt && diff output.txt ../project_tests/test47.exp >> test_results.txt
+echo "Test 48 Errors:" >> test_results.txt
+cat ../project_tests/test48.dsl | ./client > output.txt && diff output.txt ../project_tests/test48.exp >> test_results.txt
+echo "Test 49 Errors:" >> test_results.txt
+cat ../project_tests/test49.dsl | ./client > output.txt && diff output.txt ../project_tests/test49.exp >> test_results.txt
+echo "Test 50 Errors:" >> test_results.txt
+cat ../project_tests/test50.dsl | ./client > output.txt && diff output.txt ../project_tests/test50.exp >> test_results.txt
+echo "Test 51 Errors:" >> test_results.txt
+cat ../project_tests/test51.dsl | ./client > output.txt && diff output.txt ../project_tests/test51.exp >> test_results.txt
 echo "real_shutdown" | ./client
 echo "Test Results:"
 cat test_results.txt
@@ -33,6 +33,10 @@
 #include "client_context.h"
 #include "batch_manager.h"
 #include "db_join.h"
+#include "db_group_by.h"
+#include "db_expression.h"
+#include "db_sort.h"
+#include "worker_pool.h"
 
 #define DEFAULT_QUERY_BUFFER_SIZE 1024
 #define CLIENT_CONTEXT_SIZE_START 16
@@ -141,6 +145,9 @@ void execute_DbOperator(DbOperator* query, message* send_message) {
         cpu_time_used = ((double) (end - start)) / CLOCKS_PER_SEC;
         log_timing("time to fetch: %f\n", cpu_time_used);
         // ******************
+    } else if (query->type == FETCH_MANY) {
+        // fetch every column in one pass over the positions
+        db_fetch_many(query, send_message);
     } else if (query->type == JOIN) {
         db_join(query, send_message);
     } else if (query->type == AVERAGE) {
@@ -161,6 +168,18 @@ void execute_DbOperator(DbOperator* query, message* send_message) {
     } else if (query->type == SUB) {
         // add the columns, multiplying the second column by -1
         db_add(query, send_message, -1);
+    } else if (query->type == EXPRESSION) {
+        // evaluate the arithmetic expression
+        db_expression(query, send_message);
+    } else if (query->type == GROUP_BY) {
+        // group the values by key and aggregate each group
+        db_group_by(query, send_message);
+    } else if (query->type == SORT) {
+        // sort the values, or keep only the first k of them
+        db_sort(query, send_message);
+    } else if (query->type == TUNE) {
+        // recalibrate shared scans
+        shared_scan_tune(query, send_message);
     } else if (query->type == SHARED_SCAN) {
         // execute shared scan
 
@@ -244,8 +263,6 @@ void handle_client(int client_socket) {
     shared_scan_operators.num_dbos = 0;
     shared_scan_operators.dbo_slots = 0; // SHARED_QUERY_START_SIZE;
     shared_scan_operators.dbos = NULL; // malloc(sizeof(DbOperator*) * SHARED_QUERY_START_SIZE);
-    shared_scan_operators.col = NULL;
-    shared_scan_operators.num_entries = 0;
 
 
     // Continually receive messages from client and execute queries.
@@ -269,8 +286,16 @@ void handle_client(int client_socket) {
             recv_message.payload[recv_message.length] = '\0';
             send_message.payload = NULL;
 
-            // 1. Parse command
-            DbOperator* query = parse_command(recv_message.payload, &send_message, client_socket, client_context);
+            // selects and fetches wait to share a scan with the ones after
+            // them, anything that may need their results makes them run first
+            DbOperator* query = NULL;
+            if (!cooperative_scan_before_command(recv_message.payload, client_context, &send_message)) {
+                // 1. Parse command
+                query = parse_command(recv_message.payload, &send_message, client_socket, client_context);
+                if (cooperative_scan_offer(query, &send_message)) {
+                    query = NULL;
+                }
+            }
 
             // 2. Handle request
             execute_DbOperator(query, &send_message);
@@ -296,6 +321,7 @@ void handle_client(int client_socket) {
     } while (!done);
 
     log_info("Connection closed at socket %d!\n", client_socket);
+    cooperative_scan_discard();
     client_context_free(client_context);
     close(client_socket);
 }
@@ -371,5 +397,7 @@ int main(void)
         handle_client(client_socket);
     }
 
+    // stop the threads we kept around for parallel operators
+    worker_pool_shutdown();
     return 0;
 }
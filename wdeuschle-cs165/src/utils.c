@@ -34,6 +34,13 @@ void db_operator_free(DbOperator* dbo) {
     } else if (dbo->type == INSERT) {
         // free the values pointer
         free(dbo->operator_fields.insert_operator.values);
+    } else if (dbo->type == FETCH_MANY) {
+        // free the columns and handles
+        free(dbo->operator_fields.fetch_many_operator.columns);
+        free(dbo->operator_fields.fetch_many_operator.handles);
+    } else if (dbo->type == EXPRESSION) {
+        // free the expression tree
+        free(dbo->operator_fields.expression_operator.nodes);
     } else if (dbo->type == PRINT) {
         // free each of the result pointer
         free(dbo->operator_fields.print_operator.results);
@@ -70,6 +77,14 @@ int* bitvector_to_vector(int* bv, int num_bv_ints, int num_entries) {
     return results;
 }
 
+/**
+ * Returns whether a result holds a position bitvector, as selects produce,
+ * rather than one int per tuple
+ **/
+bool result_is_bitvector(Result* result) {
+    return !result->is_posn_vector && result->bitvector_ints > 0;
+}
+
 /**
  * Computes the number of batches needed to send an entire message server to client.
  **/
@@ -0,0 +1,317 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "worker_pool.h"
+#include "hardware.h"
+#include "utils.h"
+
+#define STEAL_SUCCESS 1
+#define STEAL_EMPTY 0
+#define STEAL_RETRY -1
+
+// started the first time there's work for it
+static WorkerPool* worker_pool = NULL;
+// one job at a time, and guards starting and stopping the pool
+static pthread_mutex_t worker_pool_submit_lock = PTHREAD_MUTEX_INITIALIZER;
+// set while a thread is running a task, so nested jobs run inline
+static __thread bool in_pool_task = false;
+
+/*
+ * adds a task to the bottom of a deque. only called between jobs, when no
+ * thread can be stealing, so the array can grow in place
+ */
+static void work_deque_push(WorkDeque* deque, WorkerTask task) {
+    long bottom = deque->bottom;
+    long top = deque->top;
+    // double size if necessary before pushing
+    if (bottom - top >= deque->capacity) {
+        WorkerTask* old_tasks = deque->tasks;
+        long old_capacity = deque->capacity;
+        deque->capacity = 2 * old_capacity;
+        deque->tasks = malloc(sizeof(WorkerTask) * deque->capacity);
+        for (long i = top; i < bottom; ++i) {
+            deque->tasks[i & (deque->capacity - 1)] = old_tasks[i & (old_capacity - 1)];
+        }
+        free(old_tasks);
+    }
+    deque->tasks[bottom & (deque->capacity - 1)] = task;
+    __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * takes a task off the bottom of the calling thread's own deque. returns
+ * false if it was empty or a thief got the last task first
+ */
+static bool work_deque_take(WorkDeque* deque, WorkerTask* task) {
+    long bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) - 1;
+    __atomic_store_n(&deque->bottom, bottom, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    long top = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+    if (top > bottom) {
+        // empty, put bottom back
+        __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+        return false;
+    }
+    *task = deque->tasks[bottom & (deque->capacity - 1)];
+    if (top != bottom) {
+        // more than one task left, no thief can reach this one
+        return true;
+    }
+    // last task, race any thieves for it
+    bool won = __atomic_compare_exchange_n(&deque->top, &top, top + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+    __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+    return won;
+}
+
+/*
+ * steals a task off the top of another thread's deque. returns STEAL_RETRY
+ * if another thread took the task first
+ */
+static int work_deque_steal(WorkDeque* deque, WorkerTask* task) {
+    long top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    long bottom = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+    if (top >= bottom) {
+        return STEAL_EMPTY;
+    }
+    WorkerTask stolen = deque->tasks[top & (deque->capacity - 1)];
+    if (!__atomic_compare_exchange_n(&deque->top, &top, top + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+        return STEAL_RETRY;
+    }
+    *task = stolen;
+    return STEAL_SUCCESS;
+}
+
+/*
+ * runs tasks from a thread's own deque, then steals from the others, until
+ * there is nothing left to start
+ */
+static void worker_pool_work(WorkerPool* pool, int self) {
+    int num_deques = pool->num_workers + 1;
+    WorkerTask task;
+    while (true) {
+        bool found = work_deque_take(&(pool->deques[self]), &task);
+        bool contended = false;
+        for (int i = 1; !found && i < num_deques; ++i) {
+            int outcome = work_deque_steal(&(pool->deques[(self + i) % num_deques]), &task);
+            found = outcome == STEAL_SUCCESS;
+            contended = contended || outcome == STEAL_RETRY;
+        }
+        if (!found) {
+            // tasks are never added mid job, so only a lost race means
+            // there might be something left
+            if (contended) {
+                continue;
+            }
+            return;
+        }
+
+        in_pool_task = true;
+        task.fn(task.arg);
+        in_pool_task = false;
+        // the last task to finish wakes the submitter
+        if (__atomic_sub_fetch(&(pool->remaining_tasks), 1, __ATOMIC_ACQ_REL) == 0) {
+            pthread_mutex_lock(&(pool->lock));
+            pthread_cond_broadcast(&(pool->job_done));
+            pthread_mutex_unlock(&(pool->lock));
+        }
+    }
+}
+
+/*
+ * a worker sleeps until there's a new job, helps finish it, and goes back to
+ * sleep
+ */
+static void* worker_pool_thread(void* id_void) {
+    int id = (int) (intptr_t) id_void;
+    WorkerPool* pool = worker_pool;
+    long seen_job = 0;
+    while (true) {
+        pthread_mutex_lock(&(pool->lock));
+        while (!pool->shutdown && pool->job_id == seen_job) {
+            pthread_cond_wait(&(pool->job_ready), &(pool->lock));
+        }
+        if (pool->shutdown) {
+            pthread_mutex_unlock(&(pool->lock));
+            return NULL;
+        }
+        seen_job = pool->job_id;
+        // sit out jobs that were given fewer threads
+        if (id >= pool->job_threads - 1) {
+            pthread_mutex_unlock(&(pool->lock));
+            continue;
+        }
+        ++pool->active_workers;
+        pthread_mutex_unlock(&(pool->lock));
+
+        worker_pool_work(pool, id);
+
+        // the next job can't be dealt out until every worker is done looking
+        pthread_mutex_lock(&(pool->lock));
+        if (--pool->active_workers == 0) {
+            pthread_cond_broadcast(&(pool->job_done));
+        }
+        pthread_mutex_unlock(&(pool->lock));
+    }
+}
+
+/*
+ * creates the pool and starts its threads. if some threads can't be started
+ * the pool runs with the ones that were. returns 0 on success and -1 on
+ * failure
+ */
+static int worker_pool_start(void) {
+    // one thread per cpu, the submitting thread being one of them
+    int pool_size = available_cpus();
+    if (pool_size > WORKER_POOL_MAX_SIZE) {
+        pool_size = WORKER_POOL_MAX_SIZE;
+    }
+    WorkerPool* pool = calloc(1, sizeof(WorkerPool));
+    pool->threads = malloc(sizeof(pthread_t) * pool_size);
+    pool->deques = calloc(pool_size, sizeof(WorkDeque));
+    pool->num_deques = pool_size;
+    for (int i = 0; i < pool_size; ++i) {
+        pool->deques[i].capacity = WORK_DEQUE_START_CAPACITY;
+        pool->deques[i].tasks = malloc(sizeof(WorkerTask) * WORK_DEQUE_START_CAPACITY);
+    }
+    if (pthread_mutex_init(&(pool->lock), NULL) != 0 ||
+        pthread_cond_init(&(pool->job_ready), NULL) != 0 ||
+        pthread_cond_init(&(pool->job_done), NULL) != 0) {
+        log_err("Failed to create worker pool locks\n");
+        for (int i = 0; i < pool_size; ++i) {
+            free(pool->deques[i].tasks);
+        }
+        free(pool->deques);
+        free(pool->threads);
+        free(pool);
+        return -1;
+    }
+    worker_pool = pool;
+
+    int num_started = 0;
+    for (int i = 0; i < pool_size - 1; ++i) {
+        if (pthread_create(&(pool->threads[i]), NULL, worker_pool_thread, (void*) (intptr_t) i)) {
+            log_err("Failed to start worker %d\n", i);
+            break;
+        }
+        ++num_started;
+    }
+    // workers only read this once a job wakes them
+    pthread_mutex_lock(&(pool->lock));
+    pool->num_workers = num_started;
+    pthread_mutex_unlock(&(pool->lock));
+    return 0;
+}
+
+/*
+ * this function runs fn over each of num_args args laid out arg_size bytes
+ * apart on the worker pool, and waits for them all. the calling thread
+ * works on the job as well. calls made from inside a task run inline.
+ * returns 0 on success and -1 on failure
+ */
+int worker_pool_run(void* (*fn)(void*), void* args, size_t arg_size, int num_args) {
+    return worker_pool_run_on(fn, args, arg_size, num_args, WORKER_POOL_MAX_SIZE);
+}
+
+/*
+ * this function is worker_pool_run on at most num_threads threads, counting
+ * the calling thread. the rest of the pool sits the job out
+ */
+int worker_pool_run_on(void* (*fn)(void*), void* args, size_t arg_size, int num_args, int num_threads) {
+    // a single task, or a task from a task, stays on this thread
+    if (num_args <= 1 || num_threads <= 1 || in_pool_task) {
+        for (int i = 0; i < num_args; ++i) {
+            fn((char*) args + (i * arg_size));
+        }
+        return 0;
+    }
+
+    pthread_mutex_lock(&worker_pool_submit_lock);
+    if (worker_pool == NULL && worker_pool_start() != 0) {
+        pthread_mutex_unlock(&worker_pool_submit_lock);
+        return -1;
+    }
+    WorkerPool* pool = worker_pool;
+    int job_threads = pool->num_workers + 1;
+    if (num_threads < job_threads) {
+        job_threads = num_threads;
+    }
+
+    pthread_mutex_lock(&(pool->lock));
+    // deques can only be filled once every worker is done with the last job
+    while (pool->active_workers > 0) {
+        pthread_cond_wait(&(pool->job_done), &(pool->lock));
+    }
+    // deal the tasks out evenly over the threads working this job, the last
+    // deque being ours. anyone who runs out steals the rest
+    for (int i = 0; i < num_args; ++i) {
+        WorkerTask task = { fn, (char*) args + (i * arg_size) };
+        int deque = i % job_threads;
+        if (deque == job_threads - 1) {
+            deque = pool->num_workers;
+        }
+        work_deque_push(&(pool->deques[deque]), task);
+    }
+    __atomic_store_n(&(pool->remaining_tasks), num_args, __ATOMIC_RELEASE);
+    pool->job_threads = job_threads;
+    ++pool->job_id;
+    pthread_cond_broadcast(&(pool->job_ready));
+    pthread_mutex_unlock(&(pool->lock));
+
+    // pitch in with the last deque rather than sit idle
+    worker_pool_work(pool, pool->num_workers);
+
+    pthread_mutex_lock(&(pool->lock));
+    while (__atomic_load_n(&(pool->remaining_tasks), __ATOMIC_ACQUIRE) > 0) {
+        pthread_cond_wait(&(pool->job_done), &(pool->lock));
+    }
+    pthread_mutex_unlock(&(pool->lock));
+    pthread_mutex_unlock(&worker_pool_submit_lock);
+    return 0;
+}
+
+/*
+ * this function returns how many threads work on each job, counting the
+ * thread that submits it. there's one per cpu we're allowed to use
+ */
+int worker_pool_threads(void) {
+    pthread_mutex_lock(&worker_pool_submit_lock);
+    if (worker_pool == NULL && worker_pool_start() != 0) {
+        pthread_mutex_unlock(&worker_pool_submit_lock);
+        return 1;
+    }
+    int num_threads = worker_pool->num_workers + 1;
+    pthread_mutex_unlock(&worker_pool_submit_lock);
+    return num_threads;
+}
+
+/*
+ * this function stops the worker pool's threads and frees it
+ */
+void worker_pool_shutdown(void) {
+    pthread_mutex_lock(&worker_pool_submit_lock);
+    WorkerPool* pool = worker_pool;
+    if (pool == NULL) {
+        pthread_mutex_unlock(&worker_pool_submit_lock);
+        return;
+    }
+    pthread_mutex_lock(&(pool->lock));
+    pool->shutdown = true;
+    pthread_cond_broadcast(&(pool->job_ready));
+    pthread_mutex_unlock(&(pool->lock));
+    for (int i = 0; i < pool->num_workers; ++i) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    for (int i = 0; i < pool->num_deques; ++i) {
+        free(pool->deques[i].tasks);
+    }
+    free(pool->deques);
+    free(pool->threads);
+    pthread_mutex_destroy(&(pool->lock));
+    pthread_cond_destroy(&(pool->job_ready));
+    pthread_cond_destroy(&(pool->job_done));
+    free(pool);
+    worker_pool = NULL;
+    pthread_mutex_unlock(&worker_pool_submit_lock);
+}